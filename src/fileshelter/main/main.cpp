@@ -19,31 +19,75 @@
 
 #include <filesystem>
 #include <iostream>
+#include <optional>
+#include <string_view>
 #include <thread>
 
 #include <boost/property_tree/xml_parser.hpp>
 
 #include <Wt/WServer.h>
 
+#include "share/IEncodedFileCache.hpp"
 #include "share/IShareManager.hpp"
+#include "share/IZipCache.hpp"
 #include "utils/Exception.hpp"
 #include "utils/IConfig.hpp"
+#include "utils/IMetrics.hpp"
+#include "utils/IOpenFileCache.hpp"
+#include "utils/IPageCachePrewarmer.hpp"
 #include "utils/Logger.hpp"
+#include "utils/PageCache.hpp"
 #include "utils/Service.hpp"
+#include "utils/SparseFile.hpp"
 
+#include "resources/MetricsResource.hpp"
 #include "resources/ShareResource.hpp"
 
 #include "ui/FileShelterApplicationCreator.hpp"
 
-std::vector<std::string> generateWtConfig(std::string execPath)
+unsigned long getHttpServerThreadCount()
+{
+    // Reserve at least 2 threads since we still have some blocking IO (reading on disk)
+    const unsigned long configHttpServerThreadCount{ Service<IConfig>::get()->getULong("http-server-thread-count", 0) };
+    return configHttpServerThreadCount ? configHttpServerThreadCount : std::max<unsigned long>(2, std::thread::hardware_concurrency());
+}
+
+// Processes sharing the same working directory may each serve a part of the application, routed by the reverse proxy
+enum class ServerRole
+{
+    All,
+    Ui,        // web interface only
+    Downloads, // share resource only
+};
+
+ServerRole getServerRole()
+{
+    const std::string_view role{ Service<IConfig>::get()->getString("server-role", "all") };
+    if (role == "all")
+        return ServerRole::All;
+    if (role == "ui")
+        return ServerRole::Ui;
+    if (role == "downloads")
+        return ServerRole::Downloads;
+
+    throw FsException{ "Invalid value '" + std::string{ role } + "' for server-role" };
+}
+
+std::vector<std::string> generateWtConfig(std::string execPath, ServerRole role)
 {
     std::vector<std::string> args;
 
-    const std::filesystem::path wtConfigPath{ Service<IConfig>::get()->getPath("working-dir") / "wt_config.xml" };
+    // not shared between the processes
+    std::string wtConfigFileName{ "wt_config.xml" };
+    if (role == ServerRole::Ui)
+        wtConfigFileName = "wt_config-ui.xml";
+    else if (role == ServerRole::Downloads)
+        wtConfigFileName = "wt_config-downloads.xml";
+
+    const std::filesystem::path wtConfigPath{ Service<IConfig>::get()->getPath("working-dir") / wtConfigFileName };
     const std::filesystem::path wtLogFilePath{ Service<IConfig>::get()->getPath("log-file", "") };
     const std::filesystem::path wtAccessLogFilePath{ Service<IConfig>::get()->getPath("access-log-file", "") };
     const std::filesystem::path userMsgPath{ Service<IConfig>::get()->getPath("working-dir") / "user_messages.xml" };
-    const unsigned long configHttpServerThreadCount{ Service<IConfig>::get()->getULong("http-server-thread-count", 0) };
 
     args.push_back(execPath);
     args.push_back("--config=" + wtConfigPath.string());
@@ -67,11 +111,7 @@ std::vector<std::string> generateWtConfig(std::string execPath)
 		args.push_back("--http-listen=" + std::string {Service<IConfig>::get()->getString("listen", "0.0.0.0:5091")});
 	}
 
-    {
-        // Reserve at least 2 threads since we still have some blocking IO (reading on disk)
-        const unsigned long httpServerThreadCount{ configHttpServerThreadCount ? configHttpServerThreadCount : std::max<unsigned long>(2, std::thread::hardware_concurrency()) };
-        args.push_back("--threads=" + std::to_string(httpServerThreadCount));
-    }
+    args.push_back("--threads=" + std::to_string(getHttpServerThreadCount()));
 
     // Generate the wt_config.xml file
     {
@@ -102,7 +142,8 @@ std::vector<std::string> generateWtConfig(std::string execPath)
         boost::property_tree::xml_parser::write_xml(oss, pt);
     }
 
-    // Generate the user_messages.xml file
+    // Generate the user_messages.xml file, only used by the web interface
+    if (role != ServerRole::Downloads)
     {
         boost::property_tree::ptree pt;
 
@@ -164,10 +205,12 @@ int main(int argc, char* argv[])
             throw FsException{ "Working directory '" + workingDirectory.string() + "' is not absolute!" };
         std::filesystem::create_directories(workingDirectory);
 
+        const ServerRole serverRole{ getServerRole() };
+
         const std::filesystem::path uploadDirectory{ UserInterface::prepareUploadDirectory() };
 
         // Construct WT configuration and get the argc/argv back
-        std::vector<std::string> wtServerArgs{ generateWtConfig(argv[0]) };
+        std::vector<std::string> wtServerArgs{ generateWtConfig(argv[0], serverRole) };
 
         const char* wtArgv[wtServerArgs.size()];
         for (std::size_t i = 0; i < wtServerArgs.size(); ++i)
@@ -182,19 +225,93 @@ int main(int argc, char* argv[])
 
         const std::string deployPath{ Service<IConfig>::get()->getString("deploy-path", "/") };
 
-        Service<Share::IShareManager> shareManager{ Share::createShareManager(true /* enableCleaner */) };
-        shareManager->removeOrphanFiles(uploadDirectory);
+        // must outlive the share manager, that invalidates it when removing files
+        Service<IOpenFileCache> openFileCache;
+        if (const std::size_t openFileCacheMaxCount{ Service<IConfig>::get()->getULong("open-file-cache-max-count", 1024) }; openFileCacheMaxCount > 0)
+            openFileCache.assign(createOpenFileCache(openFileCacheMaxCount, std::chrono::seconds{ Service<IConfig>::get()->getULong("open-file-cache-idle-timeout", 30) }));
+
+        // uploads and expired shares are handled by the web interface
+        Service<Share::IShareManager> shareManager{ Share::createShareManager(serverRole != ServerRole::Downloads /* enableCleaner */, serverRole != ServerRole::Downloads /* enableBackgroundCrc32 */) };
+        if (serverRole != ServerRole::Downloads)
+            shareManager->removeOrphanFiles(uploadDirectory);
 
-        ShareResource shareResource;
-        shareResource.setWorkingDirectory(workingDirectory);
+        // must be created before the components registering metrics
+        Service<IMetrics> metrics;
+        if (Service<IConfig>::get()->getBool("metrics-enable", false))
+        {
+            metrics.assign(createMetrics());
+            metrics->addCounter("fileshelter_sparse_skipped_read_bytes_total", "Bytes of file holes served without being read from disk", &SparseFile::getSkippedReadBytes);
+            metrics->addCounter("fileshelter_sparse_deallocated_bytes_total", "Bytes deallocated from the uploaded files by punching holes", &SparseFile::getDeallocatedBytes);
+            metrics->addCounter("fileshelter_page_cache_probed_bytes_total", "Size of the small files probed for page cache residency when opened", &PageCache::getProbedBytes);
+            metrics->addCounter("fileshelter_page_cache_resident_bytes_total", "Part of the probed small files already in the page cache", &PageCache::getResidentBytes);
+            metrics->addCounter("fileshelter_page_cache_dropped_bytes_total", "Bytes of large files dropped from the page cache once read", &PageCache::getDroppedBytes);
+
+            if (openFileCache.exists())
+            {
+                const IOpenFileCache& cache{ *openFileCache };
+                metrics->addCounter("fileshelter_open_file_cache_hits_total", "Downloads that reused an already opened file", [&cache] { return cache.getHitCount(); });
+                metrics->addCounter("fileshelter_open_file_cache_misses_total", "Downloads that had to open their file", [&cache] { return cache.getMissCount(); });
+                metrics->addGauge("fileshelter_open_file_cache_files", "Files currently kept opened", [&cache] { return cache.getOpenedCount(); });
+            }
+        }
+
+        {
+            PageCache::Settings pageCacheSettings;
+            pageCacheSettings.dropBehindMinFileSize = Service<IConfig>::get()->getULong("page-cache-drop-behind-min-size", 0) * 1024 * 1024;
+            // only reported through the metrics
+            if (Service<IMetrics>::exists())
+                pageCacheSettings.probeMaxFileSize = Service<IConfig>::get()->getULong("page-cache-probe-max-size", 1) * 1024 * 1024;
+            PageCache::setSettings(pageCacheSettings);
+        }
+
+        // uses the open file cache
+        Service<PageCache::IPrewarmer> pageCachePrewarmer;
+        if (const std::uint64_t prewarmMaxFileSize{ Service<IConfig>::get()->getULong("page-cache-prewarm-size", 4) * 1024 * 1024 }; prewarmMaxFileSize > 0 && serverRole != ServerRole::Downloads)
+        {
+            pageCachePrewarmer.assign(PageCache::createPrewarmer(prewarmMaxFileSize, Service<IConfig>::get()->getULong("page-cache-prewarm-budget", 256) * 1024 * 1024));
+
+            if (Service<IMetrics>::exists())
+            {
+                const PageCache::IPrewarmer& prewarmer{ *pageCachePrewarmer };
+                metrics->addCounter("fileshelter_page_cache_prewarmed_bytes_total", "Bytes read ahead when a share download page is displayed", [&prewarmer] { return prewarmer.getPrewarmedBytes(); });
+                metrics->addCounter("fileshelter_page_cache_prewarm_hot_total", "Files not read ahead because already in the page cache", [&prewarmer] { return prewarmer.getHotSkippedCount(); });
+                metrics->addCounter("fileshelter_page_cache_prewarm_budget_exhausted_total", "Files not read ahead to stay within the prewarm budget", [&prewarmer] { return prewarmer.getBudgetExhaustedCount(); });
+            }
+        }
+
+        // also used by the web interface to create the download links
         if (!deployPath.empty() && deployPath.back() == '/')
-            shareResource.setDeployPath(deployPath + "share");
+            ShareResource::setDeployPath(deployPath + "share");
         else
-            shareResource.setDeployPath(deployPath + "/share");
-        server.addResource(&shareResource, std::string{ shareResource.getDeployPath() });
-        server.addEntryPoint(Wt::EntryPointType::Application, [&](const Wt::WEnvironment& env) {
-            return UserInterface::createFileShelterApplication(env);
-        });
+            ShareResource::setDeployPath(deployPath + "/share");
+
+        std::optional<ShareResource> shareResource;
+        if (serverRole != ServerRole::Ui)
+        {
+            shareResource.emplace(getHttpServerThreadCount(), serverRole == ServerRole::All /* servesWebInterface */);
+            shareResource->setWorkingDirectory(workingDirectory);
+            server.addResource(&*shareResource, std::string{ ShareResource::getDeployPath() });
+        }
+
+        MetricsResource metricsResource;
+        if (Service<IMetrics>::exists())
+            server.addResource(&metricsResource, deployPath + (!deployPath.empty() && deployPath.back() == '/' ? "metrics" : "/metrics"));
+
+        // owned by the process serving the downloads
+        Service<Share::IZipCache> zipCache;
+        if (Service<IConfig>::get()->getBool("zip-cache-enable", false) && shareResource)
+            zipCache.assign(Share::createZipCache(workingDirectory, shareResource->getZipVariant(), [&](const Share::ShareDesc& share) { return shareResource->createZipper(share); }));
+
+        Service<Share::IEncodedFileCache> encodedFileCache;
+        if (Service<IConfig>::get()->getBool("content-encoding-enable", false) && Service<IConfig>::get()->getBool("content-encoding-cache-enable", false) && shareResource)
+            encodedFileCache.assign(Share::createEncodedFileCache(workingDirectory, [&](const Share::FileDesc& file, Zip::StreamCompression compression) { return shareResource->createEncodedFileZipper(file, compression); }));
+
+        if (serverRole != ServerRole::Downloads)
+        {
+            server.addEntryPoint(Wt::EntryPointType::Application, [&](const Wt::WEnvironment& env) {
+                return UserInterface::createFileShelterApplication(env);
+            });
+        }
 
         FS_LOG(MAIN, INFO) << "Starting server...";
         server.start();
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DownloadHeaders.hpp"
+
+#include <Wt/Utils.h>
+#include <algorithm>
+
+#include "utils/String.hpp"
+
+using namespace Share;
+
+namespace
+{
+    // Returns the compression to be used for the file, if any
+    std::optional<Zip::StreamCompression>
+    negotiateContentEncoding(const DownloadSettings& settings, const FileDesc& file, const std::string& range, const std::string& acceptEncoding, DownloadHeaders& headers)
+    {
+        if (!settings.contentEncoding || file.size < settings.contentEncoding->minFileSize)
+            return std::nullopt;
+
+        const std::vector<std::string>& extensions{ settings.contentEncoding->extensions };
+        const std::string extension{ StringUtils::stringToLower(file.clientPath.extension().string()) };
+        if (std::find(std::cbegin(extensions), std::cend(extensions), extension) == std::cend(extensions))
+            return std::nullopt;
+
+        // the response now depends on the request headers
+        headers.varyOnAcceptEncoding = true;
+
+        // ranges are only served on the file as is
+        if (!range.empty())
+            return std::nullopt;
+
+        return parseAcceptEncoding(acceptEncoding);
+    }
+} // namespace
+
+std::filesystem::path
+getAbsolutePath(const DownloadSettings& settings, const std::filesystem::path& path)
+{
+    return path.is_absolute() ? path : settings.workingDirectory / path;
+}
+
+Zip::EntryContainer
+createZipEntries(const DownloadSettings& settings, const ShareDesc& share)
+{
+    Zip::EntryContainer zipEntries;
+    for (const FileDesc& file : share.files)
+    {
+        // sizes come from the database: the files are only opened when their data is written
+        // modification time is left unset to mask the creation time
+        Zip::Entry entry;
+        entry.fileName = file.clientPath;
+        entry.filePath = getAbsolutePath(settings, file.path);
+        entry.size = file.size;
+        entry.crc32 = file.crc32;
+
+        zipEntries.push_back(std::move(entry));
+    }
+
+    return zipEntries;
+}
+
+std::string
+getArchiveMimeType(ArchiveFormat format)
+{
+    switch (format)
+    {
+    case ArchiveFormat::Zip:
+        return "application/zip";
+    case ArchiveFormat::Tar:
+        return "application/x-tar";
+    case ArchiveFormat::TarZstd:
+        return "application/zstd";
+    }
+
+    return "application/octet-stream";
+}
+
+std::string
+getContentEncodingName(Zip::StreamCompression compression)
+{
+    switch (compression)
+    {
+    case Zip::StreamCompression::Gzip:
+        return "gzip";
+    case Zip::StreamCompression::Zstd:
+        return "zstd";
+    }
+
+    return "identity";
+}
+
+std::optional<Zip::StreamCompression>
+parseAcceptEncoding(const std::string& acceptEncoding)
+{
+    bool acceptsGzip{};
+    bool acceptsZstd{};
+
+    for (const std::string& coding : StringUtils::splitString(acceptEncoding, ","))
+    {
+        // "name[;q=weight]", a zero weight meaning not acceptable
+        const std::vector<std::string> parameters{ StringUtils::splitString(coding, ";") };
+        if (parameters.empty())
+            continue;
+
+        double weight{ 1 };
+        for (std::size_t i{ 1 }; i < parameters.size(); ++i)
+        {
+            const std::string parameter{ StringUtils::stringTrim(parameters[i]) };
+            if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+                weight = StringUtils::readAs<double>(parameter.substr(2)).value_or(0);
+        }
+        if (weight <= 0)
+            continue;
+
+        const std::string name{ StringUtils::stringToLower(StringUtils::stringTrim(parameters[0])) };
+        if (name == "zstd")
+            acceptsZstd = true;
+        else if (name == "gzip" || name == "x-gzip")
+            acceptsGzip = true;
+    }
+
+    if (acceptsZstd)
+        return Zip::StreamCompression::Zstd;
+    if (acceptsGzip)
+        return Zip::StreamCompression::Gzip;
+
+    return std::nullopt;
+}
+
+std::optional<ProxyOffloadHeader>
+getProxyOffloadHeader(const DownloadSettings& settings, const std::filesystem::path& path)
+{
+    switch (settings.proxyOffload)
+    {
+    case ProxyOffload::None:
+        break;
+
+    case ProxyOffload::XAccelRedirect:
+    {
+        // the internal location only exposes the working directory
+        const std::filesystem::path relativePath{ path.lexically_normal().lexically_relative(settings.workingDirectory) };
+        if (relativePath.empty() || *relativePath.begin() == "..")
+            break;
+
+        std::string uri{ settings.proxyOffloadPrefix };
+        for (const std::filesystem::path& component : relativePath)
+            uri += "/" + Wt::Utils::urlEncode(component.string());
+
+        return ProxyOffloadHeader{ "X-Accel-Redirect", uri };
+    }
+
+    case ProxyOffload::XSendfile:
+        return ProxyOffloadHeader{ "X-Sendfile", path.string() };
+    }
+
+    return std::nullopt;
+}
+
+DownloadHeaders
+computeDownloadHeaders(const DownloadSettings& settings, const ShareDesc& share, ArchiveFormat format, const std::optional<CachedZip>& cachedZip, const std::string& range, const std::string& acceptEncoding)
+{
+    DownloadHeaders headers;
+
+    if (cachedZip)
+    {
+        headers.body = DownloadHeaders::Body::CachedZip;
+        headers.filePath = cachedZip->path;
+        headers.mimeType = "application/zip";
+        headers.proxyOffload = getProxyOffloadHeader(settings, cachedZip->path);
+        if (!headers.proxyOffload)
+        {
+            headers.acceptRanges = true;
+            headers.contentLength = cachedZip->size;
+        }
+    }
+    else if (share.files.size() > 1)
+    {
+        headers.body = DownloadHeaders::Body::Archive;
+        headers.mimeType = getArchiveMimeType(format);
+
+        // sizes of compressed archives are only known once produced
+        if (format == ArchiveFormat::Tar)
+        {
+            headers.acceptRanges = true;
+            headers.contentLength = Zip::getTarSize(createZipEntries(settings, share));
+        }
+    }
+    else
+    {
+        const FileDesc& file{ share.files.front() };
+
+        headers.body = DownloadHeaders::Body::File;
+        headers.filePath = getAbsolutePath(settings, file.path);
+        headers.mimeType = "application/octet-stream";
+        headers.proxyOffload = getProxyOffloadHeader(settings, headers.filePath);
+        if (!headers.proxyOffload)
+        {
+            // compressed size only known once compressed, ranges only served on the identity encoding
+            headers.contentEncoding = negotiateContentEncoding(settings, file, range, acceptEncoding, headers);
+            if (!headers.contentEncoding)
+            {
+                headers.acceptRanges = true;
+                headers.contentLength = file.size;
+            }
+        }
+    }
+
+    return headers;
+}
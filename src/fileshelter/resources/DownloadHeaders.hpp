@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "share/IZipCache.hpp"
+#include "share/Types.hpp"
+#include "utils/IZipper.hpp"
+
+// Formats available for multi-file shares
+enum class ArchiveFormat
+{
+    Zip,
+    Tar,
+    TarZstd,
+};
+
+// Bulk transfers delegated to the reverse proxy
+enum class ProxyOffload
+{
+    None,
+    XAccelRedirect, // internal location mapped to the working directory
+    XSendfile,      // absolute path
+};
+
+// Compression of the single files, for the clients accepting it
+struct ContentEncodingSettings
+{
+    std::vector<std::string> extensions; // lower case, with the leading dot
+    std::uint64_t minFileSize{};
+    int gzipLevel{};
+    int zstdLevel{};
+    std::size_t cacheMinReadCount{}; // variants of the files read less often are never cached
+};
+
+struct DownloadSettings
+{
+    std::filesystem::path workingDirectory;
+    std::optional<ContentEncodingSettings> contentEncoding; // not set if disabled
+    ProxyOffload proxyOffload{ ProxyOffload::None };
+    std::string proxyOffloadPrefix; // without trailing slash
+};
+
+// Tells the reverse proxy to send the file instead of us
+struct ProxyOffloadHeader
+{
+    std::string name;
+    std::string value;
+};
+
+// Headers of a download, decided from the share metadata only: no file is accessed
+// Used by both GET and HEAD requests, so that HEAD describes what GET sends
+struct DownloadHeaders
+{
+    enum class Body
+    {
+        CachedZip, // cached archive, sent as a file
+        Archive,   // archive produced on the fly
+        File,      // single file, as is or compressed
+    };
+
+    Body body{ Body::File };
+    std::filesystem::path filePath; // cached archive or single file
+    std::string mimeType;
+    std::optional<ProxyOffloadHeader> proxyOffload; // no body to send if set
+    std::optional<Zip::StreamCompression> contentEncoding;
+    bool varyOnAcceptEncoding{};
+    bool acceptRanges{};
+    std::optional<std::uint64_t> contentLength; // not set if only known once produced, or if offloaded
+};
+
+std::filesystem::path getAbsolutePath(const DownloadSettings& settings, const std::filesystem::path& path);
+Zip::EntryContainer createZipEntries(const DownloadSettings& settings, const Share::ShareDesc& share);
+
+std::string getArchiveMimeType(ArchiveFormat format);
+std::string getContentEncodingName(Zip::StreamCompression compression);
+
+// Returns the preferred compression accepted by the client, zstd first
+std::optional<Zip::StreamCompression> parseAcceptEncoding(const std::string& acceptEncoding);
+
+// Returns nothing if the file must be served by ourselves
+std::optional<ProxyOffloadHeader> getProxyOffloadHeader(const DownloadSettings& settings, const std::filesystem::path& path);
+
+// cachedZip: ready cached archive of the share, if any
+// range, acceptEncoding: values of the request headers, empty if not sent
+DownloadHeaders computeDownloadHeaders(const DownloadSettings& settings, const Share::ShareDesc& share, ArchiveFormat format, const std::optional<Share::CachedZip>& cachedZip, const std::string& range, const std::string& acceptEncoding);
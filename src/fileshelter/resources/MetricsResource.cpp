@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MetricsResource.hpp"
+
+#include <Wt/Http/Response.h>
+
+#include "utils/IMetrics.hpp"
+#include "utils/Service.hpp"
+
+MetricsResource::~MetricsResource()
+{
+    beingDeleted();
+}
+
+void MetricsResource::handleRequest(const Wt::Http::Request& /*request*/, Wt::Http::Response& response)
+{
+    response.setMimeType("text/plain; version=0.0.4");
+    response.addHeader("Cache-Control", "no-store");
+
+    Service<IMetrics>::get()->write(response.out());
+}
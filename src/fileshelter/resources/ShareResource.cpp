@@ -22,54 +22,457 @@
 #include <Wt/Auth/PasswordHash.h>
 #include <Wt/Http/Response.h>
 #include <Wt/Utils.h>
+#include <Wt/WIOService.h>
 #include <Wt/WLocalDateTime.h>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <memory>
 #include <optional>
+#include <thread>
 
 #include "share/Exception.hpp"
+#include "share/IEncodedFileCache.hpp"
 #include "share/IShareManager.hpp"
+#include "share/IZipCache.hpp"
 #include "utils/FileResourceHandlerCreator.hpp"
-#include "utils/IZipper.hpp"
+#include "utils/IAsyncFileReader.hpp"
+#include "utils/IDownloadLimiter.hpp"
+#include "utils/IFileCache.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/IMetrics.hpp"
+#include "utils/IZipLimiter.hpp"
+#include "utils/IZipStreamRegistry.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Service.hpp"
+#include "utils/String.hpp"
 #include "utils/ZipperResourceHandlerCreator.hpp"
 
 using namespace Share;
 
 namespace
 {
+    // Sent to the downloads rejected by the zip limiter
+    constexpr std::chrono::seconds zipRetryAfter{ 30 };
+    // Sent to the downloads rejected by the download limiter
+    constexpr std::chrono::seconds downloadRetryAfter{ 10 };
+
+    std::optional<ArchiveFormat>
+    parseArchiveFormat(std::string_view format)
+    {
+        if (format == "zip")
+            return ArchiveFormat::Zip;
+        if (format == "tar")
+            return ArchiveFormat::Tar;
+        if (format == "tar.zst")
+            return ArchiveFormat::TarZstd;
+
+        return std::nullopt;
+    }
+
+    std::string_view
+    getArchiveExtension(ArchiveFormat format)
+    {
+        switch (format)
+        {
+        case ArchiveFormat::Zip:
+            return ".zip";
+        case ArchiveFormat::Tar:
+            return ".tar";
+        case ArchiveFormat::TarZstd:
+            return ".tar.zst";
+        }
+
+        return "";
+    }
+
     std::filesystem::path
-    getClientFileName(const ShareDesc& share)
+    getClientFileName(const ShareDesc& share, ArchiveFormat format)
     {
         if (share.files.size() == 1)
             return share.files.front().clientPath;
 
-        return share.uuid.toString() + ".zip";
+        return share.uuid.toString() + std::string{ getArchiveExtension(format) };
+    }
+
+    // Keeps the selected files only, in the share order
+    bool
+    selectFiles(ShareDesc& share, const std::vector<std::string>& fileIds)
+    {
+        std::vector<FileUUID> fileUUIDs;
+        for (const std::string& fileId : fileIds)
+            fileUUIDs.emplace_back(fileId);
+
+        std::vector<FileDesc> selectedFiles;
+        for (FileDesc& file : share.files)
+        {
+            if (std::any_of(std::cbegin(fileUUIDs), std::cend(fileUUIDs), [&](const FileUUID& fileUUID) { return fileUUID.toString() == file.uuid.toString(); }))
+                selectedFiles.push_back(std::move(file));
+        }
+
+        // unknown files (or duplicates)
+        if (selectedFiles.size() != fileUUIDs.size())
+            return false;
+
+        share.files = std::move(selectedFiles);
+        share.size = 0;
+        for (const FileDesc& file : share.files)
+            share.size += file.size;
+
+        return true;
+    }
+
+    // Identifies the archive contents for the shared streams
+    std::string
+    getArchiveKey(const ShareDesc& share, ArchiveFormat format, bool isSelection)
+    {
+        std::string key{ share.uuid.toString() + std::string{ getArchiveExtension(format) } };
+        if (isSelection)
+        {
+            for (const FileDesc& file : share.files)
+                key += "/" + file.uuid.toString();
+        }
+
+        return key;
+    }
+
+    unsigned
+    getZstdThreadCount()
+    {
+        const unsigned long threadCount{ Service<IConfig>::get()->getULong("tar-zstd-threads", 0) };
+        if (threadCount == 0)
+            return std::max(std::thread::hardware_concurrency(), 1U);
+
+        return threadCount;
+    }
+
+    Zip::Compression
+    getZipCompression()
+    {
+        const std::string_view compression{ Service<IConfig>::get()->getString("zip-compression", "deflate") };
+        if (compression == "deflate")
+            return Zip::Compression::Deflate;
+        if (compression == "store")
+            return Zip::Compression::Store;
+
+        throw FsException{ "Invalid value '" + std::string{ compression } + "' for zip-compression" };
+    }
+
+    std::optional<ContentEncodingSettings>
+    getContentEncodingSettings()
+    {
+        if (!Service<IConfig>::get()->getBool("content-encoding-enable", false))
+            return std::nullopt;
+
+        ContentEncodingSettings settings;
+        Service<IConfig>::get()->visitStrings("content-encoding-extensions", [&](std::string_view extension) {
+            settings.extensions.push_back("." + StringUtils::stringToLower(extension));
+        },
+            { "txt", "log", "csv", "tsv", "json", "xml", "html", "htm", "css", "js", "svg", "md", "sql", "yaml", "yml" });
+        settings.minFileSize = Service<IConfig>::get()->getULong("content-encoding-min-file-size", 1) * 1024;
+        settings.gzipLevel = static_cast<int>(Service<IConfig>::get()->getULong("content-encoding-gzip-level", 6));
+        settings.zstdLevel = static_cast<int>(Service<IConfig>::get()->getULong("content-encoding-zstd-level", 3));
+        settings.cacheMinReadCount = Service<IConfig>::get()->getULong("content-encoding-cache-min-reads", 2);
+
+        return settings;
+    }
+
+    ProxyOffload
+    getProxyOffload()
+    {
+        const std::string_view proxyOffload{ Service<IConfig>::get()->getString("proxy-offload", "none") };
+        if (proxyOffload == "none")
+            return ProxyOffload::None;
+
+        // the headers would reach the clients otherwise
+        if (!Service<IConfig>::get()->getBool("behind-reverse-proxy", false))
+        {
+            FS_LOG(RESOURCE, WARNING) << "proxy-offload ignored: behind-reverse-proxy not set";
+            return ProxyOffload::None;
+        }
+
+        if (proxyOffload == "x-accel-redirect")
+            return ProxyOffload::XAccelRedirect;
+        if (proxyOffload == "x-sendfile")
+            return ProxyOffload::XSendfile;
+
+        throw FsException{ "Invalid value '" + std::string{ proxyOffload } + "' for proxy-offload" };
+    }
+
+    std::string
+    getProxyOffloadPrefix()
+    {
+        std::string prefix{ Service<IConfig>::get()->getString("proxy-offload-prefix", "/fileshelter-internal") };
+        while (!prefix.empty() && prefix.back() == '/')
+            prefix.pop_back();
+
+        return prefix;
+    }
+
+    // Uploaded files never change, the others may be modified behind our back
+    std::string getFileCacheKey(const FileDesc& file, const std::filesystem::path& path)
+    {
+        std::string key{ file.uuid.toString() };
+        if (!file.isOwned)
+        {
+            std::error_code ec;
+            key += "/" + std::to_string(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+        }
+
+        return key;
+    }
+
+    void
+    addContentDisposition(Wt::Http::Response& response, const ShareDesc& share, ArchiveFormat format)
+    {
+        // This implements RFC 5987
+        response.addHeader("Content-Disposition", "attachment; filename*=UTF-8''" + Wt::Utils::urlEncode(getClientFileName(share, format).string()));
+    }
+
+    // Uploaded files never change: validators are derived from the metadata
+    void
+    addValidators(Wt::Http::Response& response, const ShareDesc& share, ArchiveFormat format, bool isSelection, std::optional<Zip::StreamCompression> contentEncoding)
+    {
+        if (!std::all_of(std::cbegin(share.files), std::cend(share.files), [](const FileDesc& file) { return file.isOwned; }))
+            return;
+
+        // archives and compressed files may not be byte for byte identical from one download to another
+        if (share.files.size() == 1 && contentEncoding)
+            response.addHeader("ETag", "W/\"" + share.files.front().uuid.toString() + "-" + getContentEncodingName(*contentEncoding) + "\"");
+        else if (share.files.size() == 1)
+            response.addHeader("ETag", "\"" + share.files.front().uuid.toString() + "\"");
+        else
+            response.addHeader("ETag", "W/\"" + getArchiveKey(share, format, isSelection) + "\"");
+
+        if (share.creationTime.isValid())
+        {
+            const std::time_t creationTime{ std::chrono::system_clock::to_time_t(share.creationTime.toTimePoint()) };
+            std::tm tm;
+            char lastModified[64];
+            if (::gmtime_r(&creationTime, &tm) && std::strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm) > 0)
+                response.addHeader("Last-Modified", lastModified);
+        }
+    }
+
+    void
+    addDownloadHeaders(Wt::Http::Response& response, const ShareDesc& share, ArchiveFormat format, bool isSelection, const DownloadHeaders& headers)
+    {
+        response.setMimeType(headers.mimeType);
+        if (headers.proxyOffload)
+            response.addHeader(headers.proxyOffload->name, headers.proxyOffload->value);
+        if (headers.varyOnAcceptEncoding)
+            response.addHeader("Vary", "Accept-Encoding");
+        if (headers.contentEncoding)
+            response.addHeader("Content-Encoding", getContentEncodingName(*headers.contentEncoding));
+        if (headers.acceptRanges)
+            response.addHeader("Accept-Ranges", "bytes");
+
+        addContentDisposition(response, share, format);
+        addValidators(response, share, format, isSelection, headers.contentEncoding);
+    }
+
+    void
+    rejectRequest(Wt::Http::Response& response, std::chrono::seconds retryAfter)
+    {
+        response.setStatus(503);
+        response.addHeader("Retry-After", std::to_string(retryAfter.count()));
+    }
+
+    // Largest piece of data written by the resource handlers in a single call
+    // The io_uring and file cache settings only apply if the reader and the cache could be created
+    std::size_t
+    getLargestResponseChunkSize(bool usesFileReader, bool usesFileCache)
+    {
+        std::size_t chunkSize{ 64 * 1024 }; // file and archive handlers
+
+        if (usesFileReader)
+            chunkSize = std::max<std::size_t>(chunkSize, Service<IConfig>::get()->getULong("io-uring-buffer-size", 256) * 1024);
+        if (usesFileCache)
+            chunkSize = std::max<std::size_t>(chunkSize, Service<IConfig>::get()->getULong("file-cache-max-file-size", 1024) * 1024);
+
+        return chunkSize;
+    }
+
+    DownloadLimits
+    getDownloadLimits(std::size_t httpServerThreadCount, bool servesWebInterface, std::size_t largestResponseChunkSize)
+    {
+        DownloadLimits limits;
+        limits.maxActiveCount = Service<IConfig>::get()->getULong("download-max-active", 512);
+        limits.maxActivePerClientCount = Service<IConfig>::get()->getULong("download-max-active-per-client", 16);
+
+        // the other HTTP threads are kept for the web interface, provided at least 2 are left to the downloads
+        if (const std::size_t reservedThreadCount{ Service<IConfig>::get()->getULong("download-reserved-http-threads", 0) }; reservedThreadCount > 0 && servesWebInterface)
+        {
+            if (httpServerThreadCount >= reservedThreadCount + 2)
+                limits.maxProcessingCount = httpServerThreadCount - reservedThreadCount;
+            else
+                FS_LOG(RESOURCE, WARNING) << "Not reserving " << reservedThreadCount << " HTTP threads for the web interface: only " << httpServerThreadCount << " threads";
+        }
+        limits.schedulingQuantum = std::chrono::microseconds{ Service<IConfig>::get()->getULong("download-scheduling-quantum", 1000) };
+        limits.asyncProductionRate = Service<IConfig>::get()->getULong("download-scheduling-async-rate", 256) * 1024 * 1024;
+        limits.idleTimeout = std::chrono::seconds{ Service<IConfig>::get()->getULong("download-idle-timeout", 0) };
+        limits.minRate = Service<IConfig>::get()->getULong("download-min-rate", 0) * 1024;
+        limits.minRatePeriod = std::chrono::seconds{ Service<IConfig>::get()->getULong("download-min-rate-period", 60) };
+
+        // progress is only noticed once a whole chunk is sent: clients reading at the minimum rate must not look idle
+        if (limits.idleTimeout.count() > 0 && limits.minRate > 0)
+        {
+            const std::chrono::seconds minIdleTimeout{ (largestResponseChunkSize + limits.minRate - 1) / limits.minRate };
+            if (limits.idleTimeout < minIdleTimeout)
+            {
+                FS_LOG(RESOURCE, WARNING) << "download-idle-timeout raised to " << minIdleTimeout.count() << " s: sending a " << largestResponseChunkSize << " bytes chunk at download-min-rate takes longer";
+                limits.idleTimeout = minIdleTimeout;
+            }
+        }
+
+        return limits;
+    }
+
+    ShareResource::DownloadFlow
+    getDownloadFlow()
+    {
+        const std::string_view flow{ Service<IConfig>::get()->getString("download-scheduling-flow", "client") };
+        if (flow == "client")
+            return ShareResource::DownloadFlow::Client;
+        if (flow == "share")
+            return ShareResource::DownloadFlow::Share;
+
+        throw FsException{ "Invalid value '" + std::string{ flow } + "' for download-scheduling-flow" };
+    }
+
+    // The continuation must already wait when the handler calls back
+    void
+    waitForData(Wt::Http::ResponseContinuation& continuation, IResourceHandler& resourceHandler)
+    {
+        continuation.waitForMoreData();
+
+        std::weak_ptr<Wt::Http::ResponseContinuation> weakContinuation{ continuation.shared_from_this() };
+        const bool isWaiting{ resourceHandler.waitForData([weakContinuation] {
+            if (std::shared_ptr<Wt::Http::ResponseContinuation> continuation{ weakContinuation.lock() })
+                continuation->haveMoreData();
+        }) };
+
+        if (!isWaiting)
+            continuation.haveMoreData();
     }
 } // namespace
 
+ShareResource::ShareResource(std::size_t httpServerThreadCount, bool servesWebInterface)
+    : _downloadSettings{ {}, getContentEncodingSettings(), getProxyOffload(), getProxyOffloadPrefix() }
+    , _zipCompression{ getZipCompression() }
+    , _zipStreamBufferSize{ Service<IConfig>::get()->getULong("zip-stream-buffer-size", 0) * 1024 * 1024 }
+    , _zstdThreadCount{ getZstdThreadCount() }
+    , _zipWorkerBufferSize{ Service<IConfig>::get()->getULong("zip-worker-buffer-size", 1024) * 1024 }
+    , _downloadFlow{ getDownloadFlow() }
+{
+    if (_zipStreamBufferSize > 0)
+        _zipStreams = Zip::createZipStreamRegistry(_zipStreamBufferSize);
+
+    if (const unsigned long zipWorkerCount{ Service<IConfig>::get()->getULong("zip-worker-threads", 2) }; zipWorkerCount > 0 && _zipWorkerBufferSize > 0)
+    {
+        _zipWorkers = std::make_unique<Wt::WIOService>();
+        _zipWorkers->setThreadCount(zipWorkerCount);
+        _zipWorkers->start();
+
+        FS_LOG(RESOURCE, INFO) << "Archives produced by " << zipWorkerCount << " workers, buffer size = " << _zipWorkerBufferSize << " bytes";
+    }
+
+    {
+        const std::size_t zipMaxActiveCount{ Service<IConfig>::get()->getULong("zip-max-active", 16) };
+        const std::size_t zipMaxMemory{ Service<IConfig>::get()->getULong("zip-max-memory", 256) * 1024 * 1024 };
+        const std::size_t zipMaxQueuedCount{ Service<IConfig>::get()->getULong("zip-max-queued", 64) };
+
+        if (zipMaxActiveCount > 0 || zipMaxMemory > 0)
+            _zipLimiter = Zip::createZipLimiter(zipMaxActiveCount, zipMaxMemory, zipMaxQueuedCount);
+    }
+
+    if (const std::size_t fileReadBufferCount{ Service<IConfig>::get()->getULong("io-uring-buffers", 64) }; fileReadBufferCount > 0)
+    {
+        // 2 buffers per download
+        const std::size_t fileReadBufferSize{ Service<IConfig>::get()->getULong("io-uring-buffer-size", 256) * 1024 };
+        _fileReader = createIoUringFileReader(std::max<std::size_t>(fileReadBufferCount, 2), fileReadBufferSize);
+    }
+
+    if (const std::size_t fileCacheMaxSize{ Service<IConfig>::get()->getULong("file-cache-max-size", 64) * 1024 * 1024 }; fileCacheMaxSize > 0)
+        _fileCache = createFileCache(fileCacheMaxSize, Service<IConfig>::get()->getULong("file-cache-max-file-size", 1024) * 1024);
+
+    // after the reader and the cache, that set the size of the chunks
+    if (const DownloadLimits downloadLimits{ getDownloadLimits(httpServerThreadCount, servesWebInterface, getLargestResponseChunkSize(_fileReader != nullptr, _fileCache != nullptr)) };
+        downloadLimits.maxActiveCount > 0 || downloadLimits.maxActivePerClientCount > 0 || downloadLimits.maxProcessingCount > 0
+        || downloadLimits.idleTimeout.count() > 0 || (downloadLimits.minRate > 0 && downloadLimits.minRatePeriod.count() > 0))
+        _downloadLimiter = createDownloadLimiter(downloadLimits);
+
+    if (_fileCache && Service<IMetrics>::exists())
+    {
+        const IFileCache& fileCache{ *_fileCache };
+        Service<IMetrics>::get()->addCounter("fileshelter_file_cache_hits_total", "Single file downloads served from the file cache", [&fileCache] { return fileCache.getHitCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_file_cache_misses_total", "Single file downloads of cacheable files not found in the file cache", [&fileCache] { return fileCache.getMissCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_file_cache_saved_read_bytes_total", "Bytes served from the file cache instead of being read from disk", [&fileCache] { return fileCache.getSavedReadBytes(); });
+        Service<IMetrics>::get()->addGauge("fileshelter_file_cache_bytes", "Size of the file contents in the file cache", [&fileCache] { return fileCache.getUsedSize(); });
+    }
+
+    if (_downloadSettings.contentEncoding && Service<IMetrics>::exists())
+    {
+        Service<IMetrics>::get()->addCounter("fileshelter_content_encoding_total", "Single file downloads sent compressed", [this] { return _contentEncodingCount.load(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_content_encoding_saved_bytes_total", "Bytes saved on the network by the compressed single file downloads", [this] { return _contentEncodingSavedBytes.load(); });
+    }
+
+    if (_downloadSettings.proxyOffload != ProxyOffload::None && Service<IMetrics>::exists())
+        Service<IMetrics>::get()->addCounter("fileshelter_proxy_offload_total", "Downloads streamed by the reverse proxy", [this] { return _proxyOffloadCount.load(); });
+
+    if (_downloadLimiter && Service<IMetrics>::exists())
+    {
+        const IDownloadLimiter& downloadLimiter{ *_downloadLimiter };
+        Service<IMetrics>::get()->addGauge("fileshelter_downloads_active", "Downloads being streamed", [&downloadLimiter] { return downloadLimiter.getActiveCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_admitted_total", "Downloads admitted by the download limiter", [&downloadLimiter] { return downloadLimiter.getAdmittedCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_rejected_total", "Downloads rejected because the server had too many downloads", [&downloadLimiter] { return downloadLimiter.getRejectedCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_client_rejected_total", "Downloads rejected because the client had too many downloads", [&downloadLimiter] { return downloadLimiter.getClientRejectedCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_deferred_total", "Download data productions delayed to keep HTTP threads for the web interface", [&downloadLimiter] { return downloadLimiter.getDeferredCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_idle_evicted_total", "Downloads evicted because the client stopped reading", [&downloadLimiter] { return downloadLimiter.getIdleEvictedCount(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_downloads_slow_evicted_total", "Downloads evicted because the client read too slowly", [&downloadLimiter] { return downloadLimiter.getSlowEvictedCount(); });
+    }
+
+    if (_zipLimiter && Service<IMetrics>::exists())
+    {
+        const Zip::IZipLimiter& zipLimiter{ *_zipLimiter };
+        Service<IMetrics>::get()->addGauge("fileshelter_zip_active", "Archive downloads being produced", [&zipLimiter] { return zipLimiter.getActiveCount(); });
+        Service<IMetrics>::get()->addGauge("fileshelter_zip_queued", "Archive downloads waiting to be admitted", [&zipLimiter] { return zipLimiter.getQueuedCount(); });
+        Service<IMetrics>::get()->addGauge("fileshelter_zip_memory_bytes", "Estimated memory used by the archive downloads being produced", [&zipLimiter] { return zipLimiter.getUsedMemory(); });
+        Service<IMetrics>::get()->addCounter("fileshelter_zip_rejected_total", "Archive downloads rejected because the queue was full", [&zipLimiter] { return zipLimiter.getRejectedCount(); });
+    }
+}
+
 void ShareResource::setWorkingDirectory(std::filesystem::path workingDirectory)
 {
     if (std::filesystem::is_directory(workingDirectory))
     {
-        _workingDirectory = workingDirectory;
-        FS_LOG(RESOURCE, INFO) << "Working directory set to '" << _workingDirectory.string() << "'";
+        _downloadSettings.workingDirectory = workingDirectory;
+        FS_LOG(RESOURCE, INFO) << "Working directory set to '" << _downloadSettings.workingDirectory.string() << "'";
     }
     else
     {
-        FS_LOG(RESOURCE, ERROR) << "Cannot set working directory to '" << _workingDirectory.string() << "'";
+        FS_LOG(RESOURCE, ERROR) << "Cannot set working directory to '" << workingDirectory.string() << "'";
     }
 }
 
 ShareResource::~ShareResource()
 {
     beingDeleted();
+
+    if (_zipWorkers)
+        _zipWorkers->stop();
 }
 
 Wt::WLink
-ShareResource::createLink(const ShareUUID& uuid, std::optional<std::string_view> password)
+ShareResource::createLink(const ShareUUID& uuid, std::optional<std::string_view> password, const std::vector<FileUUID>& fileIds)
 {
-    return { Wt::LinkType::Url, std::string{ getDeployPath() } + "?id=" + uuid.toString() + (password ? ("&p=" + Wt::Utils::hexEncode(std::string{ *password })) : "") };
+    std::string url{ std::string{ getDeployPath() } + "?id=" + uuid.toString() };
+    for (const FileUUID& fileId : fileIds)
+        url += "&file=" + fileId.toString();
+    if (password)
+        url += "&p=" + Wt::Utils::hexEncode(std::string{ *password });
+
+    return { Wt::LinkType::Url, url };
 }
 
 void ShareResource::handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
@@ -93,28 +496,120 @@ void ShareResource::handleRequest(const Wt::Http::Request& request, Wt::Http::Re
             if (const std::string * p{ request.getParameter("p") })
                 password = Wt::Utils::hexDecode(*p);
 
-            const ShareDesc share{ Service<IShareManager>::get()->getShareDesc(shareUUID, password) };
-            if (share.files.size() > 1)
+            ArchiveFormat archiveFormat{ ArchiveFormat::Zip };
+            if (const std::string * format{ request.getParameter("format") })
             {
-                std::unique_ptr<Zip::IZipper> zipper{ createZipper(share) };
-                response.setMimeType("application/zip");
-                resourceHandler = createZipperResourceHandler(std::move(zipper));
+                const std::optional<ArchiveFormat> parsedFormat{ parseArchiveFormat(*format) };
+                if (!parsedFormat)
+                {
+                    FS_LOG(RESOURCE, DEBUG) << "Bad parameter 'format'!";
+                    response.setStatus(400);
+                    return;
+                }
+                archiveFormat = *parsedFormat;
             }
-            else
+
+            // before looking up the share (password hashing): rejections must be cheap
+            std::unique_ptr<DownloadAdmission> admission;
+            if (_downloadLimiter && request.method() != "HEAD")
             {
-                response.setMimeType("application/octet-stream");
-                resourceHandler = createFileResourceHandler(getAbsolutePath(share.files.front().path));
+                admission = _downloadLimiter->admit(request.clientAddress());
+                if (!admission)
+                {
+                    FS_LOG(RESOURCE, INFO) << "Too many downloads, rejecting request from " << request.clientAddress();
+                    rejectRequest(response, downloadRetryAfter);
+                    return;
+                }
             }
 
-            auto encodeHttpHeaderField = [](const std::string& fieldName, const std::string& fieldValue) {
-                // This implements RFC 5987
-                return fieldName + "*=UTF-8''" + Wt::Utils::urlEncode(fieldValue);
-            };
+            ShareDesc share{ Service<IShareManager>::get()->getShareDesc(shareUUID, password) };
 
-            const std::string cdp{ encodeHttpHeaderField("filename", getClientFileName(share).string()) };
-            response.addHeader("Content-Disposition", "attachment; " + cdp);
+            const std::vector<std::string>& fileIds{ request.getParameterValues("file") };
+            const bool isSelection{ !fileIds.empty() };
+            if (isSelection && !selectFiles(share, fileIds))
+            {
+                FS_LOG(RESOURCE, DEBUG) << "Bad parameter 'file'!";
+                response.setStatus(404);
+                return;
+            }
+
+            // HEAD requests are answered from the metadata: no file opened, no archive created, not counted as a download
+            const bool isHead{ request.method() == "HEAD" };
+
+            std::optional<CachedZip> cachedZip;
+            if (share.files.size() > 1 && archiveFormat == ArchiveFormat::Zip && !isSelection && Service<IZipCache>::exists())
+                cachedZip = isHead ? Service<IZipCache>::get()->findZip(share) : Service<IZipCache>::get()->getZip(share);
+
+            DownloadHeaders headers{ computeDownloadHeaders(_downloadSettings, share, archiveFormat, cachedZip, request.headerValue("Range"), request.headerValue("Accept-Encoding")) };
+            if (isHead)
+            {
+                addDownloadHeaders(response, share, archiveFormat, isSelection, headers);
+                if (headers.contentLength)
+                    response.setContentLength(*headers.contentLength);
+                response.setStatus(200);
+                return;
+            }
+
+            std::unique_ptr<IResourceHandler> downloadHandler;
+            if (headers.proxyOffload)
+            {
+                FS_LOG(RESOURCE, DEBUG) << "Offloading file '" << headers.filePath.string() << "' to the reverse proxy";
+                _proxyOffloadCount++;
+            }
+            else if (headers.body == DownloadHeaders::Body::CachedZip)
+            {
+                downloadHandler = createFileResourceHandler(headers.filePath);
+            }
+            else if (headers.body == DownloadHeaders::Body::Archive)
+            {
+                downloadHandler = createArchiveResourceHandler(share, archiveFormat, isSelection);
+                if (!downloadHandler)
+                {
+                    FS_LOG(RESOURCE, INFO) << "Too many archive downloads, rejecting request";
+                    rejectRequest(response, zipRetryAfter);
+                    return;
+                }
+            }
+            else
+            {
+                const FileDesc& file{ share.files.front() };
+                if (headers.contentEncoding)
+                {
+                    downloadHandler = createEncodedFileResourceHandler(share, file, *headers.contentEncoding);
+                    if (downloadHandler)
+                    {
+                        _contentEncodingCount++;
+                    }
+                    else
+                    {
+                        // compression not admitted: sent as is, ranges only served on the identity encoding
+                        headers.contentEncoding.reset();
+                        headers.acceptRanges = true;
+                        headers.contentLength = file.size;
+                    }
+                }
+
+                if (!downloadHandler)
+                    downloadHandler = createFileResourceHandler(file);
+            }
+
+            addDownloadHeaders(response, share, archiveFormat, isSelection, headers);
 
             Service<IShareManager>::get()->incrementReadCount(shareUUID);
+
+            // no body: the proxy sends the file instead
+            if (!downloadHandler)
+                return;
+
+            if (admission)
+            {
+                std::string flow{ request.clientAddress() };
+                if (_downloadFlow == DownloadFlow::Share)
+                    flow += "/" + share.uuid.toString();
+
+                downloadHandler = _downloadLimiter->createResourceHandler(std::move(admission), flow, std::move(downloadHandler));
+            }
+            resourceHandler = std::move(downloadHandler);
         }
         else
         {
@@ -126,6 +621,8 @@ void ShareResource::handleRequest(const Wt::Http::Request& request, Wt::Http::Re
         {
             continuation = response.createContinuation();
             continuation->setData(resourceHandler);
+            if (resourceHandler->isAsynchronous())
+                waitForData(*continuation, *resourceHandler);
         }
 
         return;
@@ -156,19 +653,162 @@ void ShareResource::handleAbort(const Wt::Http::Request& request)
     resourceHandler->abort();
 }
 
-std::filesystem::path
-ShareResource::getAbsolutePath(const std::filesystem::path& p)
+std::unique_ptr<IResourceHandler>
+ShareResource::createFileResourceHandler(const std::filesystem::path& path)
 {
-    return p.is_absolute() ? p : _workingDirectory / p;
+    return _fileReader ? ::createFileResourceHandler(path, *_fileReader) : ::createFileResourceHandler(path);
+}
+
+std::unique_ptr<IResourceHandler>
+ShareResource::createFileResourceHandler(const FileDesc& file)
+{
+    const std::filesystem::path path{ getAbsolutePath(_downloadSettings, file.path) };
+
+    if (_fileCache)
+    {
+        if (IFileCache::Content content{ _fileCache->getContent(getFileCacheKey(file, path), path, file.size) })
+            return ::createFileResourceHandler(std::move(content));
+    }
+
+    return createFileResourceHandler(path);
+}
+
+std::unique_ptr<IResourceHandler>
+ShareResource::createEncodedFileResourceHandler(const ShareDesc& share, const FileDesc& file, Zip::StreamCompression compression)
+{
+    // compressed variants of the popular files are kept on disk
+    if (share.readCount >= _downloadSettings.contentEncoding->cacheMinReadCount && Service<IEncodedFileCache>::exists())
+    {
+        if (const std::optional<std::filesystem::path> encodedFile{ Service<IEncodedFileCache>::get()->getEncodedFile(file, compression) })
+        {
+            std::error_code ec;
+            if (const std::uint64_t encodedFileSize{ std::filesystem::file_size(*encodedFile, ec) }; !ec && encodedFileSize < file.size)
+                _contentEncodingSavedBytes += file.size - encodedFileSize;
+
+            return createFileResourceHandler(*encodedFile);
+        }
+    }
+
+    auto createHandler{ [this, file, compression]() -> std::unique_ptr<IResourceHandler> {
+        std::unique_ptr<Zip::IZipper> zipper{ createEncodedFileZipper(file, compression, [this](std::uint64_t inputSize, std::uint64_t outputSize) {
+            if (outputSize < inputSize)
+                _contentEncodingSavedBytes += inputSize - outputSize;
+        }) };
+
+        return _zipWorkers ? createZipperResourceHandler(std::move(zipper), *_zipWorkers, _zipWorkerBufferSize) : createZipperResourceHandler(std::move(zipper));
+    } };
+
+    // compression is admitted like the archives, the file being sent as is if the queue is full
+    if (_zipLimiter)
+        return _zipLimiter->createResourceHandler(getContentEncodingMemoryCost(compression), createHandler);
+
+    return createHandler();
+}
+
+std::unique_ptr<IResourceHandler>
+ShareResource::createArchiveResourceHandler(const ShareDesc& share, ArchiveFormat format, bool isSelection)
+{
+    // Plain tar archives have a predictable layout and are cheap to generate: serve them by ranges
+    // Not limited: queued downloads could not set up their range, the headers being sent meanwhile
+    if (format == ArchiveFormat::Tar)
+    {
+        std::unique_ptr<Zip::ISeekableZipper> zipper{ Zip::createTarZipper(createZipEntries(_downloadSettings, share)) };
+        return _zipWorkers ? createZipperResourceHandler(std::move(zipper), *_zipWorkers, _zipWorkerBufferSize) : createZipperResourceHandler(std::move(zipper));
+    }
+
+    auto createHandler{ [this, share, format, isSelection]() -> std::unique_ptr<IResourceHandler> {
+        auto createArchiveZipper{ [this, share, format]() -> std::unique_ptr<Zip::IZipper> {
+            if (format == ArchiveFormat::TarZstd)
+                return Zip::createTarZstdZipper(createZipEntries(_downloadSettings, share), _zstdThreadCount);
+
+            return createZipper(share);
+        } };
+
+        std::unique_ptr<Zip::IZipper> zipper;
+        if (_zipStreams)
+            zipper = _zipStreams->createZipper(getArchiveKey(share, format, isSelection), createArchiveZipper);
+        else
+            zipper = createArchiveZipper();
+
+        // Compression runs on the workers, overlapping with the network writes
+        return _zipWorkers ? createZipperResourceHandler(std::move(zipper), *_zipWorkers, _zipWorkerBufferSize) : createZipperResourceHandler(std::move(zipper));
+    } };
+
+    // Compressed archives are created once admitted by the limiter, null if its queue is full
+    if (_zipLimiter)
+        return _zipLimiter->createResourceHandler(getArchiveMemoryCost(format), createHandler);
+
+    return createHandler();
+}
+
+std::size_t
+ShareResource::getArchiveMemoryCost(ArchiveFormat format) const
+{
+    // Rough estimates: read buffer, libarchive block and compression state
+    std::size_t memoryCost{ _zipWorkers ? _zipWorkerBufferSize : 0 };
+    switch (format)
+    {
+    case ArchiveFormat::Zip:
+        memoryCost += (_zipCompression == Zip::Compression::Deflate ? 512 : 128) * 1024;
+        break;
+    case ArchiveFormat::Tar:
+        memoryCost += 64 * 1024;
+        break;
+    case ArchiveFormat::TarZstd:
+        memoryCost += (1 + _zstdThreadCount) * 2 * 1024 * 1024;
+        break;
+    }
+
+    // shared stream buffer, accounted for each download: the reader may be alone on its stream
+    if (_zipStreams && format != ArchiveFormat::Tar)
+        memoryCost += _zipStreamBufferSize;
+
+    return memoryCost;
+}
+
+std::size_t
+ShareResource::getContentEncodingMemoryCost(Zip::StreamCompression compression) const
+{
+    // Rough estimates: read buffer and compression state
+    const std::size_t memoryCost{ _zipWorkers ? _zipWorkerBufferSize : 0 };
+    return memoryCost + (compression == Zip::StreamCompression::Gzip ? 512 : 2048) * 1024;
+}
+
+std::unique_ptr<Zip::IZipper>
+ShareResource::createEncodedFileZipper(const FileDesc& file, Zip::StreamCompression compression, Zip::StreamCompressionCallback onComplete)
+{
+    Zip::Entry entry;
+    entry.fileName = file.clientPath;
+    entry.filePath = getAbsolutePath(_downloadSettings, file.path);
+    entry.size = file.size;
+
+    const int level{ _downloadSettings.contentEncoding ? (compression == Zip::StreamCompression::Gzip ? _downloadSettings.contentEncoding->gzipLevel : _downloadSettings.contentEncoding->zstdLevel) : 0 };
+    return Zip::createCompressedFileZipper(entry, compression, level, std::move(onComplete));
+}
+
+std::string_view
+ShareResource::getZipVariant() const
+{
+    switch (_zipCompression)
+    {
+    case Zip::Compression::Deflate:
+        return "zip-deflate";
+    case Zip::Compression::Store:
+        return "zip-store";
+    }
+
+    return "zip";
 }
 
 std::unique_ptr<Zip::IZipper>
 ShareResource::createZipper(const ShareDesc& share)
 {
-    Zip::EntryContainer zipEntries;
-    for (const FileDesc& file : share.files)
-        zipEntries.emplace_back(Zip::Entry{ file.clientPath, getAbsolutePath(file.path) });
+    const Zip::EntryContainer zipEntries{ createZipEntries(_downloadSettings, share) };
+
+    // Stored entries are copied directly from the files, using the CRCs computed at upload time when available
+    if (_zipCompression == Zip::Compression::Store && Zip::canUseStoreZipper(zipEntries))
+        return Zip::createStoreZipper(zipEntries);
 
     // mask creation time
-    return Zip::createArchiveZipper(zipEntries);
+    return Zip::createArchiveZipper(zipEntries, _zipCompression);
 }
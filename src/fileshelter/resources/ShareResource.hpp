@@ -21,38 +21,90 @@
 
 #include <Wt/WLink.h>
 #include <Wt/WResource.h>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "share/Types.hpp"
+#include "utils/IZipper.hpp"
+#include "DownloadHeaders.hpp"
 
 namespace Share
 {
     class IShare;
 }
 
+class IAsyncFileReader;
+class IDownloadLimiter;
+class IFileCache;
+class IResourceHandler;
+
+namespace Wt
+{
+    class WIOService;
+}
+
 namespace Zip
 {
-    class IZipper;
+    class IZipLimiter;
+    class IZipStreamRegistry;
 }
 
 class ShareResource : public Wt::WResource
 {
 public:
+    // No HTTP thread is reserved when the web interface is served by another process
+    ShareResource(std::size_t httpServerThreadCount, bool servesWebInterface);
     ~ShareResource();
 
     void setWorkingDirectory(std::filesystem::path workingDirectory);
 
     static void setDeployPath(std::string_view deployPath) { _deployPath = deployPath; }
     static std::string_view getDeployPath() { return _deployPath; }
-    static Wt::WLink createLink(const Share::ShareUUID& shareId, std::optional<std::string_view> password);
+    // Links to the whole share, or to a selection of its files (served as is if a single file is selected)
+    static Wt::WLink createLink(const Share::ShareUUID& shareId, std::optional<std::string_view> password, const std::vector<Share::FileUUID>& fileIds = {});
 
-private:
-    std::filesystem::path getAbsolutePath(const std::filesystem::path& p);
     std::unique_ptr<Zip::IZipper> createZipper(const Share::ShareDesc& share);
+    // Identifies the archives created by createZipper: cached ones of another variant are stale
+    std::string_view getZipVariant() const;
+    // Compressed variant of a single file (HTTP content encoding)
+    std::unique_ptr<Zip::IZipper> createEncodedFileZipper(const Share::FileDesc& file, Zip::StreamCompression compression, Zip::StreamCompressionCallback onComplete = {});
+
+    // Downloads sharing the HTTP threads fairly, when busy
+    enum class DownloadFlow
+    {
+        Client, // client address
+        Share,  // client address and share
+    };
+
+private:
+    std::unique_ptr<IResourceHandler> createFileResourceHandler(const std::filesystem::path& path);
+    std::unique_ptr<IResourceHandler> createFileResourceHandler(const Share::FileDesc& file);
+    std::unique_ptr<IResourceHandler> createArchiveResourceHandler(const Share::ShareDesc& share, ArchiveFormat format, bool isSelection);
+    std::size_t getArchiveMemoryCost(ArchiveFormat format) const;
+    std::size_t getContentEncodingMemoryCost(Zip::StreamCompression compression) const;
+    // Returns nullptr if the download cannot be admitted by the zip limiter
+    std::unique_ptr<IResourceHandler> createEncodedFileResourceHandler(const Share::ShareDesc& share, const Share::FileDesc& file, Zip::StreamCompression compression);
 
-    std::filesystem::path _workingDirectory;
+    DownloadSettings _downloadSettings;
+    const Zip::Compression _zipCompression;
+    const std::size_t _zipStreamBufferSize;
+    std::unique_ptr<Zip::IZipStreamRegistry> _zipStreams; // may be null
+    const unsigned _zstdThreadCount;
+    const std::size_t _zipWorkerBufferSize;
+    std::unique_ptr<Wt::WIOService> _zipWorkers; // may be null
+    std::unique_ptr<Zip::IZipLimiter> _zipLimiter; // may be null
+    std::unique_ptr<IDownloadLimiter> _downloadLimiter; // may be null
+    const DownloadFlow _downloadFlow;
+    std::unique_ptr<IAsyncFileReader> _fileReader; // may be null
+    std::unique_ptr<IFileCache> _fileCache; // may be null
+    std::atomic<std::uint64_t> _contentEncodingCount{};
+    std::atomic<std::uint64_t> _contentEncodingSavedBytes{};
+    std::atomic<std::uint64_t> _proxyOffloadCount{};
     static inline std::string _deployPath;
     void handleRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
     void handleAbort(const Wt::Http::Request& request) override;
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <Wt/Utils.h>
+
+#include "resources/DownloadHeaders.hpp"
+
+// The files do not exist: the headers must be computed without accessing them (HEAD requests)
+namespace
+{
+    const std::filesystem::path workingDirectory{ "/nonexistent/fileshelter" };
+
+    DownloadSettings createSettings(ProxyOffload proxyOffload = ProxyOffload::None)
+    {
+        DownloadSettings settings;
+        settings.workingDirectory = workingDirectory;
+        settings.proxyOffload = proxyOffload;
+        settings.proxyOffloadPrefix = "/internal";
+
+        ContentEncodingSettings contentEncoding;
+        contentEncoding.extensions = { ".txt", ".json" };
+        contentEncoding.minFileSize = 1024;
+        settings.contentEncoding = contentEncoding;
+
+        return settings;
+    }
+
+    Share::FileDesc createFile(std::string clientPath, Share::FileSize size)
+    {
+        Share::FileDesc file;
+        file.path = "share-files/" + clientPath + ".data";
+        file.clientPath = std::move(clientPath);
+        file.size = size;
+        return file;
+    }
+
+    Share::ShareDesc createShare(std::vector<Share::FileDesc> files)
+    {
+        Share::ShareDesc share;
+        for (const Share::FileDesc& file : files)
+            share.size += file.size;
+        share.files = std::move(files);
+        return share;
+    }
+} // namespace
+
+TEST(DownloadHeaders, singleFile)
+{
+    const Share::ShareDesc share{ createShare({ createFile("photo.jpg", 123456) }) };
+    const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, std::nullopt, "", "gzip, zstd") };
+
+    EXPECT_EQ(headers.body, DownloadHeaders::Body::File);
+    EXPECT_EQ(headers.filePath, workingDirectory / "share-files/photo.jpg.data");
+    EXPECT_EQ(headers.mimeType, "application/octet-stream");
+    EXPECT_FALSE(headers.proxyOffload);
+    EXPECT_FALSE(headers.contentEncoding);
+    EXPECT_FALSE(headers.varyOnAcceptEncoding); // extension never compressed
+    EXPECT_TRUE(headers.acceptRanges);
+    EXPECT_EQ(headers.contentLength, 123456u);
+}
+
+TEST(DownloadHeaders, singleFileEncoded)
+{
+    const Share::ShareDesc share{ createShare({ createFile("notes.TXT", 4096) }) };
+    const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, std::nullopt, "", "gzip, zstd;q=0") };
+
+    EXPECT_EQ(headers.contentEncoding, Zip::StreamCompression::Gzip);
+    EXPECT_TRUE(headers.varyOnAcceptEncoding);
+    // compressed size only known once compressed, no ranges on compressed files
+    EXPECT_FALSE(headers.acceptRanges);
+    EXPECT_FALSE(headers.contentLength);
+}
+
+TEST(DownloadHeaders, singleFileNotEncoded)
+{
+    // range requested
+    {
+        const Share::ShareDesc share{ createShare({ createFile("notes.txt", 4096) }) };
+        const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, std::nullopt, "bytes=0-99", "zstd") };
+
+        EXPECT_FALSE(headers.contentEncoding);
+        EXPECT_TRUE(headers.varyOnAcceptEncoding);
+        EXPECT_TRUE(headers.acceptRanges);
+        EXPECT_EQ(headers.contentLength, 4096u);
+    }
+
+    // compression not accepted by the client
+    {
+        const Share::ShareDesc share{ createShare({ createFile("notes.txt", 4096) }) };
+        const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, std::nullopt, "", "br") };
+
+        EXPECT_FALSE(headers.contentEncoding);
+        EXPECT_TRUE(headers.varyOnAcceptEncoding);
+        EXPECT_EQ(headers.contentLength, 4096u);
+    }
+
+    // file too small
+    {
+        const Share::ShareDesc share{ createShare({ createFile("notes.txt", 1023) }) };
+        const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, std::nullopt, "", "zstd") };
+
+        EXPECT_FALSE(headers.contentEncoding);
+        EXPECT_FALSE(headers.varyOnAcceptEncoding);
+        EXPECT_EQ(headers.contentLength, 1023u);
+    }
+
+    // content encoding disabled
+    {
+        DownloadSettings settings{ createSettings() };
+        settings.contentEncoding.reset();
+
+        const Share::ShareDesc share{ createShare({ createFile("notes.txt", 4096) }) };
+        const DownloadHeaders headers{ computeDownloadHeaders(settings, share, ArchiveFormat::Zip, std::nullopt, "", "zstd") };
+
+        EXPECT_FALSE(headers.contentEncoding);
+        EXPECT_FALSE(headers.varyOnAcceptEncoding);
+        EXPECT_EQ(headers.contentLength, 4096u);
+    }
+}
+
+TEST(DownloadHeaders, singleFileOffloaded)
+{
+    // the proxy sends the file as is: no compression negotiated
+    const Share::ShareDesc share{ createShare({ createFile("my notes.txt", 4096) }) };
+    const DownloadHeaders headers{ computeDownloadHeaders(createSettings(ProxyOffload::XAccelRedirect), share, ArchiveFormat::Zip, std::nullopt, "", "zstd") };
+
+    ASSERT_TRUE(headers.proxyOffload);
+    EXPECT_EQ(headers.proxyOffload->name, "X-Accel-Redirect");
+    EXPECT_EQ(headers.proxyOffload->value, "/internal/share-files/" + Wt::Utils::urlEncode("my notes.txt.data"));
+    EXPECT_FALSE(headers.contentEncoding);
+    EXPECT_FALSE(headers.varyOnAcceptEncoding);
+    EXPECT_FALSE(headers.acceptRanges);
+    EXPECT_FALSE(headers.contentLength);
+}
+
+TEST(DownloadHeaders, proxyOffloadHeader)
+{
+    const DownloadSettings xAccelRedirect{ createSettings(ProxyOffload::XAccelRedirect) };
+    EXPECT_EQ(getProxyOffloadHeader(xAccelRedirect, workingDirectory / "a/./b/file.txt")->value, "/internal/a/b/file.txt");
+    // only the working directory is exposed by the internal location
+    EXPECT_FALSE(getProxyOffloadHeader(xAccelRedirect, "/elsewhere/file.txt"));
+    EXPECT_FALSE(getProxyOffloadHeader(xAccelRedirect, workingDirectory / "../file.txt"));
+
+    const DownloadSettings xSendfile{ createSettings(ProxyOffload::XSendfile) };
+    const std::optional<ProxyOffloadHeader> header{ getProxyOffloadHeader(xSendfile, "/elsewhere/file.txt") };
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->name, "X-Sendfile");
+    EXPECT_EQ(header->value, "/elsewhere/file.txt");
+
+    EXPECT_FALSE(getProxyOffloadHeader(createSettings(), workingDirectory / "file.txt"));
+}
+
+TEST(DownloadHeaders, cachedZip)
+{
+    const Share::ShareDesc share{ createShare({ createFile("a.txt", 4096), createFile("b.txt", 10) }) };
+    const Share::CachedZip cachedZip{ workingDirectory / "zip-cache/share.zip", 5000 };
+
+    const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, ArchiveFormat::Zip, cachedZip, "", "zstd") };
+    EXPECT_EQ(headers.body, DownloadHeaders::Body::CachedZip);
+    EXPECT_EQ(headers.filePath, cachedZip.path);
+    EXPECT_EQ(headers.mimeType, "application/zip");
+    EXPECT_FALSE(headers.contentEncoding);
+    EXPECT_TRUE(headers.acceptRanges);
+    EXPECT_EQ(headers.contentLength, 5000u);
+
+    const DownloadHeaders offloadedHeaders{ computeDownloadHeaders(createSettings(ProxyOffload::XAccelRedirect), share, ArchiveFormat::Zip, cachedZip, "", "zstd") };
+    ASSERT_TRUE(offloadedHeaders.proxyOffload);
+    EXPECT_EQ(offloadedHeaders.proxyOffload->value, "/internal/zip-cache/share.zip");
+    EXPECT_FALSE(offloadedHeaders.acceptRanges);
+    EXPECT_FALSE(offloadedHeaders.contentLength);
+}
+
+TEST(DownloadHeaders, archive)
+{
+    const Share::ShareDesc share{ createShare({ createFile("a.txt", 4096), createFile("b.txt", 10) }) };
+
+    const DownloadHeaders tarHeaders{ computeDownloadHeaders(createSettings(ProxyOffload::XSendfile), share, ArchiveFormat::Tar, std::nullopt, "", "zstd") };
+    EXPECT_EQ(tarHeaders.body, DownloadHeaders::Body::Archive);
+    EXPECT_EQ(tarHeaders.mimeType, "application/x-tar");
+    EXPECT_FALSE(tarHeaders.proxyOffload); // produced by ourselves
+    EXPECT_FALSE(tarHeaders.contentEncoding);
+    EXPECT_TRUE(tarHeaders.acceptRanges);
+    EXPECT_EQ(tarHeaders.contentLength, Zip::getTarSize(createZipEntries(createSettings(), share)));
+
+    // sizes only known once produced
+    for (const ArchiveFormat format : { ArchiveFormat::Zip, ArchiveFormat::TarZstd })
+    {
+        const DownloadHeaders headers{ computeDownloadHeaders(createSettings(), share, format, std::nullopt, "", "") };
+        EXPECT_EQ(headers.body, DownloadHeaders::Body::Archive);
+        EXPECT_EQ(headers.mimeType, getArchiveMimeType(format));
+        EXPECT_FALSE(headers.acceptRanges);
+        EXPECT_FALSE(headers.contentLength);
+    }
+}
+
+TEST(DownloadHeaders, parseAcceptEncoding)
+{
+    EXPECT_FALSE(parseAcceptEncoding(""));
+    EXPECT_FALSE(parseAcceptEncoding("identity"));
+    EXPECT_FALSE(parseAcceptEncoding("br, deflate"));
+
+    EXPECT_EQ(parseAcceptEncoding("gzip"), Zip::StreamCompression::Gzip);
+    EXPECT_EQ(parseAcceptEncoding("x-gzip"), Zip::StreamCompression::Gzip);
+    EXPECT_EQ(parseAcceptEncoding(" GZip ;q=0.5"), Zip::StreamCompression::Gzip);
+    EXPECT_EQ(parseAcceptEncoding("zstd"), Zip::StreamCompression::Zstd);
+
+    // zstd preferred, whatever the weights and the order
+    EXPECT_EQ(parseAcceptEncoding("gzip, deflate, br, zstd"), Zip::StreamCompression::Zstd);
+    EXPECT_EQ(parseAcceptEncoding("gzip;q=1.0, zstd;q=0.1"), Zip::StreamCompression::Zstd);
+
+    // zero weight: not acceptable
+    EXPECT_EQ(parseAcceptEncoding("zstd;q=0, gzip"), Zip::StreamCompression::Gzip);
+    EXPECT_EQ(parseAcceptEncoding("zstd; Q=0.0, gzip"), Zip::StreamCompression::Gzip);
+    EXPECT_FALSE(parseAcceptEncoding("gzip;q=0"));
+    EXPECT_FALSE(parseAcceptEncoding("gzip;q=invalid"));
+}
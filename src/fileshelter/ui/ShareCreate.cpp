@@ -23,6 +23,7 @@
 #include <Wt/WStackedWidget.h>
 
 #include "share/IShareManager.hpp"
+#include "share/IZipCache.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Service.hpp"
 
@@ -110,6 +111,9 @@ namespace UserInterface
         form->complete().connect([=](const ShareCreateParameters& shareParameters, const std::vector<FileCreateParameters>& filesParameters) {
             FS_LOG(UI, DEBUG) << "Upload complete!";
             const Share::ShareDesc shareDesc{ Service<IShareManager>::get()->createShare(shareParameters, filesParameters, true /* transfer file ownership */) };
+            // no zip cache in the "ui" role: archives are then built by the "downloads" process, on their first download
+            if (Service<IZipCache>::exists())
+                Service<IZipCache>::get()->prepareZip(shareDesc);
 
             FS_LOG(UI, DEBUG) << "Redirecting...";
             wApp->setInternalPath("/share-created/" + shareDesc.editUuid.toString(), true);
@@ -31,8 +31,11 @@
 #include "ShareUtils.hpp"
 #include "share/CreateParameters.hpp"
 #include "share/IShareManager.hpp"
+#include "utils/Exception.hpp"
+#include "utils/IConfig.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Service.hpp"
+#include "utils/SparseFile.hpp"
 
 namespace UserInterface
 {
@@ -202,11 +205,27 @@ namespace UserInterface
 
         std::vector<Share::FileCreateParameters> filesParameters;
 
+        const bool sparsifyUploads{ Service<IConfig>::get()->getBool("upload-sparsify", false) };
+
         visitUploadedFiles([&](const Wt::WFileDropWidget::File& file) {
+            if (sparsifyUploads)
+            {
+                try
+                {
+                    SparseFile::sparsify(file.uploadedFile().spoolFileName());
+                }
+                catch (const FsException& e)
+                {
+                    // the file is still fine, just not sparse
+                    FS_LOG(UI, ERROR) << "Cannot sparsify uploaded file: " << e.what();
+                }
+            }
+
             Share::FileCreateParameters fileParameters;
 
             fileParameters.path = getRelativeToWorkingDirectoryPath(file.uploadedFile().spoolFileName());
             fileParameters.name = file.uploadedFile().clientFileName();
+            // crc32 computed in the background by the share manager, not to block this session
 
             filesParameters.emplace_back(std::move(fileParameters));
         });
@@ -19,8 +19,15 @@
 
 #include "ShareDownload.hpp"
 
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <Wt/WAnchor.h>
 #include <Wt/WApplication.h>
+#include <Wt/WCheckBox.h>
 #include <Wt/WPushButton.h>
 #include <Wt/WTemplate.h>
 
@@ -28,8 +35,10 @@
 #include "share/Exception.hpp"
 #include "share/IShareManager.hpp"
 #include "share/Types.hpp"
+#include "utils/IPageCachePrewarmer.hpp"
 #include "utils/Service.hpp"
 
+#include "FileShelterApplication.hpp"
 #include "ShareDownloadPassword.hpp"
 #include "ShareUtils.hpp"
 
@@ -82,6 +91,15 @@ namespace UserInterface
             t->bindNew<Wt::WText>("file-desc", Wt::WString::fromUTF8(std::string{ share.description }), Wt::TextFormat::Plain);
         }
 
+        // the download usually follows within seconds
+        if (Service<PageCache::IPrewarmer>::exists())
+        {
+            std::vector<std::filesystem::path> files;
+            for (const Share::FileDesc& file : share.files)
+                files.push_back(file.path.is_absolute() ? file.path : FsApp->getWorkingDirectory() / file.path);
+            Service<PageCache::IPrewarmer>::get()->prewarm(share.uuid.toString(), std::move(files));
+        }
+
         t->bindNew<Wt::WText>("share-size", ShareUtils::fileSizeToString(share.size), Wt::TextFormat::Plain);
         t->bindNew<Wt::WText>("expiry-date-time", share.expiryTime.toString() + " UTC", Wt::TextFormat::Plain);
 
@@ -90,13 +108,54 @@ namespace UserInterface
             downloadBtn->setLink(ShareResource::createLink(share.uuid, password));
         }
 
+        // multi-file shares: each file can be downloaded on its own, or a subset of them as a single archive
+        const bool isSelectable{ share.files.size() > 1 };
+        Wt::WPushButton* downloadSelectionBtn{};
+        if (isSelectable)
         {
+            t->setCondition("if-selectable", true);
+            downloadSelectionBtn = t->bindNew<Wt::WPushButton>("download-selection-btn", tr("msg-download-selection"));
+            downloadSelectionBtn->setDisabled(true);
+        }
+
+        {
+            // password must outlive this call since the links are updated later on
+            const std::optional<std::string> ownedPassword{ password ? std::optional<std::string>{ std::string{ *password } } : std::nullopt };
+            auto selection{ std::make_shared<std::vector<std::pair<Wt::WCheckBox*, Share::FileUUID>>>() };
+
             auto* filesContainer{ t->bindNew<Wt::WContainerWidget>("files") };
             for (const Share::FileDesc& file : share.files)
             {
                 Wt::WTemplate* fileTemplate{ filesContainer->addNew<Wt::WTemplate>(tr("template-share-download-file")) };
 
-                fileTemplate->bindString("name", Wt::WString::fromUTF8(std::string{ file.clientPath }), Wt::TextFormat::Plain);
+                if (isSelectable)
+                {
+                    Wt::WAnchor* nameAnchor{ fileTemplate->bindNew<Wt::WAnchor>("name", ShareResource::createLink(share.uuid, password, { file.uuid })) };
+                    nameAnchor->setTextFormat(Wt::TextFormat::Plain);
+                    nameAnchor->setText(Wt::WString::fromUTF8(std::string{ file.clientPath }));
+
+                    fileTemplate->setCondition("if-selectable", true);
+                    Wt::WCheckBox* selectCheckBox{ fileTemplate->bindNew<Wt::WCheckBox>("select") };
+                    selection->emplace_back(selectCheckBox, file.uuid);
+
+                    selectCheckBox->changed().connect([=, shareUUID = share.uuid] {
+                        std::vector<Share::FileUUID> selectedFileUUIDs;
+                        for (const auto& [checkBox, fileUUID] : *selection)
+                        {
+                            if (checkBox->isChecked())
+                                selectedFileUUIDs.push_back(fileUUID);
+                        }
+
+                        downloadSelectionBtn->setDisabled(selectedFileUUIDs.empty());
+                        if (!selectedFileUUIDs.empty())
+                            downloadSelectionBtn->setLink(ShareResource::createLink(shareUUID, ownedPassword, selectedFileUUIDs));
+                    });
+                }
+                else
+                {
+                    fileTemplate->bindString("name", Wt::WString::fromUTF8(std::string{ file.clientPath }), Wt::TextFormat::Plain);
+                }
+
                 fileTemplate->bindString("size", ShareUtils::fileSizeToString(file.size), Wt::TextFormat::Plain);
             }
         }
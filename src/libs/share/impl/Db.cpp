@@ -33,7 +33,7 @@ namespace Share
 {
 
     using Version = int;
-    static constexpr Version FS_DATABASE_VERSION{ 2 };
+    static constexpr Version FS_DATABASE_VERSION{ 3 };
 
     class VersionInfo
     {
@@ -146,19 +146,44 @@ namespace Share
         doMigrationIfNeeded(*session);
     }
 
+    static void
+    migrateFromV2(Wt::Dbo::Session& session)
+    {
+        // Added file crc32
+        session.execute("ALTER TABLE file ADD crc32 integer");
+    }
+
     void
     Db::doMigrationIfNeeded(Wt::Dbo::Session& session)
     {
+        Version version;
         try
         {
             Wt::Dbo::Transaction transaction{ session };
 
-            VersionInfo::getOrCreate(session)->getVersion();
+            version = VersionInfo::getOrCreate(session)->getVersion();
         }
         catch (Wt::Dbo::Exception& e)
         {
             throw FsException{ "Database too old, migration not supported" };
         }
+
+        if (version == FS_DATABASE_VERSION)
+            return;
+
+        if (version > FS_DATABASE_VERSION)
+            throw FsException{ "Database version " + std::to_string(version) + " is not supported" };
+
+        FS_LOG(DB, INFO) << "Migrating database from version " << version << " to " << FS_DATABASE_VERSION << "...";
+
+        Wt::Dbo::Transaction transaction{ session };
+
+        if (version < 3)
+            migrateFromV2(session);
+
+        VersionInfo::get(session).modify()->setVersion(FS_DATABASE_VERSION);
+
+        FS_LOG(DB, INFO) << "Migration complete";
     }
 
 } // namespace Share
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EncodedFileCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include "share/IShareManager.hpp"
+#include "utils/Exception.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/IOpenFileCache.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Service.hpp"
+
+namespace Share
+{
+    namespace
+    {
+        std::filesystem::path getEncodedFileCacheDirectory(const std::filesystem::path& workingDirectory)
+        {
+            return workingDirectory / "encoded-cache";
+        }
+
+        bool isVariantExtension(const std::filesystem::path& extension)
+        {
+            return extension == ".gz" || extension == ".zst";
+        }
+    } // namespace
+
+    std::unique_ptr<IEncodedFileCache> createEncodedFileCache(const std::filesystem::path& workingDirectory, EncodedFileZipperFactory zipperFactory)
+    {
+        return std::make_unique<EncodedFileCache>(workingDirectory, std::move(zipperFactory));
+    }
+
+    std::filesystem::path getEncodedFilePath(const std::filesystem::path& workingDirectory, const FileUUID& fileUUID, Zip::StreamCompression compression)
+    {
+        return getEncodedFileCacheDirectory(workingDirectory) / (fileUUID.toString() + (compression == Zip::StreamCompression::Gzip ? ".gz" : ".zst"));
+    }
+
+    EncodedFileCache::EncodedFileCache(const std::filesystem::path& workingDirectory, EncodedFileZipperFactory zipperFactory)
+        : _workingDirectory{ workingDirectory }
+        , _cacheDirectory{ getEncodedFileCacheDirectory(workingDirectory) }
+        , _zipperFactory{ std::move(zipperFactory) }
+        , _maxCacheSize{ Service<IConfig>::get()->getULong("content-encoding-cache-max-size", 1024) * 1024 * 1024 }
+    {
+        std::filesystem::create_directories(_cacheDirectory);
+        loadVariants();
+        removeDestroyedFileVariants();
+
+        _ioService.setThreadCount(1);
+        _ioService.start();
+
+        scheduleNextDestroyedFilesCheck();
+
+        FS_LOG(SHARE, INFO) << "Started encoded file cache in '" << _cacheDirectory.string() << "', size = " << _cacheSize << "/" << _maxCacheSize << " bytes";
+    }
+
+    EncodedFileCache::~EncodedFileCache()
+    {
+        _destroyedFilesCheckTimer.cancel();
+        _ioService.stop();
+        FS_LOG(SHARE, DEBUG) << "Stopped encoded file cache";
+    }
+
+    std::optional<std::filesystem::path> EncodedFileCache::getEncodedFile(const FileDesc& file, Zip::StreamCompression compression)
+    {
+        if (!file.isOwned)
+            return std::nullopt;
+
+        const std::filesystem::path variantPath{ getEncodedFilePath(_workingDirectory, file.uuid, compression) };
+        const Key key{ variantPath.filename().string() };
+
+        std::scoped_lock lock{ _mutex };
+
+        auto itVariant{ _variants.find(key) };
+        if (itVariant == std::cend(_variants))
+        {
+            scheduleBuild(file, compression);
+            return std::nullopt;
+        }
+
+        Variant& variant{ itVariant->second };
+        if (!variant.isReady)
+            return std::nullopt;
+
+        if (!std::filesystem::exists(variantPath))
+        {
+            // removed behind our back, rebuilt on the next request
+            removeVariant(key);
+            return std::nullopt;
+        }
+
+        _lru.splice(std::begin(_lru), _lru, variant.lruIt);
+        return variantPath;
+    }
+
+    void EncodedFileCache::remove(const FileUUID& fileUUID)
+    {
+        std::scoped_lock lock{ _mutex };
+
+        // pending builds no longer find their variant and discard their output
+        for (const Zip::StreamCompression compression : { Zip::StreamCompression::Gzip, Zip::StreamCompression::Zstd })
+        {
+            const Key key{ getEncodedFilePath(_workingDirectory, fileUUID, compression).filename().string() };
+            if (_variants.find(key) != std::cend(_variants))
+            {
+                FS_LOG(SHARE, DEBUG) << "Removing encoded file '" << key << "' for destroyed file";
+                removeVariant(key);
+            }
+        }
+    }
+
+    std::filesystem::path EncodedFileCache::getVariantPath(const Key& key) const
+    {
+        return _cacheDirectory / key;
+    }
+
+    void EncodedFileCache::loadVariants()
+    {
+        struct ExistingVariant
+        {
+            Key key;
+            std::uint64_t size;
+            std::filesystem::file_time_type lastWriteTime;
+        };
+        std::vector<ExistingVariant> existingVariants;
+
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator{ _cacheDirectory })
+        {
+            if (!entry.is_regular_file())
+                continue;
+
+            std::error_code ec;
+            if (!isVariantExtension(entry.path().extension()))
+            {
+                // interrupted builds
+                std::filesystem::remove(entry.path(), ec);
+                continue;
+            }
+
+            existingVariants.push_back(ExistingVariant{ entry.path().filename().string(), entry.file_size(), entry.last_write_time() });
+        }
+
+        // most recent first
+        std::sort(std::begin(existingVariants), std::end(existingVariants), [](const ExistingVariant& a, const ExistingVariant& b) { return a.lastWriteTime > b.lastWriteTime; });
+
+        for (const ExistingVariant& existingVariant : existingVariants)
+        {
+            _lru.push_back(existingVariant.key);
+            _variants.emplace(existingVariant.key, Variant{ true, existingVariant.size, std::prev(std::end(_lru)) });
+            _cacheSize += existingVariant.size;
+        }
+
+        evict();
+    }
+
+    void EncodedFileCache::scheduleBuild(const FileDesc& file, Zip::StreamCompression compression)
+    {
+        // would evict everything else anyway
+        if (file.size > _maxCacheSize)
+            return;
+
+        const Key key{ getEncodedFilePath(_workingDirectory, file.uuid, compression).filename().string() };
+
+        _lru.push_front(key);
+        _variants.emplace(key, Variant{ false, 0, std::begin(_lru) });
+
+        boost::asio::post(_ioService, [this, file, compression] {
+            build(file, compression);
+        });
+    }
+
+    void EncodedFileCache::build(const FileDesc& file, Zip::StreamCompression compression)
+    {
+        const std::filesystem::path variantPath{ getEncodedFilePath(_workingDirectory, file.uuid, compression) };
+        const Key key{ variantPath.filename().string() };
+        const std::filesystem::path tmpVariantPath{ variantPath.string() + ".tmp" };
+
+        FS_LOG(SHARE, DEBUG) << "Building encoded file '" << key << "'";
+
+        try
+        {
+            {
+                std::ofstream ofs{ tmpVariantPath.c_str(), std::ios_base::binary | std::ios_base::trunc };
+                if (!ofs)
+                    throw FsException{ "Cannot create file '" + tmpVariantPath.string() + "'" };
+
+                std::unique_ptr<Zip::IZipper> zipper{ _zipperFactory(file, compression) };
+                while (!zipper->isComplete())
+                    zipper->writeSome(ofs, Zip::WriteBudget{});
+
+                ofs.flush();
+                if (!ofs)
+                    throw FsException{ "Write failed in file '" + tmpVariantPath.string() + "'" };
+            }
+
+            std::filesystem::rename(tmpVariantPath, variantPath);
+            const std::uint64_t variantSize{ std::filesystem::file_size(variantPath) };
+
+            std::scoped_lock lock{ _mutex };
+
+            auto itVariant{ _variants.find(key) };
+            if (itVariant == std::cend(_variants))
+            {
+                std::filesystem::remove(variantPath);
+                return;
+            }
+
+            itVariant->second.isReady = true;
+            itVariant->second.size = variantSize;
+            _cacheSize += variantSize;
+
+            FS_LOG(SHARE, DEBUG) << "Encoded file '" << key << "' ready, size = " << variantSize << "/" << file.size;
+
+            evict();
+        }
+        catch (const std::exception& e)
+        {
+            FS_LOG(SHARE, ERROR) << "Cannot build encoded file '" << key << "': " << e.what();
+
+            std::error_code ec;
+            std::filesystem::remove(tmpVariantPath, ec);
+
+            std::scoped_lock lock{ _mutex };
+            if (_variants.find(key) != std::cend(_variants))
+                removeVariant(key);
+        }
+    }
+
+    void EncodedFileCache::evict()
+    {
+        auto itLru{ std::end(_lru) };
+        while (_cacheSize > _maxCacheSize && itLru != std::begin(_lru))
+        {
+            --itLru;
+
+            // skip pending builds
+            if (!_variants.at(*itLru).isReady)
+                continue;
+
+            const Key key{ *itLru };
+            FS_LOG(SHARE, DEBUG) << "Evicting encoded file '" << key << "'";
+
+            itLru = std::next(itLru);
+            removeVariant(key);
+        }
+    }
+
+    void EncodedFileCache::removeDestroyedFileVariants()
+    {
+        if (!Service<IShareManager>::exists())
+            return;
+
+        // only variants existing before the shares are listed: the others may belong to files created meanwhile
+        std::vector<Key> keys;
+        {
+            std::scoped_lock lock{ _mutex };
+            for (const auto& [key, variant] : _variants)
+                keys.push_back(key);
+        }
+
+        std::unordered_set<std::string> fileUUIDs;
+        Service<IShareManager>::get()->visitShares([&](const ShareDesc& share) {
+            for (const FileDesc& file : share.files)
+                fileUUIDs.insert(file.uuid.toString());
+        });
+
+        std::scoped_lock lock{ _mutex };
+        for (const Key& key : keys)
+        {
+            if (fileUUIDs.find(std::filesystem::path{ key }.stem().string()) == std::cend(fileUUIDs) && _variants.find(key) != std::cend(_variants))
+            {
+                FS_LOG(SHARE, DEBUG) << "Removing encoded file '" << key << "' for destroyed file";
+                removeVariant(key);
+            }
+        }
+    }
+
+    void EncodedFileCache::scheduleNextDestroyedFilesCheck()
+    {
+        _destroyedFilesCheckTimer.expires_after(_destroyedFilesCheckPeriod);
+
+        _destroyedFilesCheckTimer.async_wait([this](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            removeDestroyedFileVariants();
+            scheduleNextDestroyedFilesCheck();
+        });
+    }
+
+    void EncodedFileCache::removeVariant(const Key& key)
+    {
+        auto itVariant{ _variants.find(key) };
+        assert(itVariant != std::cend(_variants));
+
+        const Variant& variant{ itVariant->second };
+        if (variant.isReady)
+        {
+            // ongoing downloads keep their file opened
+            std::error_code ec;
+            std::filesystem::remove(getVariantPath(key), ec);
+            if (Service<IOpenFileCache>::exists())
+                Service<IOpenFileCache>::get()->invalidate(getVariantPath(key));
+            _cacheSize -= variant.size;
+        }
+
+        _lru.erase(variant.lruIt);
+        _variants.erase(itVariant);
+    }
+} // namespace Share
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <Wt/WIOService.h>
+#include <boost/asio/steady_timer.hpp>
+
+#include "share/IEncodedFileCache.hpp"
+
+namespace Share
+{
+    class EncodedFileCache : public IEncodedFileCache
+    {
+    public:
+        EncodedFileCache(const std::filesystem::path& workingDirectory, EncodedFileZipperFactory zipperFactory);
+        ~EncodedFileCache();
+
+        EncodedFileCache(const EncodedFileCache&) = delete;
+        EncodedFileCache(EncodedFileCache&&) = delete;
+        EncodedFileCache& operator=(const EncodedFileCache&) = delete;
+        EncodedFileCache& operator=(EncodedFileCache&&) = delete;
+
+    private:
+        std::optional<std::filesystem::path> getEncodedFile(const FileDesc& file, Zip::StreamCompression compression) override;
+        void remove(const FileUUID& fileUUID) override;
+
+        using Key = std::string; // file name in the cache directory
+
+        struct Variant
+        {
+            bool isReady{};
+            std::uint64_t size{};
+            std::list<Key>::iterator lruIt;
+        };
+
+        std::filesystem::path getVariantPath(const Key& key) const;
+        void loadVariants();
+        void scheduleBuild(const FileDesc& file, Zip::StreamCompression compression); // must be called with _mutex held
+        void build(const FileDesc& file, Zip::StreamCompression compression);
+        void evict(); // must be called with _mutex held
+        void removeVariant(const Key& key); // must be called with _mutex held
+        void removeDestroyedFileVariants();
+        void scheduleNextDestroyedFilesCheck();
+
+        const std::filesystem::path _workingDirectory;
+        const std::filesystem::path _cacheDirectory;
+        const EncodedFileZipperFactory _zipperFactory;
+        const std::uint64_t _maxCacheSize;
+
+        std::mutex _mutex;
+        std::unordered_map<Key, Variant> _variants;
+        std::list<Key> _lru; // most recently used first
+        std::uint64_t _cacheSize{};
+
+        const std::chrono::seconds _destroyedFilesCheckPeriod{ std::chrono::hours{ 1 } };
+        Wt::WIOService _ioService; // compresses the files, one at a time
+        boost::asio::steady_timer _destroyedFilesCheckTimer{ _ioService };
+    };
+} // namespace Share
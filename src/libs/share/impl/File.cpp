@@ -32,16 +32,41 @@ namespace Share
 
         res.modify()->_path = parameters.path;
         res.modify()->_name = parameters.name;
+        res.modify()->setCrc32(parameters.crc32);
         res.modify()->_share = share;
 
         session.flush();
         return res;
     }
 
+    std::optional<std::uint32_t>
+    File::getCrc32() const
+    {
+        if (!_crc32)
+            return std::nullopt;
+
+        return static_cast<std::uint32_t>(*_crc32);
+    }
+
+    void
+    File::setCrc32(std::optional<std::uint32_t> crc32)
+    {
+        if (crc32)
+            _crc32 = *crc32;
+        else
+            _crc32.reset();
+    }
+
     File::pointer
     File::getByPath(Wt::Dbo::Session& session, const std::filesystem::path& filePath)
     {
         return session.find<File>().where("path = ?").bind(filePath);
     }
 
+    File::pointer
+    File::getByUUID(Wt::Dbo::Session& session, const FileUUID& uuid)
+    {
+        return session.find<File>().where("uuid = ?").bind(uuid);
+    }
+
 } // namespace Share
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <optional>
 #include <string>
 
 #include <Wt/Dbo/Dbo.h>
@@ -40,6 +41,7 @@ namespace Share
         // Helpers
         static pointer create(Wt::Dbo::Session& session, const FileCreateParameters& parameters, Wt::Dbo::ptr<Share> share);
         static pointer getByPath(Wt::Dbo::Session& session, const std::filesystem::path& path);
+        static pointer getByUUID(Wt::Dbo::Session& session, const FileUUID& uuid);
 
         // Getters
         const FileUUID& getUUID() const { return _uuid; }
@@ -47,11 +49,13 @@ namespace Share
         FileSize getSize() const { return _size; }
         const std::filesystem::path& getPath() const { return _path; }
         bool isOwned() const { return _isOwned; }
+        std::optional<std::uint32_t> getCrc32() const;
 
         // Setters
         void setUUID(const FileUUID& uuid) { _uuid = uuid; }
         void setIsOwned(bool value) { _isOwned = value; }
         void setSize(FileSize size) { _size = size; }
+        void setCrc32(std::optional<std::uint32_t> crc32);
 
         template<class Action>
         void persist(Action& a)
@@ -60,8 +64,9 @@ namespace Share
             Wt::Dbo::field(a, _size, "size");
             Wt::Dbo::field(a, _path, "path");
             Wt::Dbo::field(a, _isOwned, "is_owned");
+            Wt::Dbo::field(a, _crc32, "crc32");
 
-            Wt::Dbo::field(a, _uuid, "uuid"); // not used yet
+            Wt::Dbo::field(a, _uuid, "uuid");
 
             Wt::Dbo::belongsTo(a, _share, "share", Wt::Dbo::OnDeleteCascade);
         }
@@ -73,6 +78,7 @@ namespace Share
         FileSize _size{};
         std::filesystem::path _path;
         bool _isOwned{};
+        std::optional<long long> _crc32; // not set for files created before the crc32 was computed
 
         FileUUID _uuid;
 
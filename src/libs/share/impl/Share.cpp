@@ -23,7 +23,11 @@
 
 #include "File.hpp"
 #include "Types.hpp"
+#include "share/IEncodedFileCache.hpp"
+#include "share/IZipCache.hpp"
+#include "utils/IOpenFileCache.hpp"
 #include "utils/Logger.hpp"
+#include "utils/Service.hpp"
 
 namespace Share
 {
@@ -102,13 +106,15 @@ namespace Share
     }
 
     void
-    Share::destroy(pointer& share)
+    Share::destroy(pointer& share, const std::filesystem::path& workingDirectory)
     {
         share->visitFiles([&](const File::pointer& file) {
             if (file->isOwned())
             {
                 std::error_code ec;
                 std::filesystem::remove(file->getPath(), ec);
+                if (Service<IOpenFileCache>::exists())
+                    Service<IOpenFileCache>::get()->invalidate(workingDirectory / file->getPath()); // downloads use absolute paths
                 if (ec)
                 {
                     FS_LOG(SHARE, ERROR) << "Cannot remove file '" << file->getPath().string() << "' from share '" << share->getUUID().toString() << "': " << ec.message();
@@ -118,8 +124,43 @@ namespace Share
                     FS_LOG(SHARE, DEBUG) << "Removed file '" << file->getPath().string() << "' from share '" << share->getUUID().toString() << "'";
                 }
             }
+
+            // compressed variants, if any: also produced for the files not owned by the share
+            if (Service<IEncodedFileCache>::exists())
+            {
+                Service<IEncodedFileCache>::get()->remove(file->getUUID());
+            }
+            else
+            {
+                // cache owned by another process, that drops its entries on its next check
+                for (const Zip::StreamCompression compression : { Zip::StreamCompression::Gzip, Zip::StreamCompression::Zstd })
+                {
+                    const std::filesystem::path encodedFilePath{ getEncodedFilePath(workingDirectory, file->getUUID(), compression) };
+                    if (Service<IOpenFileCache>::exists())
+                        Service<IOpenFileCache>::get()->invalidate(encodedFilePath);
+                    std::error_code ec;
+                    if (std::filesystem::remove(encodedFilePath, ec))
+                        FS_LOG(SHARE, DEBUG) << "Removed encoded file '" << encodedFilePath.string() << "' from share '" << share->getUUID().toString() << "'";
+                }
+            }
         });
 
+        if (Service<IZipCache>::exists())
+        {
+            Service<IZipCache>::get()->remove(share->getUUID());
+        }
+        else
+        {
+            // cache owned by another process, that drops its entry on its next check
+            const std::filesystem::path zipPath{ getZipCacheDirectory(workingDirectory) / (share->getUUID().toString() + ".zip") };
+
+            std::error_code ec;
+            if (Service<IOpenFileCache>::exists())
+                Service<IOpenFileCache>::get()->invalidate(zipPath);
+            if (std::filesystem::remove(zipPath, ec))
+                FS_LOG(SHARE, DEBUG) << "Removed cached zip '" << zipPath.string() << "' from share '" << share->getUUID().toString() << "'";
+        }
+
         share.remove();
     }
 
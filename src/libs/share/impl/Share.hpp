@@ -58,7 +58,7 @@ namespace Share
         static pointer getByEditUUID(Wt::Dbo::Session& session, const ShareEditUUID& uuid);
 
         static void visitAll(Wt::Dbo::Session& session, std::function<void(pointer& share)> visitor);
-        static void destroy(pointer& share);
+        static void destroy(pointer& share, const std::filesystem::path& workingDirectory);
 
         // Setters
         void setUUID(const ShareUUID& uuid) { _uuid = uuid; }
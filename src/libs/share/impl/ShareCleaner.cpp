@@ -115,13 +115,13 @@ namespace Share
         Wt::Dbo::Session& session{ _db.getTLSSession() };
         Wt::Dbo::Transaction transaction{ session };
 
-        Share::visitAll(session, [&now](Share::pointer& share) {
+        Share::visitAll(session, [&](Share::pointer& share) {
             // give some extra time for the share before actually removing it
             // -> make any ongoing downloads a chance to complete before deleting the share
             if (now > share->getExpiryTime().addSecs(3600 * 2))
             {
                 FS_LOG(SHARE, INFO) << "Removing expired share '" << share->getUUID().toString() << "'";
-                Share::destroy(share);
+                Share::destroy(share, _workingDirectory);
             }
             else
             {
@@ -25,11 +25,14 @@
 #include "Share.hpp"
 #include "ShareCleaner.hpp"
 #include "share/Exception.hpp"
+#include "utils/Crc32.hpp"
+#include "utils/Exception.hpp"
 #include "utils/IConfig.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Service.hpp"
 #include <Wt/Auth/HashFunction.h>
 #include <Wt/WLocalDateTime.h>
+#include <boost/asio/post.hpp>
 
 namespace Share
 {
@@ -52,6 +55,7 @@ namespace Share
             fileDesc.path = file->getPath();
             fileDesc.clientPath = file->getClientPath();
             fileDesc.size = file->getSize();
+            fileDesc.crc32 = file->getCrc32();
             fileDesc.isOwned = file->isOwned();
 
             desc.files.emplace_back(std::move(fileDesc));
@@ -83,12 +87,12 @@ namespace Share
     }
 
     std::unique_ptr<IShareManager>
-    createShareManager(bool enableCleaner)
+    createShareManager(bool enableCleaner, bool enableBackgroundCrc32)
     {
-        return std::make_unique<ShareManager>(enableCleaner);
+        return std::make_unique<ShareManager>(enableCleaner, enableBackgroundCrc32);
     }
 
-    ShareManager::ShareManager(bool enableCleaner)
+    ShareManager::ShareManager(bool enableCleaner, bool enableBackgroundCrc32)
         : _workingDirectory{ Service<IConfig>::get()->getPath("working-dir") }
         , _db{ _workingDirectory / "fileshelter.db" }
         , _shareCleaner{ enableCleaner ? std::make_unique<ShareCleaner>(_db, _workingDirectory) : nullptr }
@@ -111,6 +115,13 @@ namespace Share
         if (_maxValidityPeriod < _defaultValidityPeriod)
             throw Exception{ "max-validity-days must be greater than default-validity-days" };
 
+        if (enableBackgroundCrc32)
+        {
+            _crc32IoService = std::make_unique<Wt::WIOService>();
+            _crc32IoService->setThreadCount(1);
+            _crc32IoService->start();
+        }
+
         FS_LOG(SHARE, DEBUG) << "Started share manager";
         FS_LOG(SHARE, DEBUG) << "Max share size = " << _maxShareSize << " bytes";
         FS_LOG(SHARE, DEBUG) << "Max validity period = " << std::chrono::duration_cast<std::chrono::hours>(_maxValidityPeriod).count() / 24 << " days";
@@ -118,6 +129,8 @@ namespace Share
 
     ShareManager::~ShareManager()
     {
+        if (_crc32IoService)
+            _crc32IoService->stop();
         FS_LOG(SHARE, DEBUG) << "Stopped share manager";
     }
 
@@ -136,6 +149,7 @@ namespace Share
         if (!shareParameters.password.empty())
             passwordHash = _passwordVerifier.hashPassword(shareParameters.password);
 
+        ShareDesc shareDesc;
         {
             Wt::Dbo::Session& session{ _db.getTLSSession() };
             Wt::Dbo::Transaction transaction{ session };
@@ -155,8 +169,23 @@ namespace Share
                 file.modify()->setSize(fileSizes[i]);
             }
 
-            return shareToDesc(*share.get());
+            shareDesc = shareToDesc(*share.get());
+        }
+
+        // large uploads would take seconds to read: the server makes the share usable meanwhile, archives computing the crc32 on the fly
+        for (const FileDesc& file : shareDesc.files)
+        {
+            if (file.crc32)
+                continue;
+
+            const std::filesystem::path filePath{ file.path.is_absolute() ? file.path : _workingDirectory / file.path };
+            if (_crc32IoService)
+                scheduleCrc32Computation(file.uuid, filePath);
+            else
+                computeCrc32(file.uuid, filePath);
         }
+
+        return shareDesc;
     }
 
     void
@@ -171,7 +200,7 @@ namespace Share
         if (!share || share->isExpired())
             throw ShareNotFoundException{};
 
-        Share::destroy(share);
+        Share::destroy(share, _workingDirectory);
 
         FS_LOG(UI, DEBUG) << "Destroying share edit = '" << shareEditUUID.toString() << " destroyed!";
     }
@@ -274,6 +303,36 @@ namespace Share
             _shareCleaner->removeOrphanFiles(directory);
     }
 
+    void
+    ShareManager::scheduleCrc32Computation(const FileUUID& fileUUID, const std::filesystem::path& filePath)
+    {
+        boost::asio::post(*_crc32IoService, [this, fileUUID, filePath] {
+            computeCrc32(fileUUID, filePath);
+        });
+    }
+
+    void
+    ShareManager::computeCrc32(const FileUUID& fileUUID, const std::filesystem::path& filePath)
+    {
+        std::uint32_t crc32{};
+        try
+        {
+            crc32 = Crc32::computeFromFile(filePath);
+        }
+        catch (const FsException& e)
+        {
+            // may have been removed along with its share meanwhile
+            FS_LOG(SHARE, DEBUG) << "Cannot compute crc32 of '" << filePath.string() << "': " << e.what();
+            return;
+        }
+
+        Wt::Dbo::Session& session{ _db.getTLSSession() };
+        Wt::Dbo::Transaction transaction{ session };
+
+        if (File::pointer file{ File::getByUUID(session, fileUUID) })
+            file.modify()->setCrc32(crc32);
+    }
+
     void
     ShareManager::validateShareSizes(const std::vector<FileCreateParameters>& files, const std::vector<FileSize>& fileSizes)
     {
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <Wt/Auth/PasswordVerifier.h>
+#include <Wt/WIOService.h>
 
 #include "Db.hpp"
 #include "share/IShareManager.hpp"
@@ -31,7 +32,7 @@ namespace Share
     class ShareManager : public IShareManager
     {
     public:
-        ShareManager(bool enableCleaner);
+        ShareManager(bool enableCleaner, bool enableBackgroundCrc32);
         ~ShareManager();
 
         ShareManager(const ShareManager&) = delete;
@@ -56,6 +57,8 @@ namespace Share
         void removeOrphanFiles(const std::filesystem::path& directory) override;
 
         void validateShareSizes(const std::vector<FileCreateParameters>& files, const std::vector<FileSize>& fileSizes);
+        void scheduleCrc32Computation(const FileUUID& fileUUID, const std::filesystem::path& filePath);
+        void computeCrc32(const FileUUID& fileUUID, const std::filesystem::path& filePath);
 
         const std::filesystem::path _workingDirectory;
         Db _db;
@@ -68,6 +71,10 @@ namespace Share
         const std::chrono::seconds _defaultValidityPeriod{};
         const std::size_t _maxValidityHits{};
         const bool _canValidityPeriodBeSet{};
+
+        // crc32 of the files created without one, computed in the background and persisted
+        // not set in short-lived processes, that would exit before the computations are done
+        std::unique_ptr<Wt::WIOService> _crc32IoService;
     };
 
 } // namespace Share
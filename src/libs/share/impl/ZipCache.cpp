@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ZipCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include "share/IShareManager.hpp"
+#include "utils/Exception.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/IOpenFileCache.hpp"
+#include "utils/Logger.hpp"
+#include "utils/Service.hpp"
+
+namespace Share
+{
+    namespace
+    {
+        // variant of the archives stored in the cache
+        constexpr std::string_view variantFileName{ "variant" };
+    } // namespace
+
+    std::unique_ptr<IZipCache> createZipCache(const std::filesystem::path& workingDirectory, std::string_view variant, ZipperFactory zipperFactory)
+    {
+        return std::make_unique<ZipCache>(workingDirectory, variant, std::move(zipperFactory));
+    }
+
+    std::filesystem::path getZipCacheDirectory(const std::filesystem::path& workingDirectory)
+    {
+        return workingDirectory / "zip-cache";
+    }
+
+    ZipCache::ZipCache(const std::filesystem::path& workingDirectory, std::string_view variant, ZipperFactory zipperFactory)
+        : _cacheDirectory{ getZipCacheDirectory(workingDirectory) }
+        , _variant{ variant }
+        , _zipperFactory{ std::move(zipperFactory) }
+        , _maxCacheSize{ Service<IConfig>::get()->getULong("zip-cache-max-size", 1024) * 1024 * 1024 }
+        , _maxEagerShareSize{ Service<IConfig>::get()->getULong("zip-cache-eager-max-share-size", 10) * 1024 * 1024 }
+    {
+        std::filesystem::create_directories(_cacheDirectory);
+        clearIfVariantChanged();
+        loadArtifacts();
+        removeDestroyedShareArtifacts();
+
+        _ioService.setThreadCount(1);
+        _ioService.start();
+
+        scheduleNextDestroyedSharesCheck();
+
+        FS_LOG(SHARE, INFO) << "Started zip cache in '" << _cacheDirectory.string() << "', variant = '" << _variant << "', size = " << _cacheSize << "/" << _maxCacheSize << " bytes";
+    }
+
+    ZipCache::~ZipCache()
+    {
+        _destroyedSharesCheckTimer.cancel();
+        _ioService.stop();
+        FS_LOG(SHARE, DEBUG) << "Stopped zip cache";
+    }
+
+    std::optional<CachedZip> ZipCache::getZip(const ShareDesc& share)
+    {
+        const Key key{ share.uuid.toString() };
+
+        std::scoped_lock lock{ _mutex };
+
+        auto itArtifact{ _artifacts.find(key) };
+        if (itArtifact == std::cend(_artifacts))
+        {
+            scheduleBuild(share);
+            return std::nullopt;
+        }
+
+        Artifact& artifact{ itArtifact->second };
+        if (!artifact.isReady)
+            return std::nullopt;
+
+        const std::filesystem::path artifactPath{ getArtifactPath(key) };
+        if (!std::filesystem::exists(artifactPath))
+        {
+            // removed behind our back, just rebuild it
+            removeArtifact(key);
+            scheduleBuild(share);
+            return std::nullopt;
+        }
+
+        _lru.splice(std::begin(_lru), _lru, artifact.lruIt);
+        return CachedZip{ artifactPath, artifact.size };
+    }
+
+    std::optional<CachedZip> ZipCache::findZip(const ShareDesc& share)
+    {
+        const Key key{ share.uuid.toString() };
+
+        std::scoped_lock lock{ _mutex };
+
+        auto itArtifact{ _artifacts.find(key) };
+        if (itArtifact == std::cend(_artifacts) || !itArtifact->second.isReady)
+            return std::nullopt;
+
+        return CachedZip{ getArtifactPath(key), itArtifact->second.size };
+    }
+
+    void ZipCache::prepareZip(const ShareDesc& share)
+    {
+        if (share.files.size() <= 1 || share.size > _maxEagerShareSize)
+            return;
+
+        std::scoped_lock lock{ _mutex };
+
+        if (_artifacts.find(share.uuid.toString()) == std::cend(_artifacts))
+            scheduleBuild(share);
+    }
+
+    void ZipCache::remove(const ShareUUID& shareUUID)
+    {
+        const Key key{ shareUUID.toString() };
+
+        std::scoped_lock lock{ _mutex };
+
+        // a pending build no longer finds its artifact and discards its output
+        if (_artifacts.find(key) != std::cend(_artifacts))
+        {
+            FS_LOG(SHARE, DEBUG) << "Removing zip for destroyed share '" << key << "'";
+            removeArtifact(key);
+        }
+    }
+
+    std::filesystem::path ZipCache::getArtifactPath(const Key& key) const
+    {
+        return _cacheDirectory / (key + ".zip");
+    }
+
+    void ZipCache::clearIfVariantChanged()
+    {
+        const std::filesystem::path variantFilePath{ _cacheDirectory / variantFileName };
+
+        std::string storedVariant;
+        {
+            std::ifstream ifs{ variantFilePath.c_str() };
+            std::getline(ifs, storedVariant);
+        }
+        if (storedVariant == _variant)
+            return;
+
+        // also the case of caches created before the variants were recorded
+        FS_LOG(SHARE, INFO) << "Archive variant changed from '" << storedVariant << "' to '" << _variant << "', clearing the zip cache";
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator{ _cacheDirectory })
+        {
+            std::error_code ec;
+            std::filesystem::remove(entry.path(), ec);
+        }
+
+        std::ofstream ofs{ variantFilePath.c_str(), std::ios_base::trunc };
+        ofs << _variant << std::endl;
+        if (!ofs)
+            throw FsException{ "Cannot write file '" + variantFilePath.string() + "'" };
+    }
+
+    void ZipCache::loadArtifacts()
+    {
+        struct ExistingArtifact
+        {
+            Key key;
+            std::uint64_t size;
+            std::filesystem::file_time_type lastWriteTime;
+        };
+        std::vector<ExistingArtifact> existingArtifacts;
+
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator{ _cacheDirectory })
+        {
+            if (!entry.is_regular_file() || entry.path().filename() == variantFileName)
+                continue;
+
+            std::error_code ec;
+            if (entry.path().extension() != ".zip")
+            {
+                // interrupted builds
+                std::filesystem::remove(entry.path(), ec);
+                continue;
+            }
+
+            existingArtifacts.push_back(ExistingArtifact{ entry.path().stem().string(), entry.file_size(), entry.last_write_time() });
+        }
+
+        // most recent first
+        std::sort(std::begin(existingArtifacts), std::end(existingArtifacts), [](const ExistingArtifact& a, const ExistingArtifact& b) { return a.lastWriteTime > b.lastWriteTime; });
+
+        for (const ExistingArtifact& existingArtifact : existingArtifacts)
+        {
+            _lru.push_back(existingArtifact.key);
+            _artifacts.emplace(existingArtifact.key, Artifact{ true, existingArtifact.size, std::prev(std::end(_lru)), _nextGeneration++ });
+            _cacheSize += existingArtifact.size;
+        }
+
+        evict();
+    }
+
+    void ZipCache::scheduleBuild(const ShareDesc& share)
+    {
+        // would evict everything else anyway
+        if (share.size > _maxCacheSize)
+            return;
+
+        const Key key{ share.uuid.toString() };
+
+        const std::uint64_t generation{ _nextGeneration++ };
+        _lru.push_front(key);
+        _artifacts.emplace(key, Artifact{ false, 0, std::begin(_lru), generation });
+
+        boost::asio::post(_ioService, [this, share, generation] {
+            build(share, generation);
+        });
+    }
+
+    void ZipCache::build(const ShareDesc& share, std::uint64_t generation)
+    {
+        const Key key{ share.uuid.toString() };
+        const std::filesystem::path artifactPath{ getArtifactPath(key) };
+        const std::filesystem::path tmpArtifactPath{ artifactPath.string() + ".tmp" };
+
+        FS_LOG(SHARE, DEBUG) << "Building zip for share '" << key << "'";
+
+        try
+        {
+            {
+                std::ofstream ofs{ tmpArtifactPath.c_str(), std::ios_base::binary | std::ios_base::trunc };
+                if (!ofs)
+                    throw FsException{ "Cannot create file '" + tmpArtifactPath.string() + "'" };
+
+                std::unique_ptr<Zip::IZipper> zipper{ _zipperFactory(share) };
+                while (!zipper->isComplete())
+                    zipper->writeSome(ofs, Zip::WriteBudget{});
+
+                ofs.flush();
+                if (!ofs)
+                    throw FsException{ "Write failed in file '" + tmpArtifactPath.string() + "'" };
+            }
+
+            const std::uint64_t artifactSize{ std::filesystem::file_size(tmpArtifactPath) };
+
+            std::scoped_lock lock{ _mutex };
+
+            // removed meanwhile, and maybe scheduled again
+            auto itArtifact{ _artifacts.find(key) };
+            if (itArtifact == std::cend(_artifacts) || itArtifact->second.generation != generation)
+            {
+                std::filesystem::remove(tmpArtifactPath);
+                return;
+            }
+
+            std::filesystem::rename(tmpArtifactPath, artifactPath);
+            itArtifact->second.isReady = true;
+            itArtifact->second.size = artifactSize;
+            _cacheSize += artifactSize;
+
+            FS_LOG(SHARE, DEBUG) << "Zip for share '" << key << "' ready, size = " << artifactSize;
+
+            evict();
+        }
+        catch (const std::exception& e)
+        {
+            FS_LOG(SHARE, ERROR) << "Cannot build zip for share '" << key << "': " << e.what();
+
+            std::error_code ec;
+            std::filesystem::remove(tmpArtifactPath, ec);
+
+            std::scoped_lock lock{ _mutex };
+            if (auto itArtifact{ _artifacts.find(key) }; itArtifact != std::cend(_artifacts) && itArtifact->second.generation == generation)
+                removeArtifact(key);
+        }
+    }
+
+    void ZipCache::evict()
+    {
+        auto itLru{ std::end(_lru) };
+        while (_cacheSize > _maxCacheSize && itLru != std::begin(_lru))
+        {
+            --itLru;
+
+            // skip pending builds
+            if (!_artifacts.at(*itLru).isReady)
+                continue;
+
+            const Key key{ *itLru };
+            FS_LOG(SHARE, DEBUG) << "Evicting zip for share '" << key << "'";
+
+            itLru = std::next(itLru);
+            removeArtifact(key);
+        }
+    }
+
+    void ZipCache::removeDestroyedShareArtifacts()
+    {
+        if (!Service<IShareManager>::exists())
+            return;
+
+        // only artifacts existing before the shares are listed: the others may belong to shares created meanwhile
+        std::vector<Key> keys;
+        {
+            std::scoped_lock lock{ _mutex };
+            for (const auto& [key, artifact] : _artifacts)
+                keys.push_back(key);
+        }
+
+        std::unordered_set<Key> shareKeys;
+        Service<IShareManager>::get()->visitShares([&](const ShareDesc& share) {
+            shareKeys.insert(share.uuid.toString());
+        });
+
+        std::scoped_lock lock{ _mutex };
+        for (const Key& key : keys)
+        {
+            if (shareKeys.find(key) == std::cend(shareKeys) && _artifacts.find(key) != std::cend(_artifacts))
+            {
+                FS_LOG(SHARE, DEBUG) << "Removing zip for destroyed share '" << key << "'";
+                removeArtifact(key);
+            }
+        }
+    }
+
+    void ZipCache::scheduleNextDestroyedSharesCheck()
+    {
+        _destroyedSharesCheckTimer.expires_after(_destroyedSharesCheckPeriod);
+
+        _destroyedSharesCheckTimer.async_wait([this](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            removeDestroyedShareArtifacts();
+            scheduleNextDestroyedSharesCheck();
+        });
+    }
+
+    void ZipCache::removeArtifact(const Key& key)
+    {
+        auto itArtifact{ _artifacts.find(key) };
+        assert(itArtifact != std::cend(_artifacts));
+
+        const Artifact& artifact{ itArtifact->second };
+        if (artifact.isReady)
+        {
+            // ongoing downloads keep their file opened
+            std::error_code ec;
+            std::filesystem::remove(getArtifactPath(key), ec);
+            if (Service<IOpenFileCache>::exists())
+                Service<IOpenFileCache>::get()->invalidate(getArtifactPath(key));
+            _cacheSize -= artifact.size;
+        }
+
+        _lru.erase(artifact.lruIt);
+        _artifacts.erase(itArtifact);
+    }
+} // namespace Share
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <Wt/WIOService.h>
+#include <boost/asio/steady_timer.hpp>
+
+#include "share/IZipCache.hpp"
+
+namespace Share
+{
+    class ZipCache : public IZipCache
+    {
+    public:
+        ZipCache(const std::filesystem::path& workingDirectory, std::string_view variant, ZipperFactory zipperFactory);
+        ~ZipCache();
+
+        ZipCache(const ZipCache&) = delete;
+        ZipCache(ZipCache&&) = delete;
+        ZipCache& operator=(const ZipCache&) = delete;
+        ZipCache& operator=(ZipCache&&) = delete;
+
+    private:
+        std::optional<CachedZip> getZip(const ShareDesc& share) override;
+        std::optional<CachedZip> findZip(const ShareDesc& share) override;
+        void prepareZip(const ShareDesc& share) override;
+        void remove(const ShareUUID& shareUUID) override;
+
+        using Key = std::string; // share UUID
+
+        struct Artifact
+        {
+            bool isReady{};
+            std::uint64_t size{};
+            std::list<Key>::iterator lruIt;
+            std::uint64_t generation{}; // the build of a removed artifact must not complete the one scheduled after it
+        };
+
+        std::filesystem::path getArtifactPath(const Key& key) const;
+        void clearIfVariantChanged();
+        void loadArtifacts();
+        void scheduleBuild(const ShareDesc& share); // must be called with _mutex held
+        void build(const ShareDesc& share, std::uint64_t generation);
+        void evict(); // must be called with _mutex held
+        void removeArtifact(const Key& key); // must be called with _mutex held
+        void removeDestroyedShareArtifacts();
+        void scheduleNextDestroyedSharesCheck();
+
+        const std::filesystem::path _cacheDirectory;
+        const std::string _variant;
+        const ZipperFactory _zipperFactory;
+        const std::uint64_t _maxCacheSize;
+        const FileSize _maxEagerShareSize;
+
+        std::mutex _mutex;
+        std::unordered_map<Key, Artifact> _artifacts;
+        std::list<Key> _lru; // most recently used first
+        std::uint64_t _cacheSize{};
+        std::uint64_t _nextGeneration{};
+
+        const std::chrono::seconds _destroyedSharesCheckPeriod{ std::chrono::hours{ 1 } };
+        Wt::WIOService _ioService; // builds the archives, one at a time
+        boost::asio::steady_timer _destroyedSharesCheckTimer{ _ioService };
+    };
+} // namespace Share
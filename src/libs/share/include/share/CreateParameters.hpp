@@ -20,7 +20,9 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <string>
 
 namespace Share
@@ -29,6 +31,7 @@ namespace Share
     {
         std::filesystem::path path;
         std::string name;
+        std::optional<std::uint32_t> crc32; // computed if not set, in the background by the server
     };
 
     struct ShareCreateParameters
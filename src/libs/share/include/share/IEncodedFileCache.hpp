@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "share/Types.hpp"
+#include "utils/IZipper.hpp"
+
+namespace Share
+{
+    // On-disk cache of the compressed variants (HTTP content encodings) of the shared files
+    // Variants are stored in the working directory and removed along with their share
+    // Only uploaded files are cached, the others may be modified behind our back
+    // Variants of files destroyed by another process are removed at startup and then periodically
+    class IEncodedFileCache
+    {
+    public:
+        virtual ~IEncodedFileCache() = default;
+
+        // Returns the cached variant if ready, otherwise schedules its build (only once per file and compression)
+        virtual std::optional<std::filesystem::path> getEncodedFile(const FileDesc& file, Zip::StreamCompression compression) = 0;
+
+        // To be called when the file is destroyed, removes all its variants and discards ongoing builds
+        virtual void remove(const FileUUID& fileUUID) = 0;
+    };
+
+    using EncodedFileZipperFactory = std::function<std::unique_ptr<Zip::IZipper>(const FileDesc& file, Zip::StreamCompression compression)>;
+    std::unique_ptr<IEncodedFileCache> createEncodedFileCache(const std::filesystem::path& workingDirectory, EncodedFileZipperFactory zipperFactory);
+
+    std::filesystem::path getEncodedFilePath(const std::filesystem::path& workingDirectory, const FileUUID& fileUUID, Zip::StreamCompression compression);
+} // namespace Share
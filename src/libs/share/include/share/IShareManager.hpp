@@ -58,5 +58,6 @@ namespace Share
         virtual void removeOrphanFiles(const std::filesystem::path& directory) = 0;
     };
 
-    std::unique_ptr<IShareManager> createShareManager(bool enableCleaner);
+    // Without background tasks, the missing crc32 of the files are computed when the share is created
+    std::unique_ptr<IShareManager> createShareManager(bool enableCleaner, bool enableBackgroundCrc32);
 } // namespace Share
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include "share/Types.hpp"
+#include "utils/IZipper.hpp"
+
+namespace Share
+{
+    struct CachedZip
+    {
+        std::filesystem::path path;
+        std::uint64_t size{};
+    };
+
+    // On-disk cache of the zip archives generated for multi-file shares
+    // Artifacts are stored in the working directory and removed along with their share
+    // Artifacts of shares destroyed by another process are removed at startup and then periodically
+    // Artifacts are tagged by the variant of the archives (format, compression): the whole cache is cleared when it changes
+    class IZipCache
+    {
+    public:
+        virtual ~IZipCache() = default;
+
+        // Returns the cached archive if ready, otherwise schedules its build (only once per share)
+        virtual std::optional<CachedZip> getZip(const ShareDesc& share) = 0;
+
+        // Returns the cached archive if ready, from the bookkeeping only: no file access, no build scheduled
+        virtual std::optional<CachedZip> findZip(const ShareDesc& share) = 0;
+
+        // Builds the archive right away if the share is small enough
+        virtual void prepareZip(const ShareDesc& share) = 0;
+
+        // To be called when the share is destroyed, an ongoing build is discarded
+        virtual void remove(const ShareUUID& shareUUID) = 0;
+    };
+
+    using ZipperFactory = std::function<std::unique_ptr<Zip::IZipper>(const ShareDesc& share)>;
+    std::unique_ptr<IZipCache> createZipCache(const std::filesystem::path& workingDirectory, std::string_view variant, ZipperFactory zipperFactory);
+
+    std::filesystem::path getZipCacheDirectory(const std::filesystem::path& workingDirectory);
+} // namespace Share
@@ -21,6 +21,7 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <optional>
 
 #include <Wt/WDateTime.h>
 
@@ -54,6 +55,7 @@ namespace Share
         std::filesystem::path path;
         std::filesystem::path clientPath;
         FileSize size{};
+        std::optional<std::uint32_t> crc32;
         bool isOwned{};
     };
 
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <archive.h>
+
+#include "utils/IZipper.hpp"
+
+namespace Zip
+{
+    class ArchiveException : public Exception
+    {
+    public:
+        ArchiveException(struct ::archive* arch)
+            : Exception{ getError(arch) }
+        {
+        }
+
+        static std::string_view getError(struct ::archive* arch)
+        {
+            const char* str{ archive_error_string(arch) };
+            if (!str)
+            {
+                static std::string unknownError{ "Unknown archive error" };
+                return unknownError;
+            }
+
+            return str;
+        }
+    };
+} // namespace Zip
@@ -22,55 +22,20 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring> // strerror
-#include <fstream>
 
 #include <archive.h>
 #include <archive_entry.h>
 
 #include "utils/Logger.hpp"
+#include "ArchiveException.hpp"
 
 namespace Zip
 {
-    std::unique_ptr<IZipper> createArchiveZipper(const EntryContainer& entries)
+    std::unique_ptr<IZipper> createArchiveZipper(const EntryContainer& entries, Compression compression)
     {
-        return std::make_unique<ArchiveZipper>(entries);
+        return std::make_unique<ArchiveZipper>(entries, compression);
     }
 
-    class FileException : public Exception
-    {
-    public:
-        FileException(const std::filesystem::path& p, std::string_view message)
-            : Exception{ "File '" + p.string() + "': " + std::string{ message } }
-        {
-        }
-
-        FileException(const std::filesystem::path& p, std::string_view message, int err)
-            : Exception{ "File '" + p.string() + "': " + std::string{ message } + ": " + ::strerror(err) }
-        {
-        }
-    };
-
-    class ArchiveException : public Exception
-    {
-    public:
-        ArchiveException(struct ::archive* arch)
-            : Exception{ getError(arch) }
-        {
-        }
-
-        static std::string_view getError(struct ::archive* arch)
-        {
-            const char* str{ archive_error_string(arch) };
-            if (!str)
-            {
-                static std::string unknownError{ "Unknown archive error" };
-                return unknownError;
-            }
-
-            return str;
-        }
-    };
-
     void ArchiveZipper::ArchiveDeleter::operator()(struct ::archive* arch)
     {
         const int res{ ::archive_write_free(arch) };
@@ -83,7 +48,7 @@ namespace Zip
         ::archive_entry_free(archEntry);
     }
 
-    ArchiveZipper::ArchiveZipper(const EntryContainer& entries)
+    ArchiveZipper::ArchiveZipper(const EntryContainer& entries, Compression compression)
         : _entries{ entries }
         , _readBuffer(_readBufferSize, {})
         , _currentEntry{ std::cbegin(_entries) }
@@ -98,7 +63,7 @@ namespace Zip
 
         auto archiveWrite{ [](struct ::archive* a, void* clientData, const void* buff, ::size_t n) -> la_ssize_t {
             ArchiveZipper* zipper{ static_cast<ArchiveZipper*>(clientData) };
-            return zipper->onWriteCallback(static_cast<const std::byte*>(buff), n);
+            return zipper->onWriteCallback(a, static_cast<const std::byte*>(buff), n);
         } };
 
         auto archiveClose{ [](struct ::archive* a, void* clientData) {
@@ -115,7 +80,7 @@ namespace Zip
         if (::archive_write_set_format_zip(_archive.get()) != ARCHIVE_OK)
             throw ArchiveException{ _archive.get() };
 
-        if (::archive_write_set_option(_archive.get(), "zip", "compression", "deflate") != ARCHIVE_OK)
+        if (::archive_write_set_option(_archive.get(), "zip", "compression", compression == Compression::Store ? "store" : "deflate") != ARCHIVE_OK)
             throw ArchiveException{ _archive.get() };
 
         int res{ ::archive_write_open(_archive.get(), this, archiveOpen, archiveWrite, archiveClose) };
@@ -123,50 +88,64 @@ namespace Zip
             throw ArchiveException{ _archive.get() };
     }
 
-    std::uint64_t ArchiveZipper::writeSome(std::ostream& output)
+    std::uint64_t ArchiveZipper::writeSome(std::ostream& output, const WriteBudget& budget)
     {
-        assert(!_currentOutputStream);
-
-        _currentOutputStream = &output;
-        _bytesWrittenInCurrentOutputStream = 0;
+        _output.open(output, budget.maxOutputSize);
 
-        while (_bytesWrittenInCurrentOutputStream == 0)
+        try
         {
-            if (!_currentArchiveEntry)
+            std::uint64_t inputSize{};
+            while (_archive && !_output.hasPendingData() && _output.getBytesWritten() == 0 && inputSize < budget.maxInputSize)
             {
-                if (_currentEntry == std::cend(_entries))
+                if (!_currentArchiveEntry)
                 {
-                    if (::archive_write_close(_archive.get()) != ARCHIVE_OK)
+                    if (_currentEntry == std::cend(_entries))
+                    {
+                        if (::archive_write_close(_archive.get()) != ARCHIVE_OK)
+                            throw ArchiveException{ _archive.get() };
+
+                        _archive.reset();
+                        break;
+                    }
+
+                    // open first: do not write a header for an entry that cannot be read
+                    _currentFile.open(*_currentEntry);
+                    _currentArchiveEntry = createArchiveEntry(*_currentEntry, _currentEntry->mode.value_or(_currentFile.getMode()));
+                    _currentEntryOffset = 0;
+                    if (::archive_write_header(_archive.get(), _currentArchiveEntry.get()) != ARCHIVE_OK)
                         throw ArchiveException{ _archive.get() };
-
-                    _archive.reset();
-                    break;
                 }
 
-                _currentArchiveEntry = createArchiveEntry(*_currentEntry);
-                _currentEntryOffset = 0;
-                if (::archive_write_header(_archive.get(), _currentArchiveEntry.get()) != ARCHIVE_OK)
-                    throw ArchiveException{ _archive.get() };
-            }
+                const std::uint64_t previousEntryOffset{ _currentEntryOffset };
+                const bool isEntryComplete{ writeSomeCurrentFileData() };
+                inputSize += _currentEntryOffset - previousEntryOffset;
 
-            if (writeSomeCurrentFileData())
-            {
-                // entry complete
-                if (::archive_write_finish_entry(_archive.get()) != ARCHIVE_OK)
-                    throw ArchiveException{ _archive.get() };
+                if (isEntryComplete)
+                {
+                    if (::archive_write_finish_entry(_archive.get()) != ARCHIVE_OK)
+                        throw ArchiveException{ _archive.get() };
 
-                _currentArchiveEntry.reset();
-                _currentEntry++;
+                    _currentArchiveEntry.reset();
+                    _currentFile.close();
+                    _currentEntry++;
+                }
             }
         }
+        catch (...)
+        {
+            // libarchive must not write the end of the archive in the output
+            _output.close();
+            abort();
+            throw;
+        }
 
-        _currentOutputStream = nullptr;
-        return _bytesWrittenInCurrentOutputStream;
+        _output.close();
+        return _output.getBytesWritten();
     }
 
     bool ArchiveZipper::isComplete() const
     {
-        return !_archive;
+        return !_archive && !_output.hasPendingData();
     }
 
     void ArchiveZipper::abort()
@@ -174,99 +153,46 @@ namespace Zip
         FS_LOG(UTILS, DEBUG) << "Aborting zip creation";
         if (_archive)
         {
-            ::archive_write_fail(_archive.get());
+            // output is closed: the end of the archive is rejected by the write callback
+            // (archive_write_fail would leak the write buffers)
+            ::archive_write_close(_archive.get());
             _archive.reset();
         }
+        _currentFile.close();
+        _output.discardPendingData();
     }
 
-    static ::mode_t permsToMode(const std::filesystem::perms p)
+    ArchiveZipper::ArchiveEntryPtr ArchiveZipper::createArchiveEntry(const Entry& entry, std::uint32_t mode)
     {
-        using std::filesystem::perms;
-        ::mode_t mode{};
-
-        auto testPerm{ [](perms p, perms permToTest) {
-            return (p & permToTest) == permToTest;
-        } };
-
-        if (testPerm(p, perms::owner_read))
-            mode |= S_IRUSR;
-        if (testPerm(p, perms::owner_write))
-            mode |= S_IWUSR;
-        if (testPerm(p, perms::owner_exec))
-            mode |= S_IXUSR;
-        if (testPerm(p, perms::group_read))
-            mode |= S_IRGRP;
-        if (testPerm(p, perms::group_write))
-            mode |= S_IWGRP;
-        if (testPerm(p, perms::group_exec))
-            mode |= S_IXGRP;
-        if (testPerm(p, perms::others_read))
-            mode |= S_IROTH;
-        if (testPerm(p, perms::others_write))
-            mode |= S_IWOTH;
-        if (testPerm(p, perms::others_exec))
-            mode |= S_IXOTH;
-
-        return mode;
-    }
-
-    ArchiveZipper::ArchiveEntryPtr ArchiveZipper::createArchiveEntry(const Entry& entry)
-    {
-        try
-        {
-            if (!std::filesystem::is_regular_file(entry.filePath))
-                throw FileException{ entry.filePath, "not a regular file" };
-
-            ArchiveEntryPtr archiveEntry{ archive_entry_new() };
-            if (!archiveEntry)
-                throw Exception{ "Cannot create archive entry control struct" };
-
-            archive_entry_set_pathname(archiveEntry.get(), entry.fileName.c_str());
-            archive_entry_set_size(archiveEntry.get(), std::filesystem::file_size(entry.filePath));
-            archive_entry_set_mode(archiveEntry.get(), permsToMode(std::filesystem::status(entry.filePath).permissions()));
-            archive_entry_set_filetype(archiveEntry.get(), AE_IFREG);
-
-            return archiveEntry;
-        }
-        catch (const std::filesystem::filesystem_error& error)
-        {
-            throw FileException{ entry.filePath, error.what() };
-        }
+        ArchiveEntryPtr archiveEntry{ archive_entry_new() };
+        if (!archiveEntry)
+            throw Exception{ "Cannot create archive entry control struct" };
+
+        archive_entry_set_pathname(archiveEntry.get(), entry.fileName.c_str());
+        // known size: libarchive only uses ZIP64 extensions for the entries and archives that need them
+        archive_entry_set_size(archiveEntry.get(), entry.size);
+        archive_entry_set_mode(archiveEntry.get(), mode);
+        archive_entry_set_filetype(archiveEntry.get(), AE_IFREG);
+        if (entry.modificationTime)
+            archive_entry_set_mtime(archiveEntry.get(), *entry.modificationTime, 0);
+
+        return archiveEntry;
     }
 
     bool ArchiveZipper::writeSomeCurrentFileData()
     {
         assert(_currentEntry != std::cend(_entries));
+        assert(_currentFile.isOpen());
 
-        std::ifstream ifs{ _currentEntry->filePath.c_str(), std::ios_base::binary };
-        if (!ifs)
-            throw FileException{ _currentEntry->filePath, "cannot open file", errno };
-
-        ifs.seekg(0, std::ios::end);
-        const std::uint64_t fileSize{ static_cast<std::uint64_t>(ifs.tellg()) };
-        ifs.seekg(0, std::ios::beg);
-
-        // TODO: store file size?
-        if (fileSize < _currentEntryOffset)
-            throw FileException{ _currentEntry->filePath, "size changed?" };
-
-        const std::uint64_t bytesToRead{ std::min(fileSize - _currentEntryOffset, static_cast<std::uint64_t>(_readBufferSize)) };
-
-        // read from file
-        if (!ifs.seekg(_currentEntryOffset, std::ios::beg))
-            throw FileException{ _currentEntry->filePath, "seek failed", errno };
-
-        if (!ifs.read(reinterpret_cast<char*>(&_readBuffer[0]), bytesToRead))
-            throw FileException{ _currentEntry->filePath, "read failed", errno };
-
-        const std::uint64_t actualBytesRead{ static_cast<std::uint64_t>(ifs.gcount()) };
+        const std::size_t bytesToRead{ static_cast<std::size_t>(std::min(_currentEntry->size - _currentEntryOffset, static_cast<std::uint64_t>(_readBufferSize))) };
+        _currentFile.read(_currentEntryOffset, &_readBuffer[0], bytesToRead);
 
         // write to archive
         {
-            std::uint64_t remainingBytesToWrite{ actualBytesRead };
+            std::uint64_t remainingBytesToWrite{ bytesToRead };
             while (remainingBytesToWrite > 0)
             {
-                const auto writtenBytes{ archive_write_data(_archive.get(), &_readBuffer[actualBytesRead - remainingBytesToWrite], remainingBytesToWrite) };
+                const auto writtenBytes{ archive_write_data(_archive.get(), &_readBuffer[bytesToRead - remainingBytesToWrite], remainingBytesToWrite) };
                 if (writtenBytes < 0)
                     throw ArchiveException{ _archive.get() };
 
@@ -275,23 +201,19 @@ namespace Zip
             }
         }
 
-        _currentEntryOffset += actualBytesRead;
-        return (_currentEntryOffset >= fileSize);
+        _currentEntryOffset += bytesToRead;
+        return (_currentEntryOffset >= _currentEntry->size);
     }
 
-    std::int64_t ArchiveZipper::onWriteCallback(const std::byte* buffer, std::size_t bufferSize)
+    std::int64_t ArchiveZipper::onWriteCallback(struct ::archive* arch, const std::byte* buffer, std::size_t bufferSize)
     {
-        if (!_currentOutputStream)
+        if (!_output.isOpen())
         {
-            archive_set_error(_archive.get(), EIO, "IO error: operation cancelled");
+            archive_set_error(arch, EIO, "IO error: operation cancelled");
             return -1;
         }
 
-        _currentOutputStream->write(reinterpret_cast<const char*>(buffer), bufferSize);
-        if (!*_currentOutputStream)
-            throw Exception{ "Failed to write " + std::to_string(bufferSize) + " bytes in final archive output!" };
-
-        _bytesWrittenInCurrentOutputStream += bufferSize;
+        _output.write(buffer, bufferSize);
 
         return bufferSize;
     }
@@ -23,6 +23,8 @@
 #include <memory>
 
 #include "utils/IZipper.hpp"
+#include "BudgetedOutput.hpp"
+#include "EntryFile.hpp"
 
 extern "C"
 {
@@ -35,12 +37,12 @@ namespace Zip
     class ArchiveZipper : public IZipper
     {
     public:
-        ArchiveZipper(const EntryContainer& files);
+        ArchiveZipper(const EntryContainer& files, Compression compression);
         ArchiveZipper(const ArchiveZipper&) = delete;
         ArchiveZipper& operator=(const ArchiveZipper&) = delete;
 
     private:
-        std::uint64_t writeSome(std::ostream& output) override;
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
         bool isComplete() const override;
         void abort() override;
 
@@ -59,9 +61,9 @@ namespace Zip
         using ArchiveEntryPtr = std::unique_ptr<struct ::archive_entry, ArchiveEntryDeleter>;
 
         void prepareCurrentEntry();
-        static ArchiveEntryPtr createArchiveEntry(const Entry& entry);
+        static ArchiveEntryPtr createArchiveEntry(const Entry& entry, std::uint32_t mode);
         bool writeSomeCurrentFileData();
-        std::int64_t onWriteCallback(const std::byte* buff, std::size_t size);
+        std::int64_t onWriteCallback(struct ::archive* arch, const std::byte* buff, std::size_t size);
 
         const EntryContainer _entries;
         ArchivePtr _archive;
@@ -73,9 +75,9 @@ namespace Zip
         EntryContainer::const_iterator _currentEntry;
         ArchiveEntryPtr _currentArchiveEntry;
 
+        EntryFile _currentFile; // kept opened until the entry is complete
         std::uint64_t _currentEntryOffset{};
-        std::ostream* _currentOutputStream{};
-        std::uint64_t _bytesWrittenInCurrentOutputStream{};
+        BudgetedOutput _output;
     };
 
 } // namespace Zip
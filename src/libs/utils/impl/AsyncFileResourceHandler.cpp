@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AsyncFileResourceHandler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <utility>
+
+#include "utils/Exception.hpp"
+#include "utils/FileResourceHandlerCreator.hpp"
+#include "utils/Logger.hpp"
+#include "FileResourceHandler.hpp"
+
+std::unique_ptr<IResourceHandler> createFileResourceHandler(const std::filesystem::path& path, IAsyncFileReader& reader)
+{
+    // all the buffers in use: fall back to synchronous reads
+    const std::optional<IAsyncFileReader::Buffer> firstBuffer{ reader.acquireBuffer() };
+    if (!firstBuffer)
+        return createFileResourceHandler(path);
+
+    const std::optional<IAsyncFileReader::Buffer> secondBuffer{ reader.acquireBuffer() };
+    if (!secondBuffer)
+    {
+        reader.releaseBuffer(*firstBuffer);
+        return createFileResourceHandler(path);
+    }
+
+    return std::make_unique<AsyncFileResourceHandler>(path, reader, std::array{ *firstBuffer, *secondBuffer });
+}
+
+AsyncFileResourceHandler::AsyncFileResourceHandler(const std::filesystem::path& path, IAsyncFileReader& reader, const std::array<IAsyncFileReader::Buffer, 2>& buffers)
+    : _path{ path }
+    , _state{ std::make_shared<State>(reader, buffers) }
+{
+}
+
+AsyncFileResourceHandler::~AsyncFileResourceHandler()
+{
+    // the reads in flight keep the state alive, but must not call back anymore
+    std::scoped_lock lock{ _state->mutex };
+    _state->onDataReady = {};
+}
+
+void AsyncFileResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    if (!_isStarted)
+    {
+        _isStarted = true;
+
+        std::error_code ec;
+        _state->file = openFile(_path, ec);
+        if (!_state->file)
+        {
+            FS_LOG(UTILS, ERROR) << "Cannot open input file '" << _path.string() << "': " << ec.message();
+            response.setStatus(404);
+            _isFinished = true;
+            return;
+        }
+
+        const std::optional<FileRange> range{ setupFileRange(_path, _state->file->getFd(), request, response) };
+        if (!range || range->firstByte == range->beyondLastByte)
+        {
+            _isFinished = true;
+            return;
+        }
+
+        _offset = range->firstByte;
+        _nextReadOffset = range->firstByte;
+        _beyondLastByte = range->beyondLastByte;
+
+        _state->dropBehind.reset(_state->file->getFd(), range->fileSize);
+        PageCache::probe(_state->file->getFd(), range->fileSize);
+
+        // only the headers for now, data will follow once read
+        submitNextRead(0);
+        submitNextRead(1);
+        return;
+    }
+
+    if (_isFinished)
+        return;
+
+    State::Read read;
+    {
+        std::scoped_lock lock{ _state->mutex };
+
+        if (!_state->reads[_currentRead].isComplete)
+            return;
+
+        read = _state->reads[_currentRead];
+    }
+
+    if (read.result <= 0)
+    {
+        FS_LOG(UTILS, ERROR) << "Read failed in file '" << _path.string() << "': " << (read.result < 0 ? std::string{ ::strerror(-read.result) } : std::string{ "unexpected end of file" });
+        _isFinished = true;
+        return;
+    }
+
+    const std::size_t readSize{ static_cast<std::size_t>(read.result) };
+    response.out().write(reinterpret_cast<const char*>(read.buffer.data), readSize);
+    _state->dropBehind.onRead(read.offset, readSize);
+    _offset += readSize;
+
+    if (_offset >= _beyondLastByte)
+    {
+        _isFinished = true;
+        return;
+    }
+
+    if (readSize < read.size)
+    {
+        // short read: the rest of the chunk comes first
+        submitRead(_currentRead, read.offset + readSize, read.size - readSize);
+        return;
+    }
+
+    // the other buffer already holds (or is being filled with) the next chunk
+    submitNextRead(_currentRead);
+    _currentRead = 1 - _currentRead;
+}
+
+bool AsyncFileResourceHandler::isComplete() const
+{
+    return _isFinished;
+}
+
+void AsyncFileResourceHandler::abort()
+{
+    _isFinished = true;
+}
+
+bool AsyncFileResourceHandler::waitForData(DataReadyCallback onDataReady)
+{
+    std::scoped_lock lock{ _state->mutex };
+
+    if (_isFinished || _state->reads[_currentRead].isComplete)
+        return false;
+
+    _state->onDataReady = std::move(onDataReady);
+    _state->awaitedRead = _currentRead;
+    return true;
+}
+
+void AsyncFileResourceHandler::submitRead(std::size_t readIndex, std::uint64_t offset, std::size_t size)
+{
+    IAsyncFileReader::Buffer buffer;
+    {
+        std::scoped_lock lock{ _state->mutex };
+
+        State::Read& read{ _state->reads[readIndex] };
+        read.offset = offset;
+        read.size = size;
+        read.result = 0;
+        read.isComplete = false;
+        buffer = read.buffer;
+    }
+
+    try
+    {
+        _state->reader.read(_state->file->getFd(), offset, buffer, size, [state = _state, readIndex](int result) {
+            state->onReadComplete(readIndex, result);
+        });
+    }
+    catch (const FsException& e)
+    {
+        FS_LOG(UTILS, ERROR) << "Cannot read file '" << _path.string() << "': " << e.what();
+        _state->onReadComplete(readIndex, -EIO);
+    }
+}
+
+void AsyncFileResourceHandler::submitNextRead(std::size_t readIndex)
+{
+    if (_nextReadOffset >= _beyondLastByte)
+        return;
+
+    const std::size_t size{ static_cast<std::size_t>(std::min<std::uint64_t>(_state->reads[readIndex].buffer.size, _beyondLastByte - _nextReadOffset)) };
+    submitRead(readIndex, _nextReadOffset, size);
+    _nextReadOffset += size;
+}
+
+AsyncFileResourceHandler::State::State(IAsyncFileReader& reader, const std::array<IAsyncFileReader::Buffer, 2>& buffers)
+    : reader{ reader }
+{
+    for (std::size_t i{}; i < buffers.size(); ++i)
+        reads[i].buffer = buffers[i];
+}
+
+AsyncFileResourceHandler::State::~State()
+{
+    if (file)
+        dropBehind.flush();
+
+    for (const Read& read : reads)
+        reader.releaseBuffer(read.buffer);
+}
+
+void AsyncFileResourceHandler::State::onReadComplete(std::size_t readIndex, int result)
+{
+    DataReadyCallback callback;
+    {
+        std::scoped_lock lock{ mutex };
+
+        reads[readIndex].result = result;
+        reads[readIndex].isComplete = true;
+
+        if (readIndex == awaitedRead)
+            callback = std::exchange(onDataReady, {});
+    }
+
+    if (callback)
+        callback();
+}
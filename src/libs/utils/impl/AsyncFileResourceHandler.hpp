@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+#include "utils/IAsyncFileReader.hpp"
+#include "utils/IOpenFileCache.hpp"
+#include "utils/IResourceHandler.hpp"
+#include "PageCacheDropBehind.hpp"
+
+// Reads the file with an asynchronous reader, one chunk ahead of the network (double buffering)
+class AsyncFileResourceHandler final : public IResourceHandler
+{
+public:
+    AsyncFileResourceHandler(const std::filesystem::path& path, IAsyncFileReader& reader, const std::array<IAsyncFileReader::Buffer, 2>& buffers);
+    ~AsyncFileResourceHandler() override;
+    AsyncFileResourceHandler(const AsyncFileResourceHandler&) = delete;
+    AsyncFileResourceHandler& operator=(const AsyncFileResourceHandler&) = delete;
+
+private:
+    void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+    bool isComplete() const override;
+    void abort() override;
+    bool isAsynchronous() const override { return true; }
+    bool waitForData(DataReadyCallback onDataReady) override;
+
+    // Shared with the reads in flight: the file and the buffers must outlive them
+    struct State
+    {
+        State(IAsyncFileReader& reader, const std::array<IAsyncFileReader::Buffer, 2>& buffers);
+        ~State();
+
+        void onReadComplete(std::size_t readIndex, int result);
+
+        struct Read
+        {
+            IAsyncFileReader::Buffer buffer;
+            std::uint64_t offset{};
+            std::size_t size{};
+            int result{};
+            bool isComplete{};
+        };
+
+        IAsyncFileReader& reader;
+        std::shared_ptr<const OpenedFile> file;
+        PageCache::DropBehind dropBehind; // only used by the handler
+
+        std::mutex mutex;
+        std::array<Read, 2> reads;
+        DataReadyCallback onDataReady;
+        std::size_t awaitedRead{};
+    };
+
+    void submitRead(std::size_t readIndex, std::uint64_t offset, std::size_t size);
+    void submitNextRead(std::size_t readIndex);
+
+    const std::filesystem::path _path;
+    std::shared_ptr<State> _state;
+    std::size_t _currentRead{};
+    std::uint64_t _nextReadOffset{};
+    std::uint64_t _offset{};
+    std::uint64_t _beyondLastByte{};
+    bool _isStarted{};
+    bool _isFinished{};
+};
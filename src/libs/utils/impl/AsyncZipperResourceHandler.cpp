@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AsyncZipperResourceHandler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/asio/post.hpp>
+#include <Wt/WIOService.h>
+
+#include "utils/Logger.hpp"
+#include "ZipperResourceHandler.hpp"
+
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize)
+{
+    return std::make_unique<AsyncZipperResourceHandler>(std::move(zipper), workers, bufferSize);
+}
+
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize)
+{
+    return std::make_unique<AsyncZipperResourceHandler>(std::move(zipper), workers, bufferSize);
+}
+
+AsyncZipperResourceHandler::AsyncZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize)
+    : _producer{ std::make_shared<Producer>(std::move(zipper), workers, bufferSize) }
+{
+}
+
+AsyncZipperResourceHandler::AsyncZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize)
+    : _seekableZipper{ zipper.get() }
+{
+    _producer = std::make_shared<Producer>(std::move(zipper), workers, bufferSize);
+}
+
+AsyncZipperResourceHandler::~AsyncZipperResourceHandler()
+{
+    // stop the production of the downloads that did not complete
+    _producer->abort();
+}
+
+void AsyncZipperResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    if (!_isStarted)
+    {
+        _isStarted = true;
+
+        if (_seekableZipper)
+        {
+            const bool rangeSatisfiable{ setupZipperRange(*_seekableZipper, request, response) };
+            _seekableZipper = nullptr;
+            if (!rangeSatisfiable)
+            {
+                _producer->abort();
+                return;
+            }
+        }
+
+        _producer->start();
+    }
+
+    _producer->read(response.out(), _chunkSize);
+}
+
+bool AsyncZipperResourceHandler::isComplete() const
+{
+    return _producer->isComplete();
+}
+
+void AsyncZipperResourceHandler::abort()
+{
+    _producer->abort();
+}
+
+bool AsyncZipperResourceHandler::waitForData(DataReadyCallback onDataReady)
+{
+    return _producer->waitForData(std::move(onDataReady));
+}
+
+AsyncZipperResourceHandler::Producer::Producer(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize)
+    : _zipper{ std::move(zipper) }
+    , _workers{ workers }
+    , _minWriteSize{ std::max<std::size_t>(bufferSize / 4, 1) }
+    , _buffer{ bufferSize }
+{
+}
+
+void AsyncZipperResourceHandler::Producer::start()
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (canProduce())
+        scheduleProduce();
+}
+
+std::size_t AsyncZipperResourceHandler::Producer::read(std::ostream& output, std::size_t maxSize)
+{
+    std::scoped_lock lock{ _mutex };
+
+    const std::size_t readSize{ _buffer.read(output, maxSize) };
+
+    // resume the production stopped by a full buffer
+    if (canProduce())
+        scheduleProduce();
+
+    return readSize;
+}
+
+bool AsyncZipperResourceHandler::Producer::isComplete() const
+{
+    std::scoped_lock lock{ _mutex };
+
+    return (_isZipperComplete && _buffer.isEmpty()) || _isFailed || _isAborted;
+}
+
+bool AsyncZipperResourceHandler::Producer::waitForData(DataReadyCallback onDataReady)
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (!_buffer.isEmpty() || _isZipperComplete || _isFailed || _isAborted)
+        return false;
+
+    _onDataReady = std::move(onDataReady);
+    return true;
+}
+
+void AsyncZipperResourceHandler::Producer::abort()
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (_isAborted)
+        return;
+
+    _isAborted = true;
+    _onDataReady = {};
+
+    // otherwise done by the production task
+    if (!_isProducing && !_isZipperComplete && !_isFailed)
+        _zipper->abort();
+}
+
+bool AsyncZipperResourceHandler::Producer::canProduce() const
+{
+    return !_isProducing && !_isZipperComplete && !_isFailed && !_isAborted && _buffer.getFreeSize() >= _minWriteSize;
+}
+
+void AsyncZipperResourceHandler::Producer::scheduleProduce()
+{
+    _isProducing = true;
+    boost::asio::post(_workers, [producer = shared_from_this()] {
+        producer->produce();
+    });
+}
+
+void AsyncZipperResourceHandler::Producer::produce()
+{
+    std::size_t maxSize;
+    {
+        std::scoped_lock lock{ _mutex };
+        maxSize = _buffer.getFreeSize();
+    }
+
+    // free size can only grow meanwhile
+    bool failed{};
+    _output.str("");
+    try
+    {
+        _zipper->writeSome(_output, Zip::WriteBudget{ maxSize, Zip::WriteBudget{}.maxInputSize });
+    }
+    catch (const std::exception& e)
+    {
+        FS_LOG(UTILS, ERROR) << "Caught exception while writing zip: " << e.what();
+        failed = true;
+    }
+
+    DataReadyCallback onDataReady;
+    {
+        std::scoped_lock lock{ _mutex };
+
+        _isProducing = false;
+
+        const std::string data{ _output.str() };
+        if (data.size() > _buffer.getFreeSize())
+        {
+            FS_LOG(UTILS, ERROR) << "Zipper exceeded its output budget: " << data.size() << " > " << _buffer.getFreeSize();
+            failed = true;
+        }
+        else
+        {
+            _buffer.write(data.data(), data.size());
+        }
+
+        if (failed)
+        {
+            _isFailed = true;
+            _zipper->abort();
+        }
+        else if (_zipper->isComplete())
+            _isZipperComplete = true;
+        else if (_isAborted)
+            _zipper->abort();
+        else if (canProduce())
+            scheduleProduce();
+
+        if (!data.empty() || _isFailed || _isZipperComplete)
+            onDataReady = std::exchange(_onDataReady, {});
+    }
+
+    if (onDataReady)
+        onDataReady();
+}
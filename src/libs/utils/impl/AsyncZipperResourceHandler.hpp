@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "utils/IResourceHandler.hpp"
+#include "utils/IZipper.hpp"
+#include "RingBuffer.hpp"
+
+namespace Wt
+{
+    class WIOService;
+}
+
+// Runs the zipper on a worker pool, ahead of the network: the requests only drain the produced data
+class AsyncZipperResourceHandler final : public IResourceHandler
+{
+public:
+    AsyncZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize);
+    AsyncZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize);
+    ~AsyncZipperResourceHandler() override;
+    AsyncZipperResourceHandler(const AsyncZipperResourceHandler&) = delete;
+    AsyncZipperResourceHandler& operator=(const AsyncZipperResourceHandler&) = delete;
+
+private:
+    void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+    bool isComplete() const override;
+    void abort() override;
+    bool isAsynchronous() const override { return true; }
+    bool waitForData(DataReadyCallback onDataReady) override;
+
+    // Shared with the production tasks, that may outlive the handler
+    class Producer : public std::enable_shared_from_this<Producer>
+    {
+    public:
+        Producer(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize);
+
+        void start();
+        std::size_t read(std::ostream& output, std::size_t maxSize);
+        bool isComplete() const;
+        bool waitForData(DataReadyCallback onDataReady);
+        void abort();
+
+    private:
+        bool canProduce() const; // must be called with _mutex held
+        void scheduleProduce();  // must be called with _mutex held
+        void produce();
+
+        std::unique_ptr<Zip::IZipper> _zipper; // only used by the production task, once started
+        Wt::WIOService& _workers;
+        std::ostringstream _output;             // only used by the production task
+        const std::size_t _minWriteSize;
+
+        mutable std::mutex _mutex;
+        Zip::RingBuffer _buffer;
+        DataReadyCallback _onDataReady;
+        bool _isProducing{};
+        bool _isZipperComplete{};
+        bool _isFailed{};
+        bool _isAborted{};
+    };
+
+    static constexpr std::size_t _chunkSize{ 65536 };
+
+    std::shared_ptr<Producer> _producer;
+    Zip::ISeekableZipper* _seekableZipper{}; // set if the zipper is seekable, until the range is set up
+    bool _isStarted{};
+};
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BudgetedOutput.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+#include "utils/IZipper.hpp"
+
+namespace Zip
+{
+    void BudgetedOutput::open(std::ostream& output, std::size_t maxSize)
+    {
+        assert(!_output);
+
+        _output = &output;
+        _remainingSize = maxSize;
+        _bytesWritten = 0;
+
+        const std::size_t size{ std::min(_pendingData.size() - _pendingDataOffset, _remainingSize) };
+        writeToOutput(_pendingData.data() + _pendingDataOffset, size);
+        _pendingDataOffset += size;
+
+        if (_pendingDataOffset == _pendingData.size())
+            discardPendingData();
+    }
+
+    void BudgetedOutput::close()
+    {
+        _output = nullptr;
+    }
+
+    void BudgetedOutput::write(const std::byte* data, std::size_t size)
+    {
+        assert(_output);
+
+        // keep ordering: no direct write while older data is pending
+        const std::size_t directSize{ _pendingData.empty() ? std::min(size, _remainingSize) : 0 };
+        writeToOutput(data, directSize);
+        _pendingData.insert(std::end(_pendingData), data + directSize, data + size);
+    }
+
+    void BudgetedOutput::discardPendingData()
+    {
+        _pendingData.clear();
+        _pendingDataOffset = 0;
+    }
+
+    void BudgetedOutput::writeToOutput(const std::byte* data, std::size_t size)
+    {
+        if (size == 0)
+            return;
+
+        _output->write(reinterpret_cast<const char*>(data), size);
+        if (!*_output)
+            throw Exception{ "Failed to write " + std::to_string(size) + " bytes in final archive output!" };
+
+        _remainingSize -= size;
+        _bytesWritten += size;
+    }
+} // namespace Zip
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace Zip
+{
+    // Output of the libarchive based zippers: libarchive writes whole blocks, so the data
+    // exceeding the output budget of the current writeSome call is kept for the next ones
+    class BudgetedOutput
+    {
+    public:
+        // Starts a writeSome call: pending data is written first
+        void open(std::ostream& output, std::size_t maxSize);
+        void close();
+        bool isOpen() const { return _output; }
+
+        // Always accepts the whole data
+        void write(const std::byte* data, std::size_t size);
+
+        bool hasPendingData() const { return !_pendingData.empty(); }
+        void discardPendingData();
+        std::uint64_t getBytesWritten() const { return _bytesWritten; }
+
+    private:
+        void writeToOutput(const std::byte* data, std::size_t size);
+
+        std::ostream* _output{};
+        std::size_t _remainingSize{};
+        std::uint64_t _bytesWritten{};
+
+        std::vector<std::byte> _pendingData;
+        std::size_t _pendingDataOffset{};
+    };
+} // namespace Zip
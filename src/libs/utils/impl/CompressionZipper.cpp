@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CompressionZipper.hpp"
+
+#include <cstring> // strerror
+#include <sstream>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "utils/Logger.hpp"
+#include "ArchiveException.hpp"
+#include "RawFileZipper.hpp"
+
+namespace Zip
+{
+    std::unique_ptr<IZipper> createTarZstdZipper(const EntryContainer& entries, unsigned threadCount)
+    {
+        return std::make_unique<CompressionZipper>(createTarZipper(entries), StreamCompression::Zstd, 0, threadCount);
+    }
+
+    std::unique_ptr<IZipper> createCompressedFileZipper(const Entry& entry, StreamCompression compression, int level, StreamCompressionCallback onComplete)
+    {
+        return std::make_unique<CompressionZipper>(std::make_unique<RawFileZipper>(entry), compression, level, 0, std::move(onComplete));
+    }
+
+    void CompressionZipper::ArchiveDeleter::operator()(struct ::archive* arch)
+    {
+        const int res{ ::archive_write_free(arch) };
+        if (res != ARCHIVE_OK)
+            FS_LOG(UTILS, ERROR) << "Failure while freeing archive control struct: " << std::string{ ::strerror(res) };
+    }
+
+    CompressionZipper::CompressionZipper(std::unique_ptr<IZipper> zipper, StreamCompression compression, int level, unsigned threadCount, StreamCompressionCallback onComplete)
+        : _zipper{ std::move(zipper) }
+        , _onComplete{ std::move(onComplete) }
+    {
+        _archive = ArchivePtr{ ::archive_write_new() };
+        if (!_archive)
+            throw Exception{ "Cannot create archive control struct" };
+
+        auto archiveOpen{ [](struct ::archive* a, void* clientData) {
+            return ARCHIVE_OK;
+        } };
+
+        auto archiveWrite{ [](struct ::archive* a, void* clientData, const void* buff, ::size_t n) -> la_ssize_t {
+            CompressionZipper* zipper{ static_cast<CompressionZipper*>(clientData) };
+            return zipper->onWriteCallback(a, static_cast<const std::byte*>(buff), n);
+        } };
+
+        auto archiveClose{ [](struct ::archive* a, void* clientData) {
+            return ARCHIVE_OK;
+        } };
+
+        if (::archive_write_set_bytes_per_block(_archive.get(), _writeBlockSize) != ARCHIVE_OK)
+            throw ArchiveException{ _archive.get() };
+
+        // 1 => no padding for last block
+        if (::archive_write_set_bytes_in_last_block(_archive.get(), 1) != ARCHIVE_OK)
+            throw ArchiveException{ _archive.get() };
+
+        // raw format: the output of the zipper is the single entry, only passed through the compression filter
+        if (::archive_write_set_format_raw(_archive.get()) != ARCHIVE_OK)
+            throw ArchiveException{ _archive.get() };
+
+        const char* filterName{};
+        switch (compression)
+        {
+        case StreamCompression::Gzip:
+            filterName = "gzip";
+            if (::archive_write_add_filter_gzip(_archive.get()) != ARCHIVE_OK)
+                throw ArchiveException{ _archive.get() };
+
+            // same output for the same input
+            if (::archive_write_set_filter_option(_archive.get(), filterName, "timestamp", nullptr) != ARCHIVE_OK)
+                FS_LOG(UTILS, WARNING) << "Cannot disable gzip timestamps: " << ArchiveException::getError(_archive.get());
+            break;
+
+        case StreamCompression::Zstd:
+            filterName = "zstd";
+            if (::archive_write_add_filter_zstd(_archive.get()) != ARCHIVE_OK)
+                throw ArchiveException{ _archive.get() };
+
+            // not supported by older libarchive versions
+            if (threadCount > 0 && ::archive_write_set_filter_option(_archive.get(), filterName, "threads", std::to_string(threadCount).c_str()) != ARCHIVE_OK)
+                FS_LOG(UTILS, WARNING) << "Cannot use " << threadCount << " zstd threads: " << ArchiveException::getError(_archive.get());
+            break;
+        }
+
+        if (level > 0 && ::archive_write_set_filter_option(_archive.get(), filterName, "compression-level", std::to_string(level).c_str()) != ARCHIVE_OK)
+            FS_LOG(UTILS, WARNING) << "Cannot use " << filterName << " compression level " << level << ": " << ArchiveException::getError(_archive.get());
+
+        if (::archive_write_open(_archive.get(), this, archiveOpen, archiveWrite, archiveClose) != ARCHIVE_OK)
+            throw ArchiveException{ _archive.get() };
+
+        std::unique_ptr<struct ::archive_entry, decltype(&::archive_entry_free)> archiveEntry{ ::archive_entry_new(), &::archive_entry_free };
+        if (!archiveEntry)
+            throw Exception{ "Cannot create archive entry control struct" };
+
+        ::archive_entry_set_filetype(archiveEntry.get(), AE_IFREG);
+        if (::archive_write_header(_archive.get(), archiveEntry.get()) != ARCHIVE_OK)
+            throw ArchiveException{ _archive.get() };
+    }
+
+    std::uint64_t CompressionZipper::writeSome(std::ostream& output, const WriteBudget& budget)
+    {
+        _output.open(output, budget.maxOutputSize);
+
+        try
+        {
+            // compressed data may be buffered: loop until something is output
+            std::uint64_t inputSize{};
+            while (_archive && !_output.hasPendingData() && _output.getBytesWritten() == 0 && inputSize < budget.maxInputSize)
+            {
+                if (_zipper->isComplete())
+                {
+                    if (::archive_write_finish_entry(_archive.get()) != ARCHIVE_OK)
+                        throw ArchiveException{ _archive.get() };
+
+                    if (::archive_write_close(_archive.get()) != ARCHIVE_OK)
+                        throw ArchiveException{ _archive.get() };
+
+                    _archive.reset();
+                    if (_onComplete)
+                        _onComplete(_inputSize, _outputSize);
+                    break;
+                }
+
+                // the output of the zipper is the input of the compression
+                const std::size_t maxInputSize{ static_cast<std::size_t>(budget.maxInputSize - inputSize) };
+
+                std::ostringstream oss;
+                const std::uint64_t writtenSize{ _zipper->writeSome(oss, WriteBudget{ maxInputSize, maxInputSize }) };
+                inputSize += writtenSize;
+                _inputSize += writtenSize;
+
+                const std::string data{ oss.str() };
+                if (!data.empty() && ::archive_write_data(_archive.get(), data.data(), data.size()) < 0)
+                    throw ArchiveException{ _archive.get() };
+            }
+        }
+        catch (...)
+        {
+            // libarchive must not write the end of the archive in the output
+            _output.close();
+            abort();
+            throw;
+        }
+
+        _output.close();
+        return _output.getBytesWritten();
+    }
+
+    bool CompressionZipper::isComplete() const
+    {
+        return !_archive && !_output.hasPendingData();
+    }
+
+    void CompressionZipper::abort()
+    {
+        FS_LOG(UTILS, DEBUG) << "Aborting compression";
+        _zipper->abort();
+        if (_archive)
+        {
+            // output is closed: the end of the archive is rejected by the write callback
+            // (archive_write_fail would leak the write buffers)
+            ::archive_write_close(_archive.get());
+            _archive.reset();
+        }
+        _output.discardPendingData();
+    }
+
+    std::int64_t CompressionZipper::onWriteCallback(struct ::archive* arch, const std::byte* buffer, std::size_t bufferSize)
+    {
+        if (!_output.isOpen())
+        {
+            archive_set_error(arch, EIO, "IO error: operation cancelled");
+            return -1;
+        }
+
+        _output.write(buffer, bufferSize);
+        _outputSize += bufferSize;
+
+        return bufferSize;
+    }
+} // namespace Zip
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "utils/IZipper.hpp"
+#include "BudgetedOutput.hpp"
+
+extern "C"
+{
+    struct archive;
+};
+
+namespace Zip
+{
+    // Compression of the output of another zipper, as a single stream
+    // threadCount is only used by zstd, 0 meaning no extra thread
+    class CompressionZipper : public IZipper
+    {
+    public:
+        CompressionZipper(std::unique_ptr<IZipper> zipper, StreamCompression compression, int level, unsigned threadCount, StreamCompressionCallback onComplete = {});
+        CompressionZipper(const CompressionZipper&) = delete;
+        CompressionZipper& operator=(const CompressionZipper&) = delete;
+
+    private:
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
+        bool isComplete() const override;
+        void abort() override;
+
+        class ArchiveDeleter
+        {
+        public:
+            void operator()(struct ::archive* arch);
+        };
+        using ArchivePtr = std::unique_ptr<struct ::archive, ArchiveDeleter>;
+
+        std::int64_t onWriteCallback(struct ::archive* arch, const std::byte* buff, std::size_t size);
+
+        std::unique_ptr<IZipper> _zipper;
+        ArchivePtr _archive;
+        StreamCompressionCallback _onComplete;
+        std::uint64_t _inputSize{};
+        std::uint64_t _outputSize{};
+
+        static inline constexpr std::size_t _writeBlockSize{ 65536 };
+        BudgetedOutput _output;
+    };
+} // namespace Zip
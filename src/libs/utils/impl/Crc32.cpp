@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/Crc32.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring> // strerror
+#include <fstream>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define FS_CRC32_PCLMUL 1
+    #include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) && defined(__linux__)
+    #define FS_CRC32_ARMV8 1
+    #include <arm_acle.h>
+    #include <asm/hwcap.h>
+    #include <sys/auxv.h>
+#endif
+
+#include "utils/Exception.hpp"
+
+namespace Crc32
+{
+    namespace
+    {
+        constexpr Value polynomial{ 0xEDB88320 };
+
+        constexpr std::array<Value, 256> computeTable()
+        {
+            std::array<Value, 256> table{};
+            for (Value i{}; i < table.size(); ++i)
+            {
+                Value crc{ i };
+                for (int bit{}; bit < 8; ++bit)
+                    crc = (crc & 1) ? (crc >> 1) ^ polynomial : (crc >> 1);
+
+                table[i] = crc;
+            }
+
+            return table;
+        }
+
+        constexpr std::array<Value, 256> table{ computeTable() };
+
+        // crc is the raw register value (not inverted)
+        Value updateScalar(Value crc, const std::byte* data, std::size_t size)
+        {
+            for (std::size_t i{}; i < size; ++i)
+                crc = table[(crc ^ static_cast<Value>(data[i])) & 0xFF] ^ (crc >> 8);
+
+            return crc;
+        }
+
+#if FS_CRC32_PCLMUL
+        // Carry-less multiplication folding, see Intel's "Fast CRC Computation for
+        // Generic Polynomials Using PCLMULQDQ Instruction"
+        // size must be at least 64 and a multiple of 16
+        __attribute__((target("pclmul,sse4.1"))) Value updatePclmul(Value crc, const std::byte* data, std::size_t size)
+        {
+            alignas(16) static constexpr std::uint64_t k1k2[]{ 0x0154442bd4, 0x01c6e41596 };
+            alignas(16) static constexpr std::uint64_t k3k4[]{ 0x01751997d0, 0x00ccaa009e };
+            alignas(16) static constexpr std::uint64_t k5k0[]{ 0x0163cd6124, 0x0000000000 };
+            alignas(16) static constexpr std::uint64_t poly[]{ 0x01db710641, 0x01f7011641 };
+
+            const auto load{ [](const std::byte* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); } };
+
+            __m128i x1{ load(data + 0x00) };
+            __m128i x2{ load(data + 0x10) };
+            __m128i x3{ load(data + 0x20) };
+            __m128i x4{ load(data + 0x30) };
+            x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+
+            __m128i x0{ _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2)) };
+            data += 64;
+            size -= 64;
+
+            // Fold 4 x 128 bits in parallel
+            while (size >= 64)
+            {
+                const __m128i x5{ _mm_clmulepi64_si128(x1, x0, 0x00) };
+                const __m128i x6{ _mm_clmulepi64_si128(x2, x0, 0x00) };
+                const __m128i x7{ _mm_clmulepi64_si128(x3, x0, 0x00) };
+                const __m128i x8{ _mm_clmulepi64_si128(x4, x0, 0x00) };
+
+                x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+                x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+                x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+                x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+                x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), load(data + 0x00));
+                x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), load(data + 0x10));
+                x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), load(data + 0x20));
+                x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), load(data + 0x30));
+
+                data += 64;
+                size -= 64;
+            }
+
+            // Fold into 128 bits
+            x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+            for (const __m128i& next : { x2, x3, x4 })
+            {
+                const __m128i x5{ _mm_clmulepi64_si128(x1, x0, 0x00) };
+                x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+                x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+            }
+
+            // Single fold blocks of 128 bits
+            while (size >= 16)
+            {
+                const __m128i x5{ _mm_clmulepi64_si128(x1, x0, 0x00) };
+                x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+                x1 = _mm_xor_si128(_mm_xor_si128(x1, load(data)), x5);
+
+                data += 16;
+                size -= 16;
+            }
+
+            // Fold 128 bits to 64 bits
+            const __m128i mask32{ _mm_setr_epi32(~0, 0, ~0, 0) };
+            x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+            x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+            x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+            x2 = _mm_srli_si128(x1, 4);
+            x1 = _mm_and_si128(x1, mask32);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_xor_si128(x1, x2);
+
+            // Barrett reduction to 32 bits
+            x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+            x2 = _mm_and_si128(x1, mask32);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+            x2 = _mm_and_si128(x2, mask32);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x1 = _mm_xor_si128(x1, x2);
+
+            return static_cast<Value>(_mm_extract_epi32(x1, 1));
+        }
+
+        Value updateAccelerated(Value crc, const std::byte* data, std::size_t size)
+        {
+            static const bool hasPclmul{ __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1") };
+
+            if (hasPclmul && size >= 64)
+            {
+                const std::size_t chunkSize{ size & ~std::size_t{ 15 } };
+                crc = updatePclmul(crc, data, chunkSize);
+                data += chunkSize;
+                size -= chunkSize;
+            }
+
+            return updateScalar(crc, data, size);
+        }
+#elif FS_CRC32_ARMV8
+        __attribute__((target("+crc"))) Value updateArmv8(Value crc, const std::byte* data, std::size_t size)
+        {
+            while (size >= sizeof(std::uint64_t))
+            {
+                std::uint64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                crc = __crc32d(crc, value);
+
+                data += sizeof(value);
+                size -= sizeof(value);
+            }
+
+            while (size > 0)
+            {
+                crc = __crc32b(crc, static_cast<std::uint8_t>(*data));
+                data++;
+                size--;
+            }
+
+            return crc;
+        }
+
+        Value updateAccelerated(Value crc, const std::byte* data, std::size_t size)
+        {
+            static const bool hasCrc32{ (::getauxval(AT_HWCAP) & HWCAP_CRC32) != 0 };
+
+            if (hasCrc32)
+                return updateArmv8(crc, data, size);
+
+            return updateScalar(crc, data, size);
+        }
+#else
+        Value updateAccelerated(Value crc, const std::byte* data, std::size_t size)
+        {
+            return updateScalar(crc, data, size);
+        }
+#endif
+    } // namespace
+
+    Value update(Value crc, const std::byte* data, std::size_t size)
+    {
+        return ~updateAccelerated(~crc, data, size);
+    }
+
+    Value computeFromFile(const std::filesystem::path& path)
+    {
+        std::ifstream ifs{ path.c_str(), std::ios_base::binary };
+        if (!ifs)
+            throw FsException{ "Cannot open file '" + path.string() + "': " + ::strerror(errno) };
+
+        constexpr std::size_t readBufferSize{ 65536 };
+        std::vector<std::byte> buffer(readBufferSize);
+
+        Value crc{};
+        while (ifs)
+        {
+            ifs.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+            if (ifs.bad())
+                throw FsException{ "Read failed in file '" + path.string() + "': " + ::strerror(errno) };
+
+            crc = update(crc, buffer.data(), static_cast<std::size_t>(ifs.gcount()));
+        }
+
+        return crc;
+    }
+} // namespace Crc32
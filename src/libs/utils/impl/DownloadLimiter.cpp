@@ -0,0 +1,677 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DownloadLimiter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+#include <streambuf>
+#include <utility>
+
+#include "utils/Logger.hpp"
+
+namespace
+{
+    // Counts the bytes written in the response, whatever the handler
+    class CountingStreamBuf : public std::streambuf
+    {
+    public:
+        CountingStreamBuf(std::streambuf& output)
+            : _output{ output } {}
+
+        std::uint64_t getCount() const { return _count; }
+
+    private:
+        int_type overflow(int_type c) override
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+
+            if (traits_type::eq_int_type(_output.sputc(traits_type::to_char_type(c)), traits_type::eof()))
+                return traits_type::eof();
+
+            _count++;
+            return c;
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override
+        {
+            const std::streamsize written{ _output.sputn(data, size) };
+            _count += written;
+            return written;
+        }
+
+        int sync() override
+        {
+            return _output.pubsync();
+        }
+
+        std::streambuf& _output;
+        std::uint64_t _count{};
+    };
+} // namespace
+
+std::unique_ptr<IDownloadLimiter> createDownloadLimiter(const DownloadLimits& limits)
+{
+    return std::make_unique<DownloadLimiter>(limits);
+}
+
+DownloadSlots::DownloadSlots(const DownloadLimits& limits)
+    : _limits{ limits }
+{
+}
+
+std::unique_ptr<DownloadAdmission> DownloadSlots::admit(std::string_view clientAddress)
+{
+    {
+        std::scoped_lock lock{ _mutex };
+
+        if (_limits.maxActiveCount > 0 && _activeCount >= _limits.maxActiveCount)
+        {
+            _rejectedCount++;
+            return nullptr;
+        }
+
+        std::size_t& clientActiveCount{ _activeCountByClient[std::string{ clientAddress }] };
+        if (_limits.maxActivePerClientCount > 0 && clientActiveCount >= _limits.maxActivePerClientCount)
+        {
+            _clientRejectedCount++;
+            return nullptr;
+        }
+
+        clientActiveCount++;
+        _activeCount++;
+        _admittedCount++;
+    }
+
+    return std::make_unique<ClientDownloadAdmission>(shared_from_this(), clientAddress);
+}
+
+void DownloadSlots::release(const std::string& clientAddress)
+{
+    std::scoped_lock lock{ _mutex };
+
+    auto itClient{ _activeCountByClient.find(clientAddress) };
+    assert(itClient != std::cend(_activeCountByClient));
+    if (--itClient->second == 0)
+        _activeCountByClient.erase(itClient);
+
+    _activeCount--;
+}
+
+DownloadSlots::Flow* DownloadSlots::openFlow(std::string_view key)
+{
+    std::scoped_lock lock{ _mutex };
+
+    auto [itFlow, inserted]{ _flows.try_emplace(std::string{ key }) };
+    if (inserted)
+        itFlow->second.key = key;
+
+    itFlow->second.handlerCount++;
+    return &itFlow->second;
+}
+
+void DownloadSlots::closeFlow(Flow* flow)
+{
+    std::scoped_lock lock{ _mutex };
+
+    // scheduled flows are removed once unscheduled
+    if (--flow->handlerCount == 0 && !flow->isScheduled)
+        _flows.erase(flow->key);
+}
+
+bool DownloadSlots::acquireProcessing(ProcessingTicket& ticket)
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (std::exchange(ticket.hasSlot, false))
+        return true;
+
+    // do not overtake the waiting handlers
+    if (_waitingCount > 0 || !canProcess())
+    {
+        _deferredCount++;
+        return false;
+    }
+
+    _processingCount++;
+    return true;
+}
+
+void DownloadSlots::releaseProcessing(ProcessingTicket& ticket, std::chrono::microseconds cost)
+{
+    IResourceHandler::DataReadyCallback callback;
+    {
+        std::scoped_lock lock{ _mutex };
+
+        // only the scheduled slots are charged: flows are not penalized for what they used without competition
+        Flow& flow{ *ticket.flow };
+        if (const std::chrono::microseconds charged{ std::exchange(ticket.charged, {}) }; charged.count() > 0)
+            flow.deficit += charged - cost;
+        flow.lastCost = cost;
+
+        callback = handOverProcessing();
+    }
+
+    if (callback)
+        callback();
+}
+
+bool DownloadSlots::waitForProcessing(const std::shared_ptr<ProcessingTicket>& ticket, IResourceHandler::DataReadyCallback onSlot)
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (ticket->hasSlot)
+        return false;
+
+    // a slot may have been released in the meantime
+    if (_waitingCount == 0 && canProcess())
+    {
+        _processingCount++;
+        ticket->hasSlot = true;
+        return false;
+    }
+
+    ticket->onSlot = std::move(onSlot);
+    if (!ticket->isQueued)
+    {
+        Flow& flow{ *ticket->flow };
+
+        ticket->isQueued = true;
+        flow.queue.push_back(ticket);
+        _waitingCount++;
+
+        if (!flow.isScheduled)
+        {
+            flow.isScheduled = true;
+            flow.deficit = _limits.schedulingQuantum;
+            _newFlows.push_back(&flow);
+        }
+    }
+
+    return true;
+}
+
+void DownloadSlots::cancelProcessing(const std::shared_ptr<ProcessingTicket>& ticket)
+{
+    IResourceHandler::DataReadyCallback callback;
+    {
+        std::scoped_lock lock{ _mutex };
+
+        Flow& flow{ *ticket->flow };
+        if (ticket->isQueued)
+        {
+            flow.queue.erase(std::remove(std::begin(flow.queue), std::end(flow.queue), ticket), std::end(flow.queue));
+            ticket->isQueued = false;
+            ticket->onSlot = {};
+            _waitingCount--;
+        }
+
+        if (std::exchange(ticket->hasSlot, false))
+        {
+            flow.deficit += std::exchange(ticket->charged, {});
+            callback = handOverProcessing();
+        }
+    }
+
+    if (callback)
+        callback();
+}
+
+void DownloadSlots::registerDownload(AdmittedResourceHandler& handler)
+{
+    std::scoped_lock lock{ _downloadsMutex };
+    _downloads.insert(&handler);
+}
+
+void DownloadSlots::unregisterDownload(AdmittedResourceHandler& handler)
+{
+    std::scoped_lock lock{ _downloadsMutex };
+    _downloads.erase(&handler);
+}
+
+void DownloadSlots::evictStalledDownloads()
+{
+    const AdmittedResourceHandler::Clock::time_point now{ AdmittedResourceHandler::Clock::now() };
+
+    AdmittedResourceHandler::EvictedResources evictedResources;
+    {
+        std::scoped_lock lock{ _downloadsMutex };
+        for (AdmittedResourceHandler* handler : _downloads)
+        {
+            switch (handler->evictIfStalled(now, evictedResources))
+            {
+            case AdmittedResourceHandler::Stall::None:
+                break;
+            case AdmittedResourceHandler::Stall::Idle:
+                _idleEvictedCount++;
+                break;
+            case AdmittedResourceHandler::Stall::Slow:
+                _slowEvictedCount++;
+                break;
+            }
+        }
+    }
+
+    // may wake up other downloads, that may be destroyed and unregistered right away
+    for (AdmittedResourceHandler::EvictedResource& evictedResource : evictedResources)
+        evictedResource.handler->abort();
+    evictedResources.clear();
+}
+
+std::size_t DownloadSlots::getActiveCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _activeCount;
+}
+
+std::uint64_t DownloadSlots::getAdmittedCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _admittedCount;
+}
+
+std::uint64_t DownloadSlots::getRejectedCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _rejectedCount;
+}
+
+std::uint64_t DownloadSlots::getClientRejectedCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _clientRejectedCount;
+}
+
+std::uint64_t DownloadSlots::getDeferredCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _deferredCount;
+}
+
+std::uint64_t DownloadSlots::getIdleEvictedCount() const
+{
+    return _idleEvictedCount;
+}
+
+std::uint64_t DownloadSlots::getSlowEvictedCount() const
+{
+    return _slowEvictedCount;
+}
+
+bool DownloadSlots::canProcess() const
+{
+    return _limits.maxProcessingCount == 0 || _processingCount < _limits.maxProcessingCount;
+}
+
+IResourceHandler::DataReadyCallback DownloadSlots::handOverProcessing()
+{
+    while (_waitingCount > 0)
+    {
+        std::deque<Flow*>& flows{ !_newFlows.empty() ? _newFlows : _oldFlows };
+        Flow* flow{ flows.front() };
+
+        if (flow->deficit.count() <= 0)
+        {
+            flow->deficit += _limits.schedulingQuantum;
+            flows.pop_front();
+            _oldFlows.push_back(flow);
+            continue;
+        }
+
+        if (flow->queue.empty())
+        {
+            flows.pop_front();
+            // emptied new flows wait for their turn with the old ones, so that they cannot be served first again right away
+            if (&flows == &_newFlows)
+                _oldFlows.push_back(flow);
+            else
+                unscheduleFlow(flow);
+            continue;
+        }
+
+        // the slot is not released: the next handler gets it
+        std::shared_ptr<ProcessingTicket> ticket{ flow->queue.front() };
+        flow->queue.pop_front();
+        _waitingCount--;
+
+        ticket->isQueued = false;
+        ticket->hasSlot = true;
+        ticket->charged = std::max(flow->lastCost, std::chrono::microseconds{ 1 });
+        flow->deficit -= ticket->charged;
+
+        return std::exchange(ticket->onSlot, {});
+    }
+
+    // nothing to schedule anymore
+    for (Flow* flow : _newFlows)
+        unscheduleFlow(flow);
+    _newFlows.clear();
+    for (Flow* flow : _oldFlows)
+        unscheduleFlow(flow);
+    _oldFlows.clear();
+
+    _processingCount--;
+    return {};
+}
+
+void DownloadSlots::unscheduleFlow(Flow* flow)
+{
+    flow->isScheduled = false;
+    if (flow->handlerCount == 0)
+        _flows.erase(flow->key);
+}
+
+ClientDownloadAdmission::ClientDownloadAdmission(std::shared_ptr<DownloadSlots> slots, std::string_view clientAddress)
+    : _slots{ std::move(slots) }
+    , _clientAddress{ clientAddress }
+{
+}
+
+ClientDownloadAdmission::~ClientDownloadAdmission()
+{
+    _slots->release(_clientAddress);
+}
+
+AdmittedResourceHandler::AdmittedResourceHandler(std::shared_ptr<DownloadSlots> slots, std::unique_ptr<DownloadAdmission> admission, std::string_view flow, std::unique_ptr<IResourceHandler> handler)
+    : _slots{ std::move(slots) }
+    , _admission{ std::move(admission) }
+    , _handler{ std::move(handler) }
+    , _ticket{ std::make_shared<DownloadSlots::ProcessingTicket>() }
+    , _activity{ std::make_shared<Activity>() }
+    , _rateCheckTime{ Clock::now() }
+{
+    _ticket->flow = _slots->openFlow(flow);
+    _activity->lastProgress = _rateCheckTime;
+    _slots->registerDownload(*this);
+}
+
+AdmittedResourceHandler::~AdmittedResourceHandler()
+{
+    // first: the sweeper may be using this handler
+    _slots->unregisterDownload(*this);
+
+    _slots->cancelProcessing(_ticket);
+    _slots->closeFlow(_ticket->flow);
+}
+
+AdmittedResourceHandler::Stall AdmittedResourceHandler::evictIfStalled(Clock::time_point now, EvictedResources& evictedResources)
+{
+    // busy handlers are producing some data
+    std::unique_lock lock{ _mutex, std::try_to_lock };
+    if (!lock.owns_lock() || !_handler || !_admission)
+        return Stall::None;
+
+    Clock::time_point lastProgress;
+    Clock::duration waitDuration;
+    std::uint64_t sentSize;
+    {
+        std::scoped_lock activityLock{ _activity->mutex };
+
+        // our own fault
+        if (_activity->waitStart)
+            return Stall::None;
+
+        lastProgress = _activity->lastProgress;
+        waitDuration = _activity->waitDuration;
+        sentSize = _activity->sentSize;
+    }
+
+    const DownloadLimits& limits{ _slots->getLimits() };
+
+    Stall stall{ Stall::None };
+    if (limits.idleTimeout.count() > 0 && now - lastProgress > limits.idleTimeout)
+    {
+        stall = Stall::Idle;
+    }
+    else if (limits.minRate > 0)
+    {
+        const Clock::duration clientDuration{ (now - _rateCheckTime) - (waitDuration - _rateCheckWaitDuration) };
+        if (clientDuration >= limits.minRatePeriod)
+        {
+            const double minSize{ static_cast<double>(limits.minRate) * std::chrono::duration<double>(clientDuration).count() };
+            if (static_cast<double>(sentSize - _rateCheckSentSize) < minSize)
+                stall = Stall::Slow;
+
+            _rateCheckTime = now;
+            _rateCheckWaitDuration = waitDuration;
+            _rateCheckSentSize = sentSize;
+        }
+    }
+
+    if (stall == Stall::None)
+        return stall;
+
+    FS_LOG(UTILS, INFO) << "Evicting " << (stall == Stall::Idle ? "idle" : "slow") << " download, sent " << sentSize << " bytes";
+
+    // the connection is left to the HTTP server, but our resources are released right now
+    evictedResources.push_back(EvictedResource{ std::move(_handler), std::move(_admission) });
+
+    return stall;
+}
+
+void AdmittedResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    std::scoped_lock lock{ _mutex };
+
+    // evicted
+    if (!_handler)
+    {
+        _slots->cancelProcessing(_ticket);
+        return;
+    }
+
+    {
+        // the client has read the previous data
+        std::scoped_lock activityLock{ _activity->mutex };
+        _activity->lastProgress = Clock::now();
+    }
+
+    _isDeferred = !_slots->acquireProcessing(*_ticket);
+    if (_isDeferred)
+        return;
+
+    // flows are charged with the time spent producing their data (disk reads, compression...)
+    // asynchronous handlers produce it on other threads (io_uring, zip workers): they are charged by size instead
+    const Clock::time_point start{ Clock::now() };
+    const bool isAsynchronous{ _handler->isAsynchronous() };
+
+    std::ostream& output{ response.out() };
+    CountingStreamBuf countingOutput{ *output.rdbuf() };
+    std::streambuf* const originalOutput{ output.rdbuf(&countingOutput) };
+
+    auto releaseProcessing{ [&] {
+        const std::ios_base::iostate state{ output.rdstate() };
+        output.rdbuf(originalOutput);
+        output.setstate(state);
+
+        {
+            std::scoped_lock activityLock{ _activity->mutex };
+            _activity->sentSize += countingOutput.getCount();
+        }
+
+        std::chrono::microseconds cost{ std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start) };
+        if (const std::uint64_t asyncProductionRate{ _slots->getLimits().asyncProductionRate }; isAsynchronous && asyncProductionRate > 0)
+            cost = std::max(cost, std::chrono::microseconds{ countingOutput.getCount() * 1'000'000 / asyncProductionRate });
+
+        _slots->releaseProcessing(*_ticket, cost);
+    } };
+
+    try
+    {
+        _handler->processRequest(request, response);
+    }
+    catch (...)
+    {
+        releaseProcessing();
+        throw;
+    }
+    releaseProcessing();
+
+    if (_handler->isComplete())
+        _admission.reset();
+}
+
+bool AdmittedResourceHandler::isComplete() const
+{
+    std::scoped_lock lock{ _mutex };
+    return !_handler || _handler->isComplete();
+}
+
+void AdmittedResourceHandler::abort()
+{
+    std::scoped_lock lock{ _mutex };
+
+    _slots->cancelProcessing(_ticket);
+    if (_handler)
+        _handler->abort();
+    _admission.reset();
+}
+
+bool AdmittedResourceHandler::waitForData(DataReadyCallback onDataReady)
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (!_handler)
+        return false;
+
+    {
+        std::scoped_lock activityLock{ _activity->mutex };
+        _activity->waitStart = Clock::now();
+    }
+
+    // from now on, the client has to read our data
+    DataReadyCallback onReady{ [activity = _activity, onDataReady = std::move(onDataReady)] {
+        {
+            std::scoped_lock activityLock{ activity->mutex };
+            const Clock::time_point now{ Clock::now() };
+            activity->waitDuration += now - *activity->waitStart;
+            activity->waitStart.reset();
+            activity->lastProgress = now;
+        }
+        onDataReady();
+    } };
+
+    bool isWaiting;
+    if (_isDeferred)
+        isWaiting = _slots->waitForProcessing(_ticket, std::move(onReady));
+    else
+        isWaiting = _handler->isAsynchronous() && _handler->waitForData(std::move(onReady));
+
+    if (!isWaiting)
+    {
+        std::scoped_lock activityLock{ _activity->mutex };
+        _activity->waitStart.reset();
+    }
+
+    return isWaiting;
+}
+
+DownloadLimiter::DownloadLimiter(const DownloadLimits& limits)
+    : _slots{ std::make_shared<DownloadSlots>(limits) }
+{
+    FS_LOG(UTILS, INFO) << "Download limits: active = " << limits.maxActiveCount << ", active per client = " << limits.maxActivePerClientCount << ", processing threads = " << limits.maxProcessingCount << " (0 = unlimited), scheduling quantum = " << limits.schedulingQuantum.count() << " us, async production rate = " << limits.asyncProductionRate << " bytes/s";
+
+    if (limits.idleTimeout.count() > 0 || (limits.minRate > 0 && limits.minRatePeriod.count() > 0))
+    {
+        FS_LOG(UTILS, INFO) << "Evicting downloads idle for " << limits.idleTimeout.count() << " s or slower than " << limits.minRate << " bytes/s over " << limits.minRatePeriod.count() << " s (0 = disabled)";
+        _sweepThread = std::thread{ [this] { sweep(); } };
+    }
+}
+
+DownloadLimiter::~DownloadLimiter()
+{
+    if (!_sweepThread.joinable())
+        return;
+
+    {
+        std::scoped_lock lock{ _sweepMutex };
+        _isStopping = true;
+    }
+    _sweepCondition.notify_one();
+    _sweepThread.join();
+}
+
+void DownloadLimiter::sweep()
+{
+    const DownloadLimits& limits{ _slots->getLimits() };
+
+    std::chrono::seconds period{ limits.idleTimeout.count() > 0 ? limits.idleTimeout : limits.minRatePeriod };
+    if (limits.minRate > 0 && limits.minRatePeriod.count() > 0)
+        period = std::min(period, limits.minRatePeriod);
+    period = std::max(period / 2, std::chrono::seconds{ 1 });
+
+    std::unique_lock lock{ _sweepMutex };
+    while (!_isStopping)
+    {
+        _sweepCondition.wait_for(lock, period);
+        if (_isStopping)
+            break;
+
+        lock.unlock();
+        _slots->evictStalledDownloads();
+        lock.lock();
+    }
+}
+
+std::unique_ptr<DownloadAdmission> DownloadLimiter::admit(std::string_view clientAddress)
+{
+    return _slots->admit(clientAddress);
+}
+
+std::unique_ptr<IResourceHandler> DownloadLimiter::createResourceHandler(std::unique_ptr<DownloadAdmission> admission, std::string_view flow, std::unique_ptr<IResourceHandler> handler)
+{
+    return std::make_unique<AdmittedResourceHandler>(_slots, std::move(admission), flow, std::move(handler));
+}
+
+std::size_t DownloadLimiter::getActiveCount() const
+{
+    return _slots->getActiveCount();
+}
+
+std::uint64_t DownloadLimiter::getAdmittedCount() const
+{
+    return _slots->getAdmittedCount();
+}
+
+std::uint64_t DownloadLimiter::getRejectedCount() const
+{
+    return _slots->getRejectedCount();
+}
+
+std::uint64_t DownloadLimiter::getClientRejectedCount() const
+{
+    return _slots->getClientRejectedCount();
+}
+
+std::uint64_t DownloadLimiter::getDeferredCount() const
+{
+    return _slots->getDeferredCount();
+}
+
+std::uint64_t DownloadLimiter::getIdleEvictedCount() const
+{
+    return _slots->getIdleEvictedCount();
+}
+
+std::uint64_t DownloadLimiter::getSlowEvictedCount() const
+{
+    return _slots->getSlowEvictedCount();
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "utils/IDownloadLimiter.hpp"
+
+class AdmittedResourceHandler;
+
+// Shared with the admissions and the handlers, that may outlive the limiter
+class DownloadSlots : public std::enable_shared_from_this<DownloadSlots>
+{
+public:
+    DownloadSlots(const DownloadLimits& limits);
+
+    std::unique_ptr<DownloadAdmission> admit(std::string_view clientAddress);
+    void release(const std::string& clientAddress);
+
+    struct Flow;
+
+    // Processing slots are handed over to the waiting handlers, flow by flow
+    struct ProcessingTicket
+    {
+        Flow* flow{};
+        bool isQueued{};
+        bool hasSlot{};                     // handed over, not used yet
+        std::chrono::microseconds charged{}; // estimated cost, charged to the flow when handed over
+        IResourceHandler::DataReadyCallback onSlot;
+    };
+
+    struct Flow
+    {
+        std::string key;
+        std::size_t handlerCount{};
+        std::deque<std::shared_ptr<ProcessingTicket>> queue;
+        std::chrono::microseconds deficit{};
+        std::chrono::microseconds lastCost{};
+        bool isScheduled{}; // in the new or old flows
+    };
+
+    // A flow lives as long as its handlers
+    Flow* openFlow(std::string_view key);
+    void closeFlow(Flow* flow);
+
+    // Returns true if the ticket may produce some data, releaseProcessing must then be called
+    bool acquireProcessing(ProcessingTicket& ticket);
+    void releaseProcessing(ProcessingTicket& ticket, std::chrono::microseconds cost);
+    // Returns false if a slot has been handed over, otherwise onSlot will be called once (from any thread)
+    bool waitForProcessing(const std::shared_ptr<ProcessingTicket>& ticket, IResourceHandler::DataReadyCallback onSlot);
+    // Leaves the queue, or gives back the slot handed over
+    void cancelProcessing(const std::shared_ptr<ProcessingTicket>& ticket);
+
+    // Downloads checked by the sweeper
+    void registerDownload(AdmittedResourceHandler& handler);
+    void unregisterDownload(AdmittedResourceHandler& handler);
+    void evictStalledDownloads();
+
+    std::size_t getActiveCount() const;
+    std::uint64_t getAdmittedCount() const;
+    std::uint64_t getRejectedCount() const;
+    std::uint64_t getClientRejectedCount() const;
+    std::uint64_t getDeferredCount() const;
+    std::uint64_t getIdleEvictedCount() const;
+    std::uint64_t getSlowEvictedCount() const;
+
+    const DownloadLimits& getLimits() const { return _limits; }
+
+private:
+    bool canProcess() const;                                   // must be called with _mutex held
+    IResourceHandler::DataReadyCallback handOverProcessing(); // must be called with _mutex held
+    void unscheduleFlow(Flow* flow);                          // must be called with _mutex held
+
+    const DownloadLimits _limits;
+
+    mutable std::mutex _mutex;
+    std::size_t _activeCount{};
+    std::unordered_map<std::string, std::size_t> _activeCountByClient;
+    std::size_t _processingCount{};
+    std::size_t _waitingCount{};
+
+    // Deficit round robin: flows that just started to wait are served first, so that small downloads are not stuck behind the large ones
+    std::unordered_map<std::string, Flow> _flows;
+    std::deque<Flow*> _newFlows;
+    std::deque<Flow*> _oldFlows;
+
+    std::uint64_t _admittedCount{};
+    std::uint64_t _rejectedCount{};
+    std::uint64_t _clientRejectedCount{};
+    std::uint64_t _deferredCount{};
+
+    std::mutex _downloadsMutex; // locked before the handlers
+    std::unordered_set<AdmittedResourceHandler*> _downloads;
+    std::atomic<std::uint64_t> _idleEvictedCount{};
+    std::atomic<std::uint64_t> _slowEvictedCount{};
+};
+
+class ClientDownloadAdmission final : public DownloadAdmission
+{
+public:
+    ClientDownloadAdmission(std::shared_ptr<DownloadSlots> slots, std::string_view clientAddress);
+    ~ClientDownloadAdmission() override;
+    ClientDownloadAdmission(const ClientDownloadAdmission&) = delete;
+    ClientDownloadAdmission& operator=(const ClientDownloadAdmission&) = delete;
+
+private:
+    std::shared_ptr<DownloadSlots> _slots;
+    const std::string _clientAddress;
+};
+
+// Only produces data when a processing slot is available, waiting for one otherwise
+class AdmittedResourceHandler final : public IResourceHandler
+{
+public:
+    AdmittedResourceHandler(std::shared_ptr<DownloadSlots> slots, std::unique_ptr<DownloadAdmission> admission, std::string_view flow, std::unique_ptr<IResourceHandler> handler);
+    ~AdmittedResourceHandler() override;
+    AdmittedResourceHandler(const AdmittedResourceHandler&) = delete;
+    AdmittedResourceHandler& operator=(const AdmittedResourceHandler&) = delete;
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Stall
+    {
+        None,
+        Idle,
+        Slow,
+    };
+    // Resources of the evicted downloads, to be aborted and destroyed without any lock held
+    struct EvictedResource
+    {
+        std::unique_ptr<IResourceHandler> handler;
+        std::unique_ptr<DownloadAdmission> admission;
+    };
+    using EvictedResources = std::vector<EvictedResource>;
+
+    // Called by the sweeper
+    Stall evictIfStalled(Clock::time_point now, EvictedResources& evictedResources);
+
+private:
+    void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+    bool isComplete() const override;
+    void abort() override;
+    bool isAsynchronous() const override { return true; }
+    bool waitForData(DataReadyCallback onDataReady) override;
+
+    // Also updated by the data ready callbacks
+    struct Activity
+    {
+        std::mutex mutex;
+        Clock::time_point lastProgress; // client read some data, or our data became ready
+        std::optional<Clock::time_point> waitStart; // set while waiting for our own data
+        Clock::duration waitDuration{};
+        std::uint64_t sentSize{};
+    };
+
+    std::shared_ptr<DownloadSlots> _slots;
+
+    mutable std::mutex _mutex; // also locked by the sweeper
+    std::unique_ptr<DownloadAdmission> _admission; // reset once complete
+    std::unique_ptr<IResourceHandler> _handler;    // reset once evicted
+    const std::shared_ptr<DownloadSlots::ProcessingTicket> _ticket;
+    bool _isDeferred{};
+
+    const std::shared_ptr<Activity> _activity;
+    // start of the current throughput measurement, only used by the sweeper
+    Clock::time_point _rateCheckTime;
+    Clock::duration _rateCheckWaitDuration{};
+    std::uint64_t _rateCheckSentSize{};
+};
+
+class DownloadLimiter : public IDownloadLimiter
+{
+public:
+    DownloadLimiter(const DownloadLimits& limits);
+    ~DownloadLimiter() override;
+    DownloadLimiter(const DownloadLimiter&) = delete;
+    DownloadLimiter& operator=(const DownloadLimiter&) = delete;
+
+private:
+    std::unique_ptr<DownloadAdmission> admit(std::string_view clientAddress) override;
+    std::unique_ptr<IResourceHandler> createResourceHandler(std::unique_ptr<DownloadAdmission> admission, std::string_view flow, std::unique_ptr<IResourceHandler> handler) override;
+    std::size_t getActiveCount() const override;
+    std::uint64_t getAdmittedCount() const override;
+    std::uint64_t getRejectedCount() const override;
+    std::uint64_t getClientRejectedCount() const override;
+    std::uint64_t getDeferredCount() const override;
+    std::uint64_t getIdleEvictedCount() const override;
+    std::uint64_t getSlowEvictedCount() const override;
+
+    void sweep();
+
+    std::shared_ptr<DownloadSlots> _slots;
+
+    std::mutex _sweepMutex;
+    std::condition_variable _sweepCondition;
+    bool _isStopping{};
+    std::thread _sweepThread; // only if eviction is enabled
+};
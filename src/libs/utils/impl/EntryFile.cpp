@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EntryFile.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ZipFileException.hpp"
+
+namespace Zip
+{
+    EntryFile::~EntryFile()
+    {
+        close();
+    }
+
+    void EntryFile::open(const Entry& entry)
+    {
+        close();
+
+        _path = entry.filePath;
+        _fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0)
+            throw FileException{ _path, "cannot open file", errno };
+
+        struct ::stat fileStat;
+        if (::fstat(_fd, &fileStat) != 0)
+            throw FileException{ _path, "stat failed", errno };
+
+        if (!S_ISREG(fileStat.st_mode))
+            throw FileException{ _path, "not a regular file" };
+
+        if (static_cast<std::uint64_t>(fileStat.st_size) != entry.size)
+            throw FileException{ _path, "size changed: expected " + std::to_string(entry.size) + " bytes, got " + std::to_string(fileStat.st_size) };
+
+        _mode = fileStat.st_mode & 07777;
+        _reader.reset(_fd);
+        _dropBehind.reset(_fd, entry.size);
+        PageCache::probe(_fd, entry.size);
+    }
+
+    void EntryFile::close()
+    {
+        if (_fd < 0)
+            return;
+
+        _dropBehind.flush();
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    void EntryFile::read(std::uint64_t offset, std::byte* buffer, std::size_t size)
+    {
+        const std::uint64_t readOffset{ offset };
+        const std::size_t readSize{ size };
+
+        while (size > 0)
+        {
+            const ::ssize_t res{ _reader.read(offset, buffer, size) };
+            if (res < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                throw FileException{ _path, "read failed", errno };
+            }
+            if (res == 0)
+                throw FileException{ _path, "unexpected end of file (size changed?)" };
+
+            buffer += res;
+            offset += res;
+            size -= res;
+        }
+
+        _dropBehind.onRead(readOffset, readSize);
+    }
+} // namespace Zip
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "utils/IZipper.hpp"
+#include "PageCacheDropBehind.hpp"
+#include "SparseFileReader.hpp"
+
+namespace Zip
+{
+    // File of an entry, checked once against the entry size when opened
+    // Holes of sparse files are not read from disk
+    class EntryFile
+    {
+    public:
+        EntryFile() = default;
+        ~EntryFile();
+        EntryFile(const EntryFile&) = delete;
+        EntryFile& operator=(const EntryFile&) = delete;
+
+        void open(const Entry& entry);
+        void close();
+        bool isOpen() const { return _fd >= 0; }
+        std::uint32_t getMode() const { return _mode; } // permission bits
+
+        // Reads exactly size bytes at offset
+        void read(std::uint64_t offset, std::byte* buffer, std::size_t size);
+
+    private:
+        std::filesystem::path _path;
+        int _fd{ -1 };
+        std::uint32_t _mode{};
+        SparseFile::Reader _reader;
+        PageCache::DropBehind _dropBehind;
+    };
+} // namespace Zip
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FileCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/Logger.hpp"
+
+std::unique_ptr<IFileCache> createFileCache(std::size_t maxSize, std::size_t maxFileSize)
+{
+    return std::make_unique<FileCache>(maxSize, maxFileSize);
+}
+
+FileCache::FileCache(std::size_t maxSize, std::size_t maxFileSize)
+    : _maxSize{ maxSize }
+    , _maxFileSize{ std::min(maxFileSize, maxSize) }
+{
+    FS_LOG(UTILS, INFO) << "File cache size = " << _maxSize << " bytes, max file size = " << _maxFileSize << " bytes";
+}
+
+IFileCache::Content FileCache::getContent(const std::string& key, const std::filesystem::path& path, std::uint64_t fileSize)
+{
+    if (fileSize > _maxFileSize)
+        return nullptr;
+
+    {
+        std::scoped_lock lock{ _mutex };
+
+        if (auto itEntry{ _entries.find(key) }; itEntry != std::cend(_entries))
+        {
+            _lru.splice(std::begin(_lru), _lru, itEntry->second.lruIt);
+            _hitCount++;
+            _savedReadBytes += itEntry->second.content->size();
+            return itEntry->second.content;
+        }
+    }
+
+    _missCount++;
+
+    // concurrent misses on the same file may load it several times, only one is kept
+    Content content{ load(path, fileSize) };
+    if (!content)
+        return nullptr;
+
+    std::scoped_lock lock{ _mutex };
+
+    if (_entries.find(key) == std::cend(_entries))
+    {
+        _lru.push_front(key);
+        _entries.emplace(key, Entry{ content, std::begin(_lru) });
+        _usedSize += content->size();
+
+        evict();
+    }
+
+    return content;
+}
+
+std::size_t FileCache::getUsedSize() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _usedSize;
+}
+
+IFileCache::Content FileCache::load(const std::filesystem::path& path, std::uint64_t fileSize)
+{
+    const int fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0)
+    {
+        FS_LOG(UTILS, ERROR) << "Cannot open file '" << path.string() << "': " << ::strerror(errno);
+        return nullptr;
+    }
+
+    auto content{ std::make_shared<std::vector<std::byte>>(fileSize) };
+
+    std::size_t offset{};
+    struct ::stat fileStat;
+    bool isValid{ ::fstat(fd, &fileStat) == 0 && static_cast<std::uint64_t>(fileStat.st_size) == fileSize };
+    while (isValid && offset < content->size())
+    {
+        const ::ssize_t res{ ::pread(fd, content->data() + offset, content->size() - offset, static_cast<::off_t>(offset)) };
+        if (res < 0 && errno == EINTR)
+            continue;
+
+        isValid = res > 0;
+        if (isValid)
+            offset += static_cast<std::size_t>(res);
+    }
+    ::close(fd);
+
+    if (!isValid)
+    {
+        FS_LOG(UTILS, ERROR) << "Cannot read file '" << path.string() << "' (" << fileSize << " bytes expected)";
+        return nullptr;
+    }
+
+    return content;
+}
+
+void FileCache::evict()
+{
+    while (_usedSize > _maxSize && !_lru.empty())
+    {
+        auto itEntry{ _entries.find(_lru.back()) };
+
+        FS_LOG(UTILS, DEBUG) << "Evicting file '" << itEntry->first << "' from cache";
+
+        _usedSize -= itEntry->second.content->size();
+        _entries.erase(itEntry);
+        _lru.pop_back();
+    }
+}
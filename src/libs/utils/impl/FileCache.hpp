@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "utils/IFileCache.hpp"
+
+class FileCache final : public IFileCache
+{
+public:
+    FileCache(std::size_t maxSize, std::size_t maxFileSize);
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+private:
+    Content getContent(const std::string& key, const std::filesystem::path& path, std::uint64_t fileSize) override;
+
+    std::uint64_t getHitCount() const override { return _hitCount; }
+    std::uint64_t getMissCount() const override { return _missCount; }
+    std::uint64_t getSavedReadBytes() const override { return _savedReadBytes; }
+    std::size_t getUsedSize() const override;
+
+    using Key = std::string;
+
+    struct Entry
+    {
+        Content content;
+        std::list<Key>::iterator lruIt;
+    };
+
+    static Content load(const std::filesystem::path& path, std::uint64_t fileSize);
+    void evict(); // must be called with _mutex held
+
+    const std::size_t _maxSize;
+    const std::size_t _maxFileSize;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, Entry> _entries;
+    std::list<Key> _lru; // most recently used first
+    std::size_t _usedSize{};
+
+    std::atomic<std::uint64_t> _hitCount{};
+    std::atomic<std::uint64_t> _missCount{};
+    std::atomic<std::uint64_t> _savedReadBytes{};
+};
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FileContentResourceHandler.hpp"
+
+#include "utils/FileResourceHandlerCreator.hpp"
+#include "FileResourceHandler.hpp"
+
+std::unique_ptr<IResourceHandler> createFileResourceHandler(IFileCache::Content content)
+{
+    return std::make_unique<FileContentResourceHandler>(std::move(content));
+}
+
+FileContentResourceHandler::FileContentResourceHandler(IFileCache::Content content)
+    : _content{ std::move(content) }
+{
+}
+
+void FileContentResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    // small enough to be written at once
+    if (const std::optional<FileRange> range{ setupFileRange(_content->size(), request, response) })
+        response.out().write(reinterpret_cast<const char*>(_content->data() + range->firstByte), range->beyondLastByte - range->firstByte);
+
+    _content.reset();
+}
+
+bool FileContentResourceHandler::isComplete() const
+{
+    return !_content;
+}
+
+void FileContentResourceHandler::abort()
+{
+    _content.reset();
+}
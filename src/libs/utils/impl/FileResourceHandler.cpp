@@ -19,8 +19,12 @@
 
 #include "FileResourceHandler.hpp"
 
+#include <cerrno>
 #include <cstring>
-#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "utils/Logger.hpp"
 
@@ -34,99 +38,86 @@ FileResourceHandler::FileResourceHandler(const std::filesystem::path& path)
 {
 }
 
+FileResourceHandler::~FileResourceHandler()
+{
+    closeFile();
+}
+
 void FileResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
 {
     ::uint64_t startByte{ _offset };
-    std::ifstream ifs{ _path.string().c_str(), std::ios::in | std::ios::binary };
-    if (!ifs)
+    if (!_file)
     {
-        const int err{ errno };
-        FS_LOG(UTILS, ERROR) << "Cannot open input file '" << _path.string() << "': " << std::string{ ::strerror(err) };
-        _isFinished = true;
+        // shared with the concurrent downloads of the same file
+        std::error_code ec;
+        _file = openFile(_path, ec);
+        if (!_file)
+        {
+            FS_LOG(UTILS, ERROR) << "Cannot open input file '" << _path.string() << "': " << ec.message();
+            _isFinished = true;
 
-        if (startByte == 0)
-            response.setStatus(404);
+            if (startByte == 0)
+                response.setStatus(404);
 
-        return;
+            return;
+        }
+        _reader.reset(_file->getFd());
     }
 
     if (startByte == 0)
     {
-        response.setStatus(200);
-
-        ifs.seekg(0, std::ios::end);
-        const ::uint64_t fileSize{ static_cast<::uint64_t>(ifs.tellg()) };
-        ifs.seekg(0, std::ios::beg);
-
-        FS_LOG(UTILS, DEBUG) << "File '" << _path.string() << "', fileSize = " << fileSize;
-
-        const Wt::Http::Request::ByteRangeSpecifier ranges{ request.getRanges(fileSize) };
-        if (!ranges.isSatisfiable())
+        const std::optional<FileRange> range{ setupFileRange(_path, _file->getFd(), request, response) };
+        if (!range)
         {
-            std::ostringstream contentRange;
-            contentRange << "bytes */" << fileSize;
-            response.setStatus(416); // Requested range not satisfiable
-            response.addHeader("Content-Range", contentRange.str());
-
-            FS_LOG(UTILS, DEBUG) << "Range not satisfiable";
             _isFinished = true;
             return;
         }
 
-        if (ranges.size() == 1)
-        {
-            FS_LOG(UTILS, DEBUG) << "Range requested = " << ranges[0].firstByte() << "/" << ranges[0].lastByte();
+        startByte = range->firstByte;
+        _beyondLastByte = range->beyondLastByte;
 
-            response.setStatus(206);
-            startByte = ranges[0].firstByte();
-            _beyondLastByte = ranges[0].lastByte() + 1;
-
-            std::ostringstream contentRange;
-            contentRange << "bytes " << startByte << "-"
-                         << _beyondLastByte - 1 << "/" << fileSize;
-
-            response.addHeader("Content-Range", contentRange.str());
-            response.setContentLength(_beyondLastByte - startByte);
-        }
-        else
-        {
-            FS_LOG(UTILS, DEBUG) << "No range requested";
-
-            _beyondLastByte = fileSize;
-            response.setContentLength(_beyondLastByte);
-        }
+        _dropBehind.reset(_file->getFd(), range->fileSize);
+        PageCache::probe(_file->getFd(), range->fileSize);
     }
 
-    if (!ifs.seekg(static_cast<std::istream::pos_type>(startByte)))
+    std::vector<std::byte> buf;
+    buf.resize(_chunkSize);
+
+    ::uint64_t restSize = _beyondLastByte - startByte;
+    ::uint64_t pieceSize = buf.size() > restSize ? restSize : buf.size();
+    if (pieceSize == 0)
     {
-        const int err{ errno };
-        FS_LOG(UTILS, ERROR) << "Failed to seek in file '" << _path.string() << "' at " << startByte << ": " << std::string{ ::strerror(err) };
         _isFinished = true;
         return;
     }
 
-    std::vector<char> buf;
-    buf.resize(_chunkSize);
-
-    ::uint64_t restSize = _beyondLastByte - startByte;
-    ::uint64_t pieceSize = buf.size() > restSize ? restSize : buf.size();
+    // holes of sparse files are not read from disk
+    ::ssize_t res;
+    do
+    {
+        res = _reader.read(startByte, buf.data(), pieceSize);
+    } while (res < 0 && errno == EINTR);
 
-    if (!ifs.read(&buf[0], pieceSize))
+    if (res <= 0)
     {
         const int err{ errno };
-        FS_LOG(UTILS, ERROR) << "Read failed in file '" << _path.string() << "': " << std::string{ ::strerror(err) };
+        FS_LOG(UTILS, ERROR) << "Read failed in file '" << _path.string() << "': " << (res < 0 ? std::string{ ::strerror(err) } : std::string{ "unexpected end of file" });
         _isFinished = true;
         return;
     }
-    const ::uint64_t actualPieceSize{ static_cast<::uint64_t>(ifs.gcount()) };
-    response.out().write(&buf[0], actualPieceSize);
+    const ::uint64_t actualPieceSize{ static_cast<::uint64_t>(res) };
+    response.out().write(reinterpret_cast<const char*>(buf.data()), actualPieceSize);
+    _dropBehind.onRead(startByte, actualPieceSize);
 
-    if (ifs.good() && actualPieceSize < restSize)
+    if (actualPieceSize < restSize)
     {
         _offset = startByte + actualPieceSize;
         return;
     }
 
+    if (_reader.getSkippedReadBytes() > 0)
+        FS_LOG(UTILS, DEBUG) << "File '" << _path.string() << "': skipped reading " << _reader.getSkippedReadBytes() << " bytes of holes";
+
     _isFinished = true;
 }
 
@@ -137,5 +128,71 @@ bool FileResourceHandler::isComplete() const
 
 void FileResourceHandler::abort()
 {
+    closeFile();
     _isFinished = true;
 }
+
+void FileResourceHandler::closeFile()
+{
+    if (!_file)
+        return;
+
+    _dropBehind.flush();
+    _file.reset();
+}
+
+std::optional<FileRange> setupFileRange(const std::filesystem::path& path, int fd, const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    struct ::stat fileStat;
+    if (::fstat(fd, &fileStat) != 0)
+    {
+        const int err{ errno };
+        FS_LOG(UTILS, ERROR) << "Cannot stat input file '" << path.string() << "': " << std::string{ ::strerror(err) };
+        response.setStatus(500);
+        return std::nullopt;
+    }
+    const ::uint64_t fileSize{ static_cast<::uint64_t>(fileStat.st_size) };
+
+    FS_LOG(UTILS, DEBUG) << "File '" << path.string() << "', fileSize = " << fileSize;
+
+    return setupFileRange(fileSize, request, response);
+}
+
+std::optional<FileRange> setupFileRange(std::uint64_t fileSize, const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    const Wt::Http::Request::ByteRangeSpecifier ranges{ request.getRanges(fileSize) };
+    if (!ranges.isSatisfiable())
+    {
+        std::ostringstream contentRange;
+        contentRange << "bytes */" << fileSize;
+        response.setStatus(416); // Requested range not satisfiable
+        response.addHeader("Content-Range", contentRange.str());
+
+        FS_LOG(UTILS, DEBUG) << "Range not satisfiable";
+        return std::nullopt;
+    }
+
+    if (ranges.size() == 1)
+    {
+        FS_LOG(UTILS, DEBUG) << "Range requested = " << ranges[0].firstByte() << "/" << ranges[0].lastByte();
+
+        const FileRange range{ ranges[0].firstByte(), ranges[0].lastByte() + 1, fileSize };
+
+        std::ostringstream contentRange;
+        contentRange << "bytes " << range.firstByte << "-"
+                     << range.beyondLastByte - 1 << "/" << fileSize;
+
+        response.setStatus(206);
+        response.addHeader("Content-Range", contentRange.str());
+        response.setContentLength(range.beyondLastByte - range.firstByte);
+
+        return range;
+    }
+
+    FS_LOG(UTILS, DEBUG) << "No range requested";
+
+    response.setStatus(200);
+    response.setContentLength(fileSize);
+
+    return FileRange{ 0, fileSize, fileSize };
+}
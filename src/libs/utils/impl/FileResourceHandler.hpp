@@ -20,21 +20,48 @@
 #pragma once
 
 #include "utils/IResourceHandler.hpp"
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <optional>
+
+#include "utils/IOpenFileCache.hpp"
+#include "PageCacheDropBehind.hpp"
+#include "SparseFileReader.hpp"
+
+struct FileRange
+{
+    std::uint64_t firstByte{};
+    std::uint64_t beyondLastByte{};
+    std::uint64_t fileSize{};
+};
+
+// Sets up the response status and headers for the whole file or the requested range
+// Returns std::nullopt if the response is complete (error or range not satisfiable)
+std::optional<FileRange> setupFileRange(const std::filesystem::path& path, int fd, const Wt::Http::Request& request, Wt::Http::Response& response);
+std::optional<FileRange> setupFileRange(std::uint64_t fileSize, const Wt::Http::Request& request, Wt::Http::Response& response);
 
 class FileResourceHandler final : public IResourceHandler
 {
 public:
     FileResourceHandler(const std::filesystem::path& filePath);
+    ~FileResourceHandler() override;
+    FileResourceHandler(const FileResourceHandler&) = delete;
+    FileResourceHandler& operator=(const FileResourceHandler&) = delete;
 
 private:
     void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
     bool isComplete() const override;
     void abort() override;
 
+    void closeFile();
+
     static constexpr std::size_t _chunkSize{ 65536 };
 
     std::filesystem::path _path;
+    std::shared_ptr<const OpenedFile> _file; // kept opened: the file may be removed during the download
+    SparseFile::Reader _reader;
+    PageCache::DropBehind _dropBehind;
     ::uint64_t _beyondLastByte{};
     ::uint64_t _offset{};
     bool _isFinished{};
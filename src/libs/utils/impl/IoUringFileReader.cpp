@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/IAsyncFileReader.hpp"
+
+#include "utils/Logger.hpp"
+
+#ifdef FILESHELTER_HAS_IO_URING
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/uio.h>
+
+#include "utils/Exception.hpp"
+
+#include "IoUringFileReader.hpp"
+#endif
+
+std::unique_ptr<IAsyncFileReader> createIoUringFileReader(std::size_t bufferCount, std::size_t bufferSize)
+{
+#ifdef FILESHELTER_HAS_IO_URING
+    try
+    {
+        return std::make_unique<IoUringFileReader>(bufferCount, bufferSize);
+    }
+    catch (const FsException& e)
+    {
+        FS_LOG(UTILS, WARNING) << "Cannot use io_uring, using synchronous file reads: " << e.what();
+        return nullptr;
+    }
+#else
+    FS_LOG(UTILS, INFO) << "Built without io_uring support, using synchronous file reads";
+    return nullptr;
+#endif
+}
+
+#ifdef FILESHELTER_HAS_IO_URING
+IoUringFileReader::IoUringFileReader(std::size_t bufferCount, std::size_t bufferSize)
+    : _bufferSize{ bufferSize }
+    , _buffers(bufferCount * bufferSize)
+{
+    // each buffer has at most one read in flight, plus the stop request
+    if (const int res{ ::io_uring_queue_init(static_cast<unsigned>(bufferCount + 1), &_ring, 0) }; res < 0)
+        throw FsException{ "io_uring_queue_init failed: " + std::string{ ::strerror(-res) } };
+
+    std::vector<::iovec> iovecs(bufferCount);
+    for (std::size_t i{}; i < bufferCount; ++i)
+    {
+        iovecs[i].iov_base = _buffers.data() + i * _bufferSize;
+        iovecs[i].iov_len = _bufferSize;
+    }
+
+    if (const int res{ ::io_uring_register_buffers(&_ring, iovecs.data(), static_cast<unsigned>(iovecs.size())) }; res < 0)
+    {
+        ::io_uring_queue_exit(&_ring);
+        throw FsException{ "io_uring_register_buffers failed: " + std::string{ ::strerror(-res) } };
+    }
+
+    _freeBufferIndexes.reserve(bufferCount);
+    for (std::size_t i{ bufferCount }; i > 0; --i)
+        _freeBufferIndexes.push_back(static_cast<unsigned>(i - 1));
+
+    _completionThread = std::thread{ [this] { processCompletions(); } };
+
+    FS_LOG(UTILS, INFO) << "Using io_uring for file reads, " << bufferCount << " buffers of " << _bufferSize << " bytes";
+}
+
+IoUringFileReader::~IoUringFileReader()
+{
+    {
+        std::scoped_lock lock{ _mutex };
+
+        // the completion thread exits once the reads in flight are done
+        ::io_uring_sqe* sqe{ ::io_uring_get_sqe(&_ring) };
+        assert(sqe);
+        ::io_uring_prep_nop(sqe);
+        ::io_uring_sqe_set_data(sqe, nullptr);
+        ::io_uring_submit(&_ring);
+    }
+
+    _completionThread.join();
+    ::io_uring_queue_exit(&_ring);
+}
+
+std::optional<IAsyncFileReader::Buffer> IoUringFileReader::acquireBuffer()
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (_freeBufferIndexes.empty())
+        return std::nullopt;
+
+    const unsigned index{ _freeBufferIndexes.back() };
+    _freeBufferIndexes.pop_back();
+
+    return Buffer{ _buffers.data() + index * _bufferSize, _bufferSize, index };
+}
+
+void IoUringFileReader::releaseBuffer(const Buffer& buffer)
+{
+    std::scoped_lock lock{ _mutex };
+    _freeBufferIndexes.push_back(buffer.index);
+}
+
+void IoUringFileReader::read(int fd, std::uint64_t offset, const Buffer& buffer, std::size_t size, CompletionHandler onComplete)
+{
+    assert(size <= buffer.size);
+    auto completionHandler{ std::make_unique<CompletionHandler>(std::move(onComplete)) };
+
+    std::scoped_lock lock{ _mutex };
+
+    ::io_uring_sqe* sqe{ ::io_uring_get_sqe(&_ring) };
+    if (!sqe)
+        throw FsException{ "io_uring submission queue is full" };
+
+    ::io_uring_prep_read_fixed(sqe, fd, buffer.data, static_cast<unsigned>(size), offset, static_cast<int>(buffer.index));
+    ::io_uring_sqe_set_data(sqe, completionHandler.release());
+    _pendingReadCount++;
+
+    // on failure, the request stays queued and will be submitted along with the next one
+    if (const int res{ ::io_uring_submit(&_ring) }; res < 0)
+        FS_LOG(UTILS, ERROR) << "io_uring_submit failed: " << ::strerror(-res);
+}
+
+void IoUringFileReader::processCompletions()
+{
+    bool isStopRequested{};
+    while (!isStopRequested || _pendingReadCount > 0)
+    {
+        ::io_uring_cqe* cqe{};
+        if (const int res{ ::io_uring_wait_cqe(&_ring, &cqe) }; res < 0)
+        {
+            if (res == -EINTR)
+                continue;
+
+            FS_LOG(UTILS, ERROR) << "io_uring_wait_cqe failed: " << ::strerror(-res);
+            break;
+        }
+
+        std::unique_ptr<CompletionHandler> onComplete{ static_cast<CompletionHandler*>(::io_uring_cqe_get_data(cqe)) };
+        const int result{ cqe->res };
+        ::io_uring_cqe_seen(&_ring, cqe);
+
+        if (!onComplete)
+        {
+            isStopRequested = true;
+            continue;
+        }
+
+        _pendingReadCount--;
+        (*onComplete)(result);
+    }
+}
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <liburing.h>
+
+#include "utils/IAsyncFileReader.hpp"
+
+// A single ring shared by all the downloads, completions are processed by a dedicated thread
+class IoUringFileReader final : public IAsyncFileReader
+{
+public:
+    IoUringFileReader(std::size_t bufferCount, std::size_t bufferSize);
+    ~IoUringFileReader() override;
+    IoUringFileReader(const IoUringFileReader&) = delete;
+    IoUringFileReader& operator=(const IoUringFileReader&) = delete;
+
+private:
+    std::optional<Buffer> acquireBuffer() override;
+    void releaseBuffer(const Buffer& buffer) override;
+    void read(int fd, std::uint64_t offset, const Buffer& buffer, std::size_t size, CompletionHandler onComplete) override;
+
+    void processCompletions();
+
+    const std::size_t _bufferSize;
+    std::vector<std::byte> _buffers;
+
+    std::mutex _mutex;
+    ::io_uring _ring; // submissions guarded by _mutex
+    std::vector<unsigned> _freeBufferIndexes;
+    std::atomic<std::size_t> _pendingReadCount{};
+    std::thread _completionThread;
+};
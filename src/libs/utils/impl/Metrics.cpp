@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+
+#include "utils/Exception.hpp"
+
+std::unique_ptr<IMetrics> createMetrics()
+{
+    return std::make_unique<Metrics>();
+}
+
+void Metrics::addGauge(const std::string& name, const std::string& help, ValueGetter getter)
+{
+    add(Metric{ name, help, "gauge", std::move(getter) });
+}
+
+void Metrics::addCounter(const std::string& name, const std::string& help, ValueGetter getter)
+{
+    add(Metric{ name, help, "counter", std::move(getter) });
+}
+
+void Metrics::write(std::ostream& output) const
+{
+    std::scoped_lock lock{ _mutex };
+
+    for (const Metric& metric : _metrics)
+    {
+        output << "# HELP " << metric.name << " " << metric.help << "\n";
+        output << "# TYPE " << metric.name << " " << metric.type << "\n";
+        output << metric.name << " " << metric.getter() << "\n";
+    }
+}
+
+void Metrics::add(Metric metric)
+{
+    std::scoped_lock lock{ _mutex };
+
+    if (std::any_of(std::cbegin(_metrics), std::cend(_metrics), [&](const Metric& m) { return m.name == metric.name; }))
+        throw FsException{ "Metric '" + metric.name + "' already registered" };
+
+    _metrics.push_back(std::move(metric));
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "utils/IMetrics.hpp"
+
+class Metrics : public IMetrics
+{
+public:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+private:
+    void addGauge(const std::string& name, const std::string& help, ValueGetter getter) override;
+    void addCounter(const std::string& name, const std::string& help, ValueGetter getter) override;
+    void write(std::ostream& output) const override;
+
+    struct Metric
+    {
+        std::string name;
+        std::string help;
+        std::string_view type;
+        ValueGetter getter;
+    };
+
+    void add(Metric metric);
+
+    mutable std::mutex _mutex;
+    std::vector<Metric> _metrics;
+};
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OpenFileCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/Logger.hpp"
+#include "utils/Service.hpp"
+
+namespace
+{
+    std::shared_ptr<const OpenedFile> openFileDescriptor(const std::filesystem::path& path, std::error_code& ec)
+    {
+        const int fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (fd < 0)
+        {
+            ec = std::error_code{ errno, std::generic_category() };
+            return nullptr;
+        }
+
+        return std::make_shared<const OpenedFile>(fd);
+    }
+} // namespace
+
+OpenedFile::~OpenedFile()
+{
+    ::close(_fd);
+}
+
+std::unique_ptr<IOpenFileCache> createOpenFileCache(std::size_t maxCount, std::chrono::seconds idleTimeout)
+{
+    return std::make_unique<OpenFileCache>(maxCount, idleTimeout);
+}
+
+std::shared_ptr<const OpenedFile> openFile(const std::filesystem::path& path, std::error_code& ec)
+{
+    if (Service<IOpenFileCache>::exists())
+        return Service<IOpenFileCache>::get()->open(path, ec);
+
+    return openFileDescriptor(path, ec);
+}
+
+OpenFileCache::OpenFileCache(std::size_t maxCount, std::chrono::seconds idleTimeout)
+    : _maxCount{ maxCount }
+    , _idleTimeout{ std::max(idleTimeout, std::chrono::seconds{ 1 }) }
+    , _sweepThread{ [this] { sweep(); } }
+{
+    FS_LOG(UTILS, INFO) << "Open file cache max count = " << _maxCount << ", idle timeout = " << _idleTimeout.count() << "s";
+}
+
+OpenFileCache::~OpenFileCache()
+{
+    {
+        std::scoped_lock lock{ _mutex };
+        _isStopping = true;
+    }
+    _sweepCondition.notify_one();
+    _sweepThread.join();
+}
+
+std::shared_ptr<const OpenedFile> OpenFileCache::open(const std::filesystem::path& path, std::error_code& ec)
+{
+    const Key key{ path.string() };
+
+    // the path may now lead to another file: entries are only used for the inode they were opened on
+    struct ::stat fileStat;
+    if (::stat(path.c_str(), &fileStat) == 0)
+    {
+        std::scoped_lock lock{ _mutex };
+
+        if (auto itEntry{ _entries.find(key) }; itEntry != std::cend(_entries))
+        {
+            Entry& entry{ itEntry->second };
+            if (fileStat.st_dev == entry.device && fileStat.st_ino == entry.inode)
+            {
+                entry.lastUsedAt = Clock::now();
+                _hitCount++;
+                return entry.file;
+            }
+
+            FS_LOG(UTILS, DEBUG) << "File '" << key << "' changed, reopening it";
+        }
+    }
+
+    _missCount++;
+
+    std::shared_ptr<const OpenedFile> file{ openFileDescriptor(path, ec) };
+    if (!file)
+        return nullptr;
+
+    if (::fstat(file->getFd(), &fileStat) != 0)
+    {
+        ec = std::error_code{ errno, std::generic_category() };
+        return nullptr;
+    }
+
+    OpenedFiles removedFiles; // released once unlocked, as closing may block
+    std::scoped_lock lock{ _mutex };
+
+    const Clock::time_point now{ Clock::now() };
+    auto itEntry{ _entries.find(key) };
+    if (itEntry == std::cend(_entries))
+    {
+        if (_entries.size() >= _maxCount && !removeLeastRecentlyUsedIdleEntry(removedFiles))
+            return file; // all in use: not cached
+
+        itEntry = _entries.emplace(key, Entry{}).first;
+    }
+
+    // concurrent misses on the same file: last one wins
+    Entry& entry{ itEntry->second };
+    removedFiles.push_back(std::move(entry.file));
+    entry.file = file;
+    entry.device = fileStat.st_dev;
+    entry.inode = fileStat.st_ino;
+    entry.lastUsedAt = now;
+
+    return file;
+}
+
+void OpenFileCache::invalidate(const std::filesystem::path& path)
+{
+    OpenedFiles removedFiles;
+    std::scoped_lock lock{ _mutex };
+
+    if (auto itEntry{ _entries.find(path.string()) }; itEntry != std::cend(_entries))
+    {
+        FS_LOG(UTILS, DEBUG) << "Invalidating opened file '" << itEntry->first << "'";
+
+        removedFiles.push_back(std::move(itEntry->second.file));
+        _entries.erase(itEntry);
+    }
+}
+
+std::size_t OpenFileCache::getOpenedCount() const
+{
+    std::scoped_lock lock{ _mutex };
+    return _entries.size();
+}
+
+void OpenFileCache::removeIdleEntries(Clock::time_point now, OpenedFiles& removedFiles)
+{
+    for (auto itEntry{ std::begin(_entries) }; itEntry != std::end(_entries);)
+    {
+        // copies are only made with _mutex held: an unused file cannot be used concurrently
+        const Entry& entry{ itEntry->second };
+        if (entry.file.use_count() == 1 && now - entry.lastUsedAt >= _idleTimeout)
+        {
+            FS_LOG(UTILS, DEBUG) << "Closing idle file '" << itEntry->first << "'";
+
+            removedFiles.push_back(std::move(itEntry->second.file));
+            itEntry = _entries.erase(itEntry);
+        }
+        else
+        {
+            ++itEntry;
+        }
+    }
+}
+
+bool OpenFileCache::removeLeastRecentlyUsedIdleEntry(OpenedFiles& removedFiles)
+{
+    auto itLeastRecentlyUsed{ std::end(_entries) };
+    for (auto itEntry{ std::begin(_entries) }; itEntry != std::end(_entries); ++itEntry)
+    {
+        if (itEntry->second.file.use_count() == 1
+            && (itLeastRecentlyUsed == std::end(_entries) || itEntry->second.lastUsedAt < itLeastRecentlyUsed->second.lastUsedAt))
+        {
+            itLeastRecentlyUsed = itEntry;
+        }
+    }
+
+    if (itLeastRecentlyUsed == std::end(_entries))
+        return false;
+
+    removedFiles.push_back(std::move(itLeastRecentlyUsed->second.file));
+    _entries.erase(itLeastRecentlyUsed);
+    return true;
+}
+
+void OpenFileCache::sweep()
+{
+    std::unique_lock lock{ _mutex };
+
+    while (!_isStopping)
+    {
+        _sweepCondition.wait_for(lock, std::chrono::milliseconds{ _idleTimeout } / 2);
+
+        OpenedFiles removedFiles;
+        removeIdleEntries(Clock::now(), removedFiles);
+
+        lock.unlock();
+        removedFiles.clear();
+        lock.lock();
+    }
+}
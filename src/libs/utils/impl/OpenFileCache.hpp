@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "utils/IOpenFileCache.hpp"
+
+class OpenFileCache final : public IOpenFileCache
+{
+public:
+    OpenFileCache(std::size_t maxCount, std::chrono::seconds idleTimeout);
+    ~OpenFileCache() override;
+    OpenFileCache(const OpenFileCache&) = delete;
+    OpenFileCache& operator=(const OpenFileCache&) = delete;
+
+private:
+    std::shared_ptr<const OpenedFile> open(const std::filesystem::path& path, std::error_code& ec) override;
+    void invalidate(const std::filesystem::path& path) override;
+
+    std::uint64_t getHitCount() const override { return _hitCount; }
+    std::uint64_t getMissCount() const override { return _missCount; }
+    std::size_t getOpenedCount() const override;
+
+    using Clock = std::chrono::steady_clock;
+    using Key = std::string;
+    using OpenedFiles = std::vector<std::shared_ptr<const OpenedFile>>;
+
+    struct Entry
+    {
+        std::shared_ptr<const OpenedFile> file;
+        ::dev_t device{};
+        ::ino_t inode{};
+        Clock::time_point lastUsedAt;
+    };
+
+    // must be called with _mutex held, removed files are to be released once unlocked
+    void removeIdleEntries(Clock::time_point now, OpenedFiles& removedFiles);
+    bool removeLeastRecentlyUsedIdleEntry(OpenedFiles& removedFiles);
+
+    void sweep();
+
+    const std::size_t _maxCount;
+    const std::chrono::seconds _idleTimeout;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, Entry> _entries;
+    std::condition_variable _sweepCondition;
+    bool _isStopping{};
+    std::thread _sweepThread;
+
+    std::atomic<std::uint64_t> _hitCount{};
+    std::atomic<std::uint64_t> _missCount{};
+};
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/PageCache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/Logger.hpp"
+
+#include "PageCacheDropBehind.hpp"
+
+namespace PageCache
+{
+    namespace
+    {
+        constexpr std::uint64_t dropBatchSize{ 4 * 1024 * 1024 };
+        constexpr std::uint64_t dropAlignment{ 2 * 1024 * 1024 }; // largest page cache folios on common setups
+
+        Settings settings;
+
+        std::atomic<std::uint64_t> probedBytes{};
+        std::atomic<std::uint64_t> residentBytes{};
+        std::atomic<std::uint64_t> droppedBytes{};
+
+        std::uint64_t getPageSize()
+        {
+            static const std::uint64_t pageSize{ static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE)) };
+            return pageSize;
+        }
+    } // namespace
+
+    void setSettings(const Settings& newSettings)
+    {
+        settings = newSettings;
+    }
+
+    std::uint64_t getProbedBytes()
+    {
+        return probedBytes.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t getResidentBytes()
+    {
+        return residentBytes.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t getDroppedBytes()
+    {
+        return droppedBytes.load(std::memory_order_relaxed);
+    }
+
+    void DropBehind::reset(int fd, std::uint64_t fileSize)
+    {
+        _fd = fd;
+        _fileSize = fileSize;
+        _isEnabled = settings.dropBehindMinFileSize > 0 && fileSize >= settings.dropBehindMinFileSize;
+        _pendingBegin = 0;
+        _pendingEnd = 0;
+        _droppedEnd = 0;
+    }
+
+    void DropBehind::onRead(std::uint64_t offset, std::size_t size)
+    {
+        if (!_isEnabled)
+            return;
+
+        if (offset != _pendingEnd)
+        {
+            flush();
+            _pendingBegin = offset;
+            _droppedEnd = 0;
+        }
+        _pendingEnd = offset + size;
+
+        if (_pendingEnd - _pendingBegin >= dropBatchSize)
+            flush();
+    }
+
+    void DropBehind::flush()
+    {
+        if (!_isEnabled || _pendingBegin == _pendingEnd)
+            return;
+
+        // partially covered pages (and large folios) are not dropped: the batch boundaries are aligned, the remaining part is dropped with the next batch
+        const std::uint64_t begin{ _pendingBegin / dropAlignment * dropAlignment };
+        const std::uint64_t end{ _pendingEnd >= _fileSize ? _fileSize : _pendingEnd / dropAlignment * dropAlignment };
+        if (end <= begin)
+            return;
+
+        // size 0 goes up to the end of file, including its last partial page
+        const std::uint64_t size{ end == _fileSize ? 0 : end - begin };
+        if (const int res{ ::posix_fadvise(_fd, static_cast<::off_t>(begin), static_cast<::off_t>(size), POSIX_FADV_DONTNEED) }; res != 0)
+            FS_LOG(UTILS, DEBUG) << "posix_fadvise failed: " << ::strerror(res);
+        else
+            droppedBytes.fetch_add(end - std::max(begin, _droppedEnd), std::memory_order_relaxed);
+
+        _droppedEnd = end;
+        _pendingBegin = end;
+    }
+
+    std::optional<std::uint64_t> getResidentBytes(int fd, std::uint64_t size)
+    {
+        if (size == 0)
+            return 0;
+
+        void* addr{ ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) };
+        if (addr == MAP_FAILED)
+        {
+            FS_LOG(UTILS, DEBUG) << "Cannot map file to probe the page cache: " << ::strerror(errno);
+            return std::nullopt;
+        }
+
+        std::optional<std::uint64_t> res;
+
+        const std::uint64_t pageSize{ getPageSize() };
+        std::vector<unsigned char> pageStates((size + pageSize - 1) / pageSize);
+        if (::mincore(addr, size, pageStates.data()) == 0)
+        {
+            res = 0;
+            for (std::size_t i{}; i < pageStates.size(); ++i)
+            {
+                if (pageStates[i] & 1)
+                    *res += std::min(pageSize, size - i * pageSize);
+            }
+        }
+
+        ::munmap(addr, size);
+
+        return res;
+    }
+
+    void probe(int fd, std::uint64_t fileSize)
+    {
+        if (fileSize == 0 || fileSize > settings.probeMaxFileSize)
+            return;
+
+        if (const std::optional<std::uint64_t> fileResidentBytes{ getResidentBytes(fd, fileSize) })
+        {
+            probedBytes.fetch_add(fileSize, std::memory_order_relaxed);
+            residentBytes.fetch_add(*fileResidentBytes, std::memory_order_relaxed);
+        }
+    }
+} // namespace PageCache
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace PageCache
+{
+    // Drops the pages of large files once read (POSIX_FADV_DONTNEED behind the read cursor),
+    // so that streaming them does not evict the other files from the page cache
+    class DropBehind
+    {
+    public:
+        // Does not take ownership of fd, flush must be called before closing it
+        void reset(int fd, std::uint64_t fileSize);
+
+        // Contiguous reads are dropped by batches
+        void onRead(std::uint64_t offset, std::size_t size);
+        void flush();
+
+    private:
+        int _fd{ -1 };
+        std::uint64_t _fileSize{};
+        bool _isEnabled{};
+        std::uint64_t _pendingBegin{};
+        std::uint64_t _pendingEnd{};
+        std::uint64_t _droppedEnd{}; // to account the realigned parts only once
+    };
+
+    // Accounts how much of the file is already in the page cache, if small enough to be probed
+    void probe(int fd, std::uint64_t fileSize);
+
+    // Part of the first size bytes of the file already in the page cache, nullopt if it cannot be checked
+    std::optional<std::uint64_t> getResidentBytes(int fd, std::uint64_t size);
+} // namespace PageCache
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PageCachePrewarmer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "utils/IOpenFileCache.hpp"
+#include "utils/Logger.hpp"
+
+#include "PageCacheDropBehind.hpp"
+
+namespace PageCache
+{
+    std::unique_ptr<IPrewarmer> createPrewarmer(std::uint64_t maxFileSize, std::uint64_t budget)
+    {
+        return std::make_unique<Prewarmer>(maxFileSize, budget);
+    }
+
+    Prewarmer::Prewarmer(std::uint64_t maxFileSize, std::uint64_t budget)
+        : _maxFileSize{ maxFileSize }
+        , _budget{ budget }
+        , _availableBudget{ static_cast<double>(budget) }
+        , _lastRefill{ Clock::now() }
+        , _thread{ [this] { process(); } }
+    {
+        FS_LOG(UTILS, INFO) << "Page cache prewarm: " << _maxFileSize << " bytes per file, budget = " << _budget << " bytes per minute";
+    }
+
+    Prewarmer::~Prewarmer()
+    {
+        {
+            std::scoped_lock lock{ _mutex };
+            _isStopping = true;
+        }
+        _condition.notify_one();
+        _thread.join();
+    }
+
+    void Prewarmer::prewarm(std::string_view key, std::vector<std::filesystem::path> files)
+    {
+        const Clock::time_point now{ Clock::now() };
+
+        {
+            std::scoped_lock lock{ _mutex };
+
+            for (auto it{ std::begin(_recentKeys) }; it != std::end(_recentKeys);)
+            {
+                if (now - it->second >= _recentPeriod)
+                    it = _recentKeys.erase(it);
+                else
+                    ++it;
+            }
+
+            if (_recentKeys.find(std::string{ key }) != std::cend(_recentKeys))
+                return;
+
+            if (_pendingFiles.size() >= _maxPendingCount)
+            {
+                FS_LOG(UTILS, DEBUG) << "Too many pending prewarms, skipping";
+                return;
+            }
+
+            _recentKeys.emplace(key, now);
+            _pendingFiles.push_back(std::move(files));
+        }
+        _condition.notify_one();
+    }
+
+    void Prewarmer::process()
+    {
+        std::unique_lock lock{ _mutex };
+
+        while (true)
+        {
+            _condition.wait(lock, [this] { return _isStopping || !_pendingFiles.empty(); });
+            if (_isStopping)
+                break;
+
+            const std::vector<std::filesystem::path> files{ std::move(_pendingFiles.front()) };
+            _pendingFiles.pop_front();
+
+            lock.unlock();
+            for (const std::filesystem::path& file : files)
+                prewarmFile(file);
+            lock.lock();
+        }
+    }
+
+    void Prewarmer::prewarmFile(const std::filesystem::path& path)
+    {
+        // kept opened by the open file cache, if any, for the download that is likely to follow
+        std::error_code ec;
+        const std::shared_ptr<const OpenedFile> file{ openFile(path, ec) };
+        if (!file)
+        {
+            FS_LOG(UTILS, DEBUG) << "Cannot open '" << path.string() << "' to prewarm it: " << ec.message();
+            return;
+        }
+
+        struct ::stat fileStat;
+        if (::fstat(file->getFd(), &fileStat) != 0)
+        {
+            FS_LOG(UTILS, DEBUG) << "Cannot stat '" << path.string() << "' to prewarm it: " << ::strerror(errno);
+            return;
+        }
+
+        const std::uint64_t size{ std::min(static_cast<std::uint64_t>(fileStat.st_size), _maxFileSize) };
+        if (size == 0)
+            return;
+
+        const std::uint64_t residentBytes{ getResidentBytes(file->getFd(), size).value_or(0) };
+        if (residentBytes >= size)
+        {
+            _hotSkippedCount++;
+            return;
+        }
+
+        const std::uint64_t coldBytes{ size - residentBytes };
+        if (!consumeBudget(coldBytes))
+        {
+            _budgetExhaustedCount++;
+            return;
+        }
+
+        // only starts the reads: the pages are populated asynchronously
+        if (const int res{ ::posix_fadvise(file->getFd(), 0, static_cast<::off_t>(size), POSIX_FADV_WILLNEED) }; res != 0)
+        {
+            FS_LOG(UTILS, DEBUG) << "posix_fadvise failed: " << ::strerror(res);
+            return;
+        }
+
+        _prewarmedBytes += coldBytes;
+    }
+
+    bool Prewarmer::consumeBudget(std::uint64_t size)
+    {
+        const Clock::time_point now{ Clock::now() };
+        const std::chrono::duration<double> elapsed{ now - _lastRefill };
+        _lastRefill = now;
+
+        _availableBudget = std::min(static_cast<double>(_budget), _availableBudget + _budget * elapsed.count() / std::chrono::duration<double>{ _recentPeriod }.count());
+        if (_availableBudget < size)
+            return false;
+
+        _availableBudget -= size;
+        return true;
+    }
+} // namespace PageCache
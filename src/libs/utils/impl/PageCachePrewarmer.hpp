@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "utils/IPageCachePrewarmer.hpp"
+
+namespace PageCache
+{
+    class Prewarmer final : public IPrewarmer
+    {
+    public:
+        Prewarmer(std::uint64_t maxFileSize, std::uint64_t budget);
+        ~Prewarmer() override;
+        Prewarmer(const Prewarmer&) = delete;
+        Prewarmer& operator=(const Prewarmer&) = delete;
+
+    private:
+        void prewarm(std::string_view key, std::vector<std::filesystem::path> files) override;
+
+        std::uint64_t getPrewarmedBytes() const override { return _prewarmedBytes; }
+        std::uint64_t getHotSkippedCount() const override { return _hotSkippedCount; }
+        std::uint64_t getBudgetExhaustedCount() const override { return _budgetExhaustedCount; }
+
+        using Clock = std::chrono::steady_clock;
+
+        void process();
+        void prewarmFile(const std::filesystem::path& path);
+        bool consumeBudget(std::uint64_t size); // only called by the worker thread
+
+        static constexpr std::chrono::seconds _recentPeriod{ 60 }; // also the budget refill period
+        static constexpr std::size_t _maxPendingCount{ 64 };
+        const std::uint64_t _maxFileSize;
+        const std::uint64_t _budget;
+
+        std::mutex _mutex;
+        std::deque<std::vector<std::filesystem::path>> _pendingFiles;
+        std::unordered_map<std::string, Clock::time_point> _recentKeys;
+        std::condition_variable _condition;
+        bool _isStopping{};
+
+        // token bucket
+        double _availableBudget{};
+        Clock::time_point _lastRefill;
+
+        std::atomic<std::uint64_t> _prewarmedBytes{};
+        std::atomic<std::uint64_t> _hotSkippedCount{};
+        std::atomic<std::uint64_t> _budgetExhaustedCount{};
+
+        std::thread _thread; // last, started once everything is initialized
+    };
+} // namespace PageCache
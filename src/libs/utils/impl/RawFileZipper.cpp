@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RawFileZipper.hpp"
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include "utils/Logger.hpp"
+
+namespace Zip
+{
+    RawFileZipper::RawFileZipper(const Entry& entry)
+        : _entry{ entry }
+        , _beyondLastByte{ entry.size }
+        , _readBuffer(_readBufferSize, {})
+    {
+    }
+
+    std::uint64_t RawFileZipper::writeSome(std::ostream& output, const WriteBudget& budget)
+    {
+        if (_offset >= _beyondLastByte)
+            return 0;
+
+        if (!_file.isOpen())
+            _file.open(_entry);
+
+        const std::size_t size{ static_cast<std::size_t>(std::min<std::uint64_t>({ _beyondLastByte - _offset, _readBuffer.size(), budget.maxOutputSize, budget.maxInputSize })) };
+        _file.read(_offset, _readBuffer.data(), size);
+
+        output.write(reinterpret_cast<const char*>(_readBuffer.data()), size);
+        if (!output)
+            throw Exception{ "Failed to write " + std::to_string(size) + " bytes in output!" };
+
+        _offset += size;
+        if (_offset >= _beyondLastByte)
+            _file.close();
+
+        return size;
+    }
+
+    bool RawFileZipper::isComplete() const
+    {
+        return _offset >= _beyondLastByte;
+    }
+
+    void RawFileZipper::abort()
+    {
+        FS_LOG(UTILS, DEBUG) << "Aborting file read";
+        _file.close();
+        _beyondLastByte = _offset;
+    }
+} // namespace Zip
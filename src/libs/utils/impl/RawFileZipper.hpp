@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "utils/IZipper.hpp"
+#include "EntryFile.hpp"
+
+namespace Zip
+{
+    // Data of a single file, as is: input of the stream compressions
+    class RawFileZipper : public IZipper
+    {
+    public:
+        RawFileZipper(const Entry& entry);
+        RawFileZipper(const RawFileZipper&) = delete;
+        RawFileZipper& operator=(const RawFileZipper&) = delete;
+
+    private:
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
+        bool isComplete() const override;
+        void abort() override;
+
+        const Entry _entry;
+        std::uint64_t _beyondLastByte{};
+
+        static inline constexpr std::size_t _readBufferSize{ 65536 };
+        std::vector<std::byte> _readBuffer;
+
+        EntryFile _file;
+        std::uint64_t _offset{};
+    };
+} // namespace Zip
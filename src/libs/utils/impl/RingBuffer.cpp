@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace Zip
+{
+    RingBuffer::RingBuffer(std::size_t capacity)
+        : _buffer(capacity)
+    {
+    }
+
+    void RingBuffer::write(const char* data, std::size_t size)
+    {
+        assert(size <= getFreeSize());
+
+        const std::size_t writeOffset{ (_readOffset + _size) % _buffer.size() };
+        const std::size_t firstPartSize{ std::min(size, _buffer.size() - writeOffset) };
+
+        std::memcpy(&_buffer[writeOffset], data, firstPartSize);
+        std::memcpy(&_buffer[0], data + firstPartSize, size - firstPartSize);
+        _size += size;
+    }
+
+    std::size_t RingBuffer::read(std::ostream& output, std::size_t maxSize)
+    {
+        const std::size_t size{ std::min(maxSize, _size) };
+        const std::size_t firstPartSize{ std::min(size, _buffer.size() - _readOffset) };
+
+        output.write(&_buffer[_readOffset], firstPartSize);
+        output.write(&_buffer[0], size - firstPartSize);
+
+        _readOffset = (_readOffset + size) % _buffer.size();
+        _size -= size;
+        return size;
+    }
+} // namespace Zip
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace Zip
+{
+    // Fixed capacity byte FIFO
+    class RingBuffer
+    {
+    public:
+        RingBuffer(std::size_t capacity);
+
+        std::size_t getSize() const { return _size; }
+        std::size_t getFreeSize() const { return _buffer.size() - _size; }
+        bool isEmpty() const { return _size == 0; }
+
+        // size must not exceed the free size
+        void write(const char* data, std::size_t size);
+        // Returns the number of bytes written to output
+        std::size_t read(std::ostream& output, std::size_t maxSize);
+
+    private:
+        std::vector<char> _buffer;
+        std::size_t _readOffset{};
+        std::size_t _size{};
+    };
+} // namespace Zip
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/SparseFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/Exception.hpp"
+#include "utils/Logger.hpp"
+
+#include "SparseFileReader.hpp"
+
+namespace SparseFile
+{
+    namespace
+    {
+        std::atomic<std::uint64_t> skippedReadBytes{};
+        std::atomic<std::uint64_t> deallocatedBytes{};
+
+        class ScopedFd
+        {
+        public:
+            ScopedFd(int fd)
+                : _fd{ fd } {}
+            ~ScopedFd()
+            {
+                if (_fd >= 0)
+                    ::close(_fd);
+            }
+            ScopedFd(const ScopedFd&) = delete;
+            ScopedFd& operator=(const ScopedFd&) = delete;
+
+            int get() const { return _fd; }
+
+        private:
+            const int _fd;
+        };
+
+        bool isZero(const std::byte* data, std::size_t size)
+        {
+            return size == 0 || (data[0] == std::byte{ 0 } && std::memcmp(data, data + 1, size - 1) == 0);
+        }
+    } // namespace
+
+    Reader::Reader(int fd)
+        : _fd{ fd }
+    {
+    }
+
+    void Reader::reset(int fd)
+    {
+        _fd = fd;
+        _isSeekSupported = true;
+        _extentBegin = 0;
+        _extentEnd = 0;
+        _isHole = false;
+    }
+
+    ::ssize_t Reader::read(std::uint64_t offset, std::byte* buffer, std::size_t size)
+    {
+        if (offset < _extentBegin || offset >= _extentEnd)
+        {
+            if (!locateExtent(offset))
+                return -1;
+
+            if (_extentBegin == _extentEnd) // end of file
+                return 0;
+        }
+
+        const std::size_t extentSize{ static_cast<std::size_t>(std::min<std::uint64_t>(size, _extentEnd - offset)) };
+        if (!_isHole)
+            return ::pread(_fd, buffer, extentSize, static_cast<::off_t>(offset));
+
+        std::memset(buffer, 0, extentSize);
+        _skippedReadBytes += extentSize;
+        skippedReadBytes.fetch_add(extentSize, std::memory_order_relaxed);
+
+        return static_cast<::ssize_t>(extentSize);
+    }
+
+    bool Reader::locateExtent(std::uint64_t offset)
+    {
+        _extentBegin = offset;
+
+        if (_isSeekSupported)
+        {
+            const ::off_t dataOffset{ ::lseek(_fd, static_cast<::off_t>(offset), SEEK_DATA) };
+            if (dataOffset < 0 && errno == ENXIO)
+            {
+                // no more data: either in the trailing hole or at the end of file
+                struct ::stat fileStat;
+                if (::fstat(_fd, &fileStat) != 0)
+                    return false;
+
+                _extentEnd = std::max(offset, static_cast<std::uint64_t>(fileStat.st_size));
+                _isHole = true;
+                return true;
+            }
+
+            if (dataOffset >= 0 && static_cast<std::uint64_t>(dataOffset) > offset)
+            {
+                _extentEnd = static_cast<std::uint64_t>(dataOffset);
+                _isHole = true;
+                return true;
+            }
+
+            if (dataOffset >= 0)
+            {
+                // the end of file is an implicit hole
+                const ::off_t holeOffset{ ::lseek(_fd, static_cast<::off_t>(offset), SEEK_HOLE) };
+                if (holeOffset >= 0)
+                {
+                    _extentEnd = static_cast<std::uint64_t>(holeOffset);
+                    _isHole = false;
+                    return true;
+                }
+            }
+
+            FS_LOG(UTILS, DEBUG) << "SEEK_DATA/SEEK_HOLE not supported: " << ::strerror(errno);
+            _isSeekSupported = false;
+        }
+
+        // let pread report the errors and the end of file
+        _extentEnd = std::numeric_limits<std::uint64_t>::max();
+        _isHole = false;
+        return true;
+    }
+
+    std::uint64_t sparsify(const std::filesystem::path& path)
+    {
+#ifdef FALLOC_FL_PUNCH_HOLE
+        const ScopedFd fd{ ::open(path.c_str(), O_RDWR | O_CLOEXEC) };
+        if (fd.get() < 0)
+            throw FsException{ "Cannot open file '" + path.string() + "': " + ::strerror(errno) };
+
+        struct ::stat fileStat;
+        if (::fstat(fd.get(), &fileStat) != 0)
+            throw FsException{ "Cannot stat file '" + path.string() + "': " + ::strerror(errno) };
+
+        const std::uint64_t fileSize{ static_cast<std::uint64_t>(fileStat.st_size) };
+        const std::uint64_t allocatedSizeBefore{ static_cast<std::uint64_t>(fileStat.st_blocks) * 512 };
+
+        // only whole file system blocks can be deallocated
+        const std::size_t blockSize{ fileStat.st_blksize > 0 ? static_cast<std::size_t>(fileStat.st_blksize) : 4096 };
+        std::vector<std::byte> buffer(std::max<std::size_t>(blockSize, 1024 * 1024 / blockSize * blockSize));
+
+        std::optional<std::uint64_t> zeroBlocksBegin;
+        auto punchHole{ [&](std::uint64_t end) {
+            const std::uint64_t begin{ *zeroBlocksBegin };
+            zeroBlocksBegin.reset();
+
+            if (::fallocate(fd.get(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<::off_t>(begin), static_cast<::off_t>(end - begin)) != 0)
+            {
+                if (errno == EOPNOTSUPP)
+                    return false;
+
+                throw FsException{ "Cannot punch hole in file '" + path.string() + "': " + ::strerror(errno) };
+            }
+
+            return true;
+        } };
+
+        // existing holes are not read again
+        Reader reader{ fd.get() };
+        std::uint64_t offset{};
+        while (offset + blockSize <= fileSize)
+        {
+            const std::size_t readSize{ static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), (fileSize - offset) / blockSize * blockSize)) };
+            for (std::size_t bufferOffset{}; bufferOffset < readSize;)
+            {
+                const ::ssize_t res{ reader.read(offset + bufferOffset, buffer.data() + bufferOffset, readSize - bufferOffset) };
+                if (res < 0 && errno == EINTR)
+                    continue;
+                if (res < 0)
+                    throw FsException{ "Read failed in file '" + path.string() + "': " + ::strerror(errno) };
+                if (res == 0)
+                    throw FsException{ "Read failed in file '" + path.string() + "': unexpected end of file" };
+
+                bufferOffset += static_cast<std::size_t>(res);
+            }
+
+            for (std::size_t blockOffset{}; blockOffset < readSize; blockOffset += blockSize)
+            {
+                const bool isZeroBlock{ isZero(buffer.data() + blockOffset, blockSize) };
+                if (isZeroBlock && !zeroBlocksBegin)
+                    zeroBlocksBegin = offset + blockOffset;
+                else if (!isZeroBlock && zeroBlocksBegin && !punchHole(offset + blockOffset))
+                {
+                    FS_LOG(UTILS, DEBUG) << "Cannot sparsify file '" << path.string() << "': hole punching not supported";
+                    return 0;
+                }
+            }
+
+            offset += readSize;
+        }
+
+        if (zeroBlocksBegin && !punchHole(offset))
+        {
+            FS_LOG(UTILS, DEBUG) << "Cannot sparsify file '" << path.string() << "': hole punching not supported";
+            return 0;
+        }
+
+        if (::fstat(fd.get(), &fileStat) != 0)
+            throw FsException{ "Cannot stat file '" + path.string() + "': " + ::strerror(errno) };
+
+        const std::uint64_t allocatedSizeAfter{ static_cast<std::uint64_t>(fileStat.st_blocks) * 512 };
+        const std::uint64_t deallocatedSize{ allocatedSizeBefore > allocatedSizeAfter ? allocatedSizeBefore - allocatedSizeAfter : 0 };
+        deallocatedBytes.fetch_add(deallocatedSize, std::memory_order_relaxed);
+
+        FS_LOG(UTILS, DEBUG) << "Sparsified file '" << path.string() << "', fileSize = " << fileSize << ", deallocated = " << deallocatedSize;
+
+        return deallocatedSize;
+#else
+        FS_LOG(UTILS, DEBUG) << "Cannot sparsify file '" << path.string() << "': hole punching not supported";
+        return 0;
+#endif
+    }
+
+    std::uint64_t getSkippedReadBytes()
+    {
+        return skippedReadBytes.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t getDeallocatedBytes()
+    {
+        return deallocatedBytes.load(std::memory_order_relaxed);
+    }
+} // namespace SparseFile
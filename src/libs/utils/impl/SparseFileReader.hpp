@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+namespace SparseFile
+{
+    // Reads a file like pread, except that holes are filled with zeros instead of being read
+    // The current data or hole extent is cached, so that sequential reads only look up each extent once
+    class Reader
+    {
+    public:
+        Reader() = default;
+        explicit Reader(int fd);
+
+        // Does not take ownership of fd
+        void reset(int fd);
+
+        // Same semantics as pread: returns the number of bytes read (maybe less than size), 0 at end of file, -1 and errno on error
+        ::ssize_t read(std::uint64_t offset, std::byte* buffer, std::size_t size);
+
+        std::uint64_t getSkippedReadBytes() const { return _skippedReadBytes; }
+
+    private:
+        bool locateExtent(std::uint64_t offset);
+
+        int _fd{ -1 };
+        bool _isSeekSupported{ true };
+        std::uint64_t _extentBegin{};
+        std::uint64_t _extentEnd{};
+        bool _isHole{};
+        std::uint64_t _skippedReadBytes{};
+    };
+} // namespace SparseFile
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StoreZipper.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <string_view>
+
+#include <sys/stat.h>
+
+#include "utils/Crc32.hpp"
+#include "utils/Logger.hpp"
+
+namespace Zip
+{
+    namespace
+    {
+        constexpr std::uint32_t localFileHeaderSignature{ 0x04034b50 };
+        constexpr std::uint32_t dataDescriptorSignature{ 0x08074b50 };
+        constexpr std::uint32_t centralDirectoryHeaderSignature{ 0x02014b50 };
+        constexpr std::uint32_t zip64EndOfCentralDirectorySignature{ 0x06064b50 };
+        constexpr std::uint32_t zip64EndOfCentralDirectoryLocatorSignature{ 0x07064b50 };
+        constexpr std::uint32_t endOfCentralDirectorySignature{ 0x06054b50 };
+
+        constexpr std::uint64_t zip64EndOfCentralDirectoryRecordSize{ 44 }; // not counting the leading signature and size fields
+        constexpr std::uint16_t zip64ExtraFieldTag{ 0x0001 };
+
+        constexpr std::uint16_t versionNeededToExtract{ 10 };      // 1.0: stored entries
+        constexpr std::uint16_t versionNeededToExtractZip64{ 45 }; // 4.5: ZIP64 extensions
+        constexpr std::uint16_t versionMadeBy{ (3 << 8) | 45 };    // Unix, 4.5
+        constexpr std::uint16_t generalPurposeFlags{ 0x0800 };     // names are UTF-8 encoded
+        constexpr std::uint16_t dataDescriptorFlag{ 0x0008 };      // CRC is written after the file data
+        constexpr std::uint16_t compressionMethodStore{ 0 };
+
+        // values greater or equal are moved to the ZIP64 structures
+        constexpr std::uint64_t maxValue32{ std::numeric_limits<std::uint32_t>::max() };
+        constexpr std::uint64_t maxValue16{ std::numeric_limits<std::uint16_t>::max() };
+
+        // names are flagged as UTF-8: reject what would not decode
+        bool isValidUtf8(std::string_view str)
+        {
+            std::size_t i{};
+            while (i < str.size())
+            {
+                const unsigned char c{ static_cast<unsigned char>(str[i]) };
+
+                std::size_t continuationCount{};
+                std::uint32_t codePoint{};
+                if (c < 0x80)
+                    codePoint = c;
+                else if ((c & 0xE0) == 0xC0)
+                {
+                    continuationCount = 1;
+                    codePoint = c & 0x1F;
+                }
+                else if ((c & 0xF0) == 0xE0)
+                {
+                    continuationCount = 2;
+                    codePoint = c & 0x0F;
+                }
+                else if ((c & 0xF8) == 0xF0)
+                {
+                    continuationCount = 3;
+                    codePoint = c & 0x07;
+                }
+                else
+                    return false;
+
+                if (continuationCount > str.size() - i - 1)
+                    return false;
+
+                for (std::size_t j{ 1 }; j <= continuationCount; ++j)
+                {
+                    const unsigned char continuation{ static_cast<unsigned char>(str[i + j]) };
+                    if ((continuation & 0xC0) != 0x80)
+                        return false;
+                    codePoint = (codePoint << 6) | (continuation & 0x3F);
+                }
+
+                // overlong encodings, surrogates and out of range values
+                constexpr std::uint32_t minCodePoints[]{ 0, 0x80, 0x800, 0x10000 };
+                if (codePoint < minCodePoints[continuationCount] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+                    return false;
+
+                i += continuationCount + 1;
+            }
+
+            return true;
+        }
+    } // namespace
+
+    // Little endian serialization of the zip structures
+    class StoreZipper::HeaderWriter
+    {
+    public:
+        void writeU16(std::uint16_t value)
+        {
+            for (std::size_t i{}; i < sizeof(value); ++i)
+                _buffer.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+        }
+
+        void writeU32(std::uint32_t value)
+        {
+            for (std::size_t i{}; i < sizeof(value); ++i)
+                _buffer.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+        }
+
+        void writeU64(std::uint64_t value)
+        {
+            for (std::size_t i{}; i < sizeof(value); ++i)
+                _buffer.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+        }
+
+        // writes 0xFFFF... if the value does not fit
+        void writeU32OrZip64Marker(std::uint64_t value)
+        {
+            writeU32(static_cast<std::uint32_t>(std::min(value, maxValue32)));
+        }
+
+        void writeString(std::string_view str)
+        {
+            std::transform(std::cbegin(str), std::cend(str), std::back_inserter(_buffer), [](char c) { return static_cast<std::byte>(c); });
+        }
+
+        const std::vector<std::byte>& getBuffer() const { return _buffer; }
+
+    private:
+        std::vector<std::byte> _buffer;
+    };
+
+    bool canUseStoreZipper(const EntryContainer& entries)
+    {
+        return std::all_of(std::cbegin(entries), std::cend(entries), [](const Entry& entry) {
+            return !entry.fileName.empty()
+                && entry.fileName.size() < maxValue16
+                && entry.fileName.find('\0') == std::string::npos
+                && isValidUtf8(entry.fileName)
+                && (!entry.mode || (*entry.mode & ~static_cast<std::uint32_t>(07777)) == 0);
+        });
+    }
+
+    std::unique_ptr<IZipper> createStoreZipper(const EntryContainer& entries)
+    {
+        return std::make_unique<StoreZipper>(entries);
+    }
+
+    StoreZipper::StoreZipper(const EntryContainer& entries)
+        : _entries{ entries }
+        , _readBuffer(_readBufferSize, {})
+        , _currentEntry{ std::cbegin(_entries) }
+    {
+        _centralDirectoryRecords.reserve(_entries.size());
+    }
+
+    std::uint64_t StoreZipper::writeSome(std::ostream& output, const WriteBudget& budget)
+    {
+        _output.open(output, budget.maxOutputSize);
+
+        try
+        {
+            // pending data first, new data is only produced in the following calls
+            if (_output.getBytesWritten() == 0 && !_output.hasPendingData())
+                writeSomeData(std::min(budget.maxOutputSize, budget.maxInputSize));
+        }
+        catch (...)
+        {
+            _output.close();
+            throw;
+        }
+
+        _output.close();
+        return _output.getBytesWritten();
+    }
+
+    bool StoreZipper::isComplete() const
+    {
+        return _state == State::Complete && !_output.hasPendingData();
+    }
+
+    void StoreZipper::abort()
+    {
+        FS_LOG(UTILS, DEBUG) << "Aborting zip creation";
+        _currentFile.close();
+        _output.discardPendingData();
+        _state = State::Complete;
+    }
+
+    void StoreZipper::writeSomeData(std::size_t maxSize)
+    {
+        switch (_state)
+        {
+        case State::LocalFileHeader:
+            if (_currentEntry == std::cend(_entries))
+            {
+                _state = State::CentralDirectory;
+                _centralDirectoryOffset = _totalBytesWritten;
+                writeSomeCentralDirectory(maxSize);
+            }
+            else
+                writeLocalFileHeader();
+            break;
+
+        case State::FileData:
+            writeSomeCurrentFileData(maxSize);
+            break;
+
+        case State::DataDescriptor:
+            writeDataDescriptor();
+            break;
+
+        case State::CentralDirectory:
+            writeSomeCentralDirectory(maxSize);
+            break;
+
+        case State::Complete:
+            break;
+        }
+    }
+
+    // local time, as done by libarchive
+    StoreZipper::DosDateTime StoreZipper::toDosDateTime(std::optional<std::time_t> time)
+    {
+        DosDateTime res;
+
+        std::tm tm;
+        if (!time || !::localtime_r(&*time, &tm) || tm.tm_year < 80 || tm.tm_year > 207)
+            return res;
+
+        res.date = static_cast<std::uint16_t>(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+        res.time = static_cast<std::uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+        return res;
+    }
+
+    void StoreZipper::writeLocalFileHeader()
+    {
+        assert(_currentEntry != std::cend(_entries));
+
+        _currentFile.open(*_currentEntry);
+
+        CentralDirectoryRecord record;
+        record.localHeaderOffset = _totalBytesWritten;
+        record.crc32 = _currentEntry->crc32.value_or(0);
+        record.hasDataDescriptor = !_currentEntry->crc32;
+        record.mode = S_IFREG | _currentEntry->mode.value_or(_currentFile.getMode());
+        record.size = _currentEntry->size;
+        record.dosDateTime = toDosDateTime(_currentEntry->modificationTime);
+
+        // if present, the ZIP64 extra field of local headers must contain both sizes
+        const bool useZip64{ record.size >= maxValue32 };
+
+        HeaderWriter header;
+        header.writeU32(localFileHeaderSignature);
+        header.writeU16(useZip64 ? versionNeededToExtractZip64 : versionNeededToExtract);
+        header.writeU16(record.hasDataDescriptor ? generalPurposeFlags | dataDescriptorFlag : generalPurposeFlags);
+        header.writeU16(compressionMethodStore);
+        header.writeU16(record.dosDateTime.time);
+        header.writeU16(record.dosDateTime.date);
+        header.writeU32(record.crc32); // 0 if computed on the fly
+        header.writeU32OrZip64Marker(record.size); // compressed size
+        header.writeU32OrZip64Marker(record.size); // uncompressed size
+        header.writeU16(static_cast<std::uint16_t>(_currentEntry->fileName.size()));
+        header.writeU16(useZip64 ? 4 + 2 * sizeof(std::uint64_t) : 0); // extra field length
+        header.writeString(_currentEntry->fileName);
+        if (useZip64)
+        {
+            header.writeU16(zip64ExtraFieldTag);
+            header.writeU16(2 * sizeof(std::uint64_t));
+            header.writeU64(record.size); // uncompressed size
+            header.writeU64(record.size); // compressed size
+        }
+
+        _centralDirectoryRecords.push_back(record);
+        _currentEntryOffset = 0;
+        _state = State::FileData;
+
+        write(header.getBuffer().data(), header.getBuffer().size());
+    }
+
+    void StoreZipper::writeSomeCurrentFileData(std::size_t maxSize)
+    {
+        const std::uint64_t fileSize{ _centralDirectoryRecords.back().size };
+        const std::uint64_t bytesToRead{ std::min(fileSize - _currentEntryOffset, static_cast<std::uint64_t>(std::min(_readBufferSize, maxSize))) };
+
+        if (bytesToRead > 0)
+        {
+            _currentFile.read(_currentEntryOffset, _readBuffer.data(), bytesToRead);
+
+            CentralDirectoryRecord& record{ _centralDirectoryRecords.back() };
+            if (record.hasDataDescriptor)
+                record.crc32 = Crc32::update(record.crc32, _readBuffer.data(), bytesToRead);
+
+            write(_readBuffer.data(), bytesToRead);
+            _currentEntryOffset += bytesToRead;
+        }
+
+        if (_currentEntryOffset == fileSize)
+        {
+            _currentFile.close();
+            if (_centralDirectoryRecords.back().hasDataDescriptor)
+            {
+                _state = State::DataDescriptor;
+            }
+            else
+            {
+                _currentEntry++;
+                _state = State::LocalFileHeader;
+            }
+        }
+    }
+
+    void StoreZipper::writeDataDescriptor()
+    {
+        const CentralDirectoryRecord& record{ _centralDirectoryRecords.back() };
+
+        // sizes are 64-bit if the local header has a ZIP64 extra field
+        HeaderWriter header;
+        header.writeU32(dataDescriptorSignature);
+        header.writeU32(record.crc32);
+        if (record.size >= maxValue32)
+        {
+            header.writeU64(record.size); // compressed size
+            header.writeU64(record.size); // uncompressed size
+        }
+        else
+        {
+            header.writeU32(static_cast<std::uint32_t>(record.size)); // compressed size
+            header.writeU32(static_cast<std::uint32_t>(record.size)); // uncompressed size
+        }
+
+        _currentEntry++;
+        _state = State::LocalFileHeader;
+
+        write(header.getBuffer().data(), header.getBuffer().size());
+    }
+
+    void StoreZipper::writeSomeCentralDirectory(std::size_t maxSize)
+    {
+        assert(_centralDirectoryRecords.size() == _entries.size());
+
+        // the central directory may be large: write it by batches
+        HeaderWriter header;
+        while (_currentCentralDirectoryRecord < _centralDirectoryRecords.size() && header.getBuffer().size() < std::min(_readBufferSize, maxSize))
+        {
+            writeCentralDirectoryRecord(header, _entries[_currentCentralDirectoryRecord], _centralDirectoryRecords[_currentCentralDirectoryRecord]);
+            _currentCentralDirectoryRecord++;
+        }
+
+        if (_currentCentralDirectoryRecord == _centralDirectoryRecords.size())
+        {
+            writeEndOfCentralDirectory(header, _totalBytesWritten + header.getBuffer().size());
+            _state = State::Complete;
+        }
+
+        write(header.getBuffer().data(), header.getBuffer().size());
+    }
+
+    void StoreZipper::writeCentralDirectoryRecord(HeaderWriter& header, const Entry& entry, const CentralDirectoryRecord& record)
+    {
+        // only the overflowing fields are present in the ZIP64 extra field, in this order
+        std::vector<std::uint64_t> zip64Values;
+        if (record.size >= maxValue32)
+        {
+            zip64Values.push_back(record.size); // uncompressed size
+            zip64Values.push_back(record.size); // compressed size
+        }
+        if (record.localHeaderOffset >= maxValue32)
+            zip64Values.push_back(record.localHeaderOffset);
+
+        const std::size_t zip64ExtraFieldSize{ zip64Values.size() * sizeof(std::uint64_t) };
+
+        header.writeU32(centralDirectoryHeaderSignature);
+        header.writeU16(versionMadeBy);
+        header.writeU16(zip64Values.empty() ? versionNeededToExtract : versionNeededToExtractZip64);
+        header.writeU16(record.hasDataDescriptor ? generalPurposeFlags | dataDescriptorFlag : generalPurposeFlags);
+        header.writeU16(compressionMethodStore);
+        header.writeU16(record.dosDateTime.time);
+        header.writeU16(record.dosDateTime.date);
+        header.writeU32(record.crc32);
+        header.writeU32OrZip64Marker(record.size); // compressed size
+        header.writeU32OrZip64Marker(record.size); // uncompressed size
+        header.writeU16(static_cast<std::uint16_t>(entry.fileName.size()));
+        header.writeU16(zip64Values.empty() ? 0 : static_cast<std::uint16_t>(4 + zip64ExtraFieldSize)); // extra field length
+        header.writeU16(0);                                                                          // comment length
+        header.writeU16(0);                                                                          // disk number start
+        header.writeU16(0);                                                                          // internal file attributes
+        header.writeU32(record.mode << 16);
+        header.writeU32OrZip64Marker(record.localHeaderOffset);
+        header.writeString(entry.fileName);
+        if (!zip64Values.empty())
+        {
+            header.writeU16(zip64ExtraFieldTag);
+            header.writeU16(static_cast<std::uint16_t>(zip64ExtraFieldSize));
+            for (const std::uint64_t value : zip64Values)
+                header.writeU64(value);
+        }
+    }
+
+    void StoreZipper::writeEndOfCentralDirectory(HeaderWriter& header, std::uint64_t centralDirectoryEndOffset)
+    {
+        const std::uint64_t centralDirectorySize{ centralDirectoryEndOffset - _centralDirectoryOffset };
+        const std::uint64_t entryCount{ _entries.size() };
+
+        if (entryCount >= maxValue16 || centralDirectorySize >= maxValue32 || _centralDirectoryOffset >= maxValue32)
+        {
+            const std::uint64_t zip64EndOfCentralDirectoryOffset{ centralDirectoryEndOffset };
+
+            header.writeU32(zip64EndOfCentralDirectorySignature);
+            header.writeU64(zip64EndOfCentralDirectoryRecordSize);
+            header.writeU16(versionMadeBy);
+            header.writeU16(versionNeededToExtractZip64);
+            header.writeU32(0); // number of this disk
+            header.writeU32(0); // disk where central directory starts
+            header.writeU64(entryCount);
+            header.writeU64(entryCount);
+            header.writeU64(centralDirectorySize);
+            header.writeU64(_centralDirectoryOffset);
+
+            header.writeU32(zip64EndOfCentralDirectoryLocatorSignature);
+            header.writeU32(0); // disk where the ZIP64 end of central directory starts
+            header.writeU64(zip64EndOfCentralDirectoryOffset);
+            header.writeU32(1); // total number of disks
+        }
+
+        header.writeU32(endOfCentralDirectorySignature);
+        header.writeU16(0); // number of this disk
+        header.writeU16(0); // disk where central directory starts
+        header.writeU16(static_cast<std::uint16_t>(std::min(entryCount, maxValue16)));
+        header.writeU16(static_cast<std::uint16_t>(std::min(entryCount, maxValue16)));
+        header.writeU32OrZip64Marker(centralDirectorySize);
+        header.writeU32OrZip64Marker(_centralDirectoryOffset);
+        header.writeU16(0); // comment length
+    }
+
+    void StoreZipper::write(const std::byte* data, std::size_t size)
+    {
+        _output.write(data, size);
+        _totalBytesWritten += size;
+    }
+} // namespace Zip
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "utils/IZipper.hpp"
+#include "BudgetedOutput.hpp"
+#include "EntryFile.hpp"
+
+namespace Zip
+{
+    // Writes stored (uncompressed) entries: sizes and precomputed CRCs are written in the local file headers,
+    // file data is copied as is. Missing CRCs are computed while copying and written in data descriptors
+    // ZIP64 extensions are only used by the entries and archives that need them
+    // Headers exceeding the output budget of a writeSome call are kept for the next calls
+    class StoreZipper : public IZipper
+    {
+    public:
+        StoreZipper(const EntryContainer& entries);
+        StoreZipper(const StoreZipper&) = delete;
+        StoreZipper& operator=(const StoreZipper&) = delete;
+
+    private:
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
+        bool isComplete() const override;
+        void abort() override;
+
+        class HeaderWriter;
+
+        struct DosDateTime
+        {
+            std::uint16_t date{ (1 << 5) | 1 }; // 1980-01-01
+            std::uint16_t time{};
+        };
+        static DosDateTime toDosDateTime(std::optional<std::time_t> time);
+
+        struct CentralDirectoryRecord
+        {
+            std::uint64_t localHeaderOffset{};
+            std::uint64_t size{};
+            std::uint32_t crc32{};
+            std::uint32_t mode{};
+            DosDateTime dosDateTime;
+            bool hasDataDescriptor{};
+        };
+
+        void writeSomeData(std::size_t maxSize);
+        void writeLocalFileHeader();
+        void writeSomeCurrentFileData(std::size_t maxSize);
+        void writeDataDescriptor();
+        void writeSomeCentralDirectory(std::size_t maxSize);
+        void writeCentralDirectoryRecord(HeaderWriter& header, const Entry& entry, const CentralDirectoryRecord& record);
+        void writeEndOfCentralDirectory(HeaderWriter& header, std::uint64_t centralDirectoryEndOffset);
+        void write(const std::byte* data, std::size_t size);
+
+        enum class State
+        {
+            LocalFileHeader,
+            FileData,
+            DataDescriptor,
+            CentralDirectory,
+            Complete,
+        };
+
+        const EntryContainer _entries;
+        State _state{ State::LocalFileHeader };
+
+        static inline constexpr std::size_t _readBufferSize{ 65536 };
+        std::vector<std::byte> _readBuffer;
+
+        EntryContainer::const_iterator _currentEntry;
+        EntryFile _currentFile;
+        std::uint64_t _currentEntryOffset{};
+
+        std::vector<CentralDirectoryRecord> _centralDirectoryRecords;
+        std::size_t _currentCentralDirectoryRecord{};
+        std::uint64_t _centralDirectoryOffset{};
+        std::uint64_t _totalBytesWritten{}; // in the archive, including the pending data
+        BudgetedOutput _output;
+    };
+} // namespace Zip
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TarZipper.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "utils/Logger.hpp"
+
+namespace Zip
+{
+    namespace
+    {
+        constexpr std::size_t blockSize{ 512 };
+        constexpr std::size_t ustarNameSize{ 100 };
+        constexpr std::uint64_t ustarMaxSize{ 077777777777 }; // 11 octal digits
+        constexpr std::string_view paxHeaderName{ "././@PaxHeader" };
+
+        constexpr std::array<std::byte, 2 * blockSize> zeros{}; // padding and end of archive
+
+        std::uint64_t padToBlock(std::uint64_t size)
+        {
+            return (size + blockSize - 1) / blockSize * blockSize;
+        }
+
+        std::string createPaxRecord(std::string_view key, std::string_view value)
+        {
+            // "<length> <key>=<value>\n", where length includes its own digits
+            const std::size_t size{ key.size() + value.size() + 3 };
+            std::size_t recordSize{ size + std::to_string(size).size() };
+            if (std::to_string(recordSize).size() + size != recordSize)
+                recordSize++;
+
+            return std::to_string(recordSize) + " " + std::string{ key } + "=" + std::string{ value } + "\n";
+        }
+
+        std::string createPaxData(std::string_view name, std::uint64_t fileSize)
+        {
+            std::string paxData;
+
+            const bool isAsciiName{ std::all_of(std::cbegin(name), std::cend(name), [](char c) { return (static_cast<unsigned char>(c) & 0x80) == 0; }) };
+            if (name.size() > ustarNameSize || !isAsciiName)
+                paxData += createPaxRecord("path", name);
+
+            if (fileSize > ustarMaxSize)
+                paxData += createPaxRecord("size", std::to_string(fileSize));
+
+            return paxData;
+        }
+
+        std::uint64_t getHeadersSize(const Entry& entry)
+        {
+            std::uint64_t headersSize{ blockSize };
+            if (const std::size_t paxDataSize{ createPaxData(entry.fileName, entry.size).size() }; paxDataSize > 0)
+                headersSize += blockSize + padToBlock(paxDataSize);
+
+            return headersSize;
+        }
+
+        void writeOctal(std::byte* field, std::size_t fieldSize, std::uint64_t value)
+        {
+            // zero padded, NUL terminated
+            for (std::size_t i{ fieldSize - 1 }; i > 0; --i)
+            {
+                field[i - 1] = static_cast<std::byte>('0' + (value & 7));
+                value >>= 3;
+            }
+            field[fieldSize - 1] = std::byte{ 0 };
+        }
+
+        void writeString(std::byte* field, std::size_t fieldSize, std::string_view str)
+        {
+            std::memcpy(field, str.data(), std::min(fieldSize, str.size()));
+        }
+
+        void writeUstarHeader(std::byte* header, std::string_view name, std::uint32_t mode, std::uint64_t size, std::time_t modificationTime, char typeFlag)
+        {
+            std::memset(header, 0, blockSize);
+
+            writeString(header, 100, name);
+            writeOctal(header + 100, 8, mode);
+            writeOctal(header + 108, 8, 0); // uid
+            writeOctal(header + 116, 8, 0); // gid
+            writeOctal(header + 124, 12, size > ustarMaxSize ? 0 : size);
+            writeOctal(header + 136, 12, static_cast<std::uint64_t>(std::max<std::time_t>(modificationTime, 0)));
+            header[156] = static_cast<std::byte>(typeFlag);
+            writeString(header + 257, 6, std::string_view{ "ustar", 6 });
+            writeString(header + 263, 2, "00");
+
+            // checksum is computed with its own field filled with spaces
+            std::memset(header + 148, ' ', 8);
+            unsigned checksum{};
+            for (std::size_t i{}; i < blockSize; ++i)
+                checksum += std::to_integer<unsigned>(header[i]);
+            writeOctal(header + 148, 7, checksum);
+        }
+    } // namespace
+
+    std::unique_ptr<ISeekableZipper> createTarZipper(const EntryContainer& entries)
+    {
+        return std::make_unique<TarZipper>(entries);
+    }
+
+    std::uint64_t getTarSize(const EntryContainer& entries)
+    {
+        std::uint64_t size{ zeros.size() };
+        for (const Entry& entry : entries)
+            size += getHeadersSize(entry) + padToBlock(entry.size);
+
+        return size;
+    }
+
+    TarZipper::TarZipper(const EntryContainer& entries)
+        : _entries{ entries }
+        , _readBuffer(_readBufferSize, {})
+    {
+        _layouts.reserve(_entries.size());
+        for (const Entry& entry : _entries)
+        {
+            EntryLayout layout;
+            layout.offset = _totalSize;
+            layout.fileSize = entry.size;
+
+            layout.headersSize = getHeadersSize(entry);
+
+            _layouts.push_back(layout);
+            _totalSize += layout.headersSize + padToBlock(layout.fileSize);
+        }
+
+        _totalSize += zeros.size();
+        _beyondLastByte = _totalSize;
+    }
+
+    std::uint64_t TarZipper::writeSome(std::ostream& output, const WriteBudget& budget)
+    {
+        if (_offset >= _beyondLastByte)
+            return 0;
+
+        while (_currentEntryIndex < _layouts.size() && _offset >= getEntryEnd(_currentEntryIndex))
+            _currentEntryIndex++;
+
+        const std::uint64_t maxSize{ std::min(_beyondLastByte - _offset, static_cast<std::uint64_t>(std::min(budget.maxOutputSize, budget.maxInputSize))) };
+
+        if (_currentEntryIndex == _layouts.size())
+        {
+            const std::uint64_t trailerOffset{ _offset - (_totalSize - zeros.size()) };
+            return write(output, zeros.data() + trailerOffset, std::min(zeros.size() - trailerOffset, maxSize));
+        }
+
+        const EntryLayout& layout{ _layouts[_currentEntryIndex] };
+        const std::uint64_t entryOffset{ _offset - layout.offset };
+
+        if (entryOffset < layout.headersSize)
+        {
+            // open first: the header holds the mode of the file and is not written if the file cannot be read
+            openFile(_currentEntryIndex);
+            const std::vector<std::byte> headers{ createHeaders(_currentEntryIndex) };
+            return write(output, headers.data() + entryOffset, std::min(headers.size() - entryOffset, maxSize));
+        }
+
+        if (entryOffset < layout.headersSize + layout.fileSize)
+        {
+            const std::uint64_t fileOffset{ entryOffset - layout.headersSize };
+            return writeSomeFileData(output, _currentEntryIndex, fileOffset, std::min(layout.fileSize - fileOffset, maxSize));
+        }
+
+        // padding of the file data
+        const std::uint64_t paddingSize{ getEntryEnd(_currentEntryIndex) - _offset };
+        return write(output, zeros.data(), std::min(paddingSize, maxSize));
+    }
+
+    bool TarZipper::isComplete() const
+    {
+        return _offset >= _beyondLastByte;
+    }
+
+    void TarZipper::abort()
+    {
+        FS_LOG(UTILS, DEBUG) << "Aborting tar creation";
+        _currentFile.close();
+        _beyondLastByte = _offset;
+    }
+
+    std::uint64_t TarZipper::getTotalSize() const
+    {
+        return _totalSize;
+    }
+
+    void TarZipper::setRange(std::uint64_t firstByte, std::uint64_t beyondLastByte)
+    {
+        assert(firstByte <= beyondLastByte && beyondLastByte <= _totalSize);
+
+        _offset = firstByte;
+        _beyondLastByte = beyondLastByte;
+
+        // first entry that ends after the offset
+        auto itLayout{ std::upper_bound(std::cbegin(_layouts), std::cend(_layouts), _offset, [](std::uint64_t offset, const EntryLayout& layout) { return offset < layout.offset; }) };
+        _currentEntryIndex = itLayout == std::cbegin(_layouts) ? 0 : std::distance(std::cbegin(_layouts), itLayout) - 1;
+    }
+
+    std::uint64_t TarZipper::getEntryEnd(std::size_t entryIndex) const
+    {
+        const EntryLayout& layout{ _layouts[entryIndex] };
+        return layout.offset + layout.headersSize + padToBlock(layout.fileSize);
+    }
+
+    std::vector<std::byte> TarZipper::createHeaders(std::size_t entryIndex) const
+    {
+        const Entry& entry{ _entries[entryIndex] };
+        const EntryLayout& layout{ _layouts[entryIndex] };
+
+        std::vector<std::byte> headers(layout.headersSize, std::byte{ 0 });
+        std::byte* header{ headers.data() };
+
+        const std::string paxData{ createPaxData(entry.fileName, layout.fileSize) };
+        if (!paxData.empty())
+        {
+            writeUstarHeader(header, paxHeaderName, 0644, paxData.size(), 0, 'x');
+            writeString(header + blockSize, paxData.size(), paxData);
+            header += blockSize + padToBlock(paxData.size());
+        }
+
+        // name is truncated if already set in the pax header
+        writeUstarHeader(header, entry.fileName, entry.mode.value_or(_currentFile.getMode()) & 07777, layout.fileSize, entry.modificationTime.value_or(0), '0');
+
+        return headers;
+    }
+
+    void TarZipper::openFile(std::size_t entryIndex)
+    {
+        if (!_currentFile.isOpen() || _currentFileEntryIndex != entryIndex)
+        {
+            _currentFile.open(_entries[entryIndex]);
+            _currentFileEntryIndex = entryIndex;
+        }
+    }
+
+    std::uint64_t TarZipper::writeSomeFileData(std::ostream& output, std::size_t entryIndex, std::uint64_t fileOffset, std::uint64_t size)
+    {
+        openFile(entryIndex);
+
+        const std::size_t bytesToRead{ static_cast<std::size_t>(std::min(size, static_cast<std::uint64_t>(_readBuffer.size()))) };
+        _currentFile.read(fileOffset, _readBuffer.data(), bytesToRead);
+
+        return write(output, _readBuffer.data(), bytesToRead);
+    }
+
+    std::uint64_t TarZipper::write(std::ostream& output, const std::byte* data, std::size_t size)
+    {
+        output.write(reinterpret_cast<const char*>(data), size);
+        if (!output)
+            throw Exception{ "Failed to write " + std::to_string(size) + " bytes in final archive output!" };
+
+        _offset += size;
+        return size;
+    }
+} // namespace Zip
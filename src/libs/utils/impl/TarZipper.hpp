@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "utils/IZipper.hpp"
+#include "EntryFile.hpp"
+
+namespace Zip
+{
+    // Writes a ustar archive whose layout is computed upfront, so that any range of it can be generated
+    // pax extended headers are used for the names and sizes that do not fit in the ustar header
+    class TarZipper : public ISeekableZipper
+    {
+    public:
+        TarZipper(const EntryContainer& entries);
+        TarZipper(const TarZipper&) = delete;
+        TarZipper& operator=(const TarZipper&) = delete;
+
+    private:
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
+        bool isComplete() const override;
+        void abort() override;
+        std::uint64_t getTotalSize() const override;
+        void setRange(std::uint64_t firstByte, std::uint64_t beyondLastByte) override;
+
+        struct EntryLayout
+        {
+            std::uint64_t offset{}; // of the first header
+            std::uint64_t headersSize{};
+            std::uint64_t fileSize{};
+        };
+
+        std::uint64_t getEntryEnd(std::size_t entryIndex) const;
+        void openFile(std::size_t entryIndex);
+        std::vector<std::byte> createHeaders(std::size_t entryIndex) const;
+        std::uint64_t writeSomeFileData(std::ostream& output, std::size_t entryIndex, std::uint64_t fileOffset, std::uint64_t size);
+        std::uint64_t write(std::ostream& output, const std::byte* data, std::size_t size);
+
+        const EntryContainer _entries;
+        std::vector<EntryLayout> _layouts;
+        std::uint64_t _totalSize{};
+
+        std::uint64_t _offset{};
+        std::uint64_t _beyondLastByte{};
+        std::size_t _currentEntryIndex{};
+
+        static inline constexpr std::size_t _readBufferSize{ 65536 };
+        std::vector<std::byte> _readBuffer;
+
+        EntryFile _currentFile;
+        std::size_t _currentFileEntryIndex{};
+    };
+} // namespace Zip
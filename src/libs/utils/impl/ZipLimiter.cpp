@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ZipLimiter.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/Logger.hpp"
+
+namespace Zip
+{
+    std::unique_ptr<IZipLimiter> createZipLimiter(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount)
+    {
+        return std::make_unique<ZipLimiter>(maxActiveCount, maxMemory, maxQueuedCount);
+    }
+
+    ZipAdmissionQueue::ZipAdmissionQueue(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount)
+        : _maxActiveCount{ maxActiveCount }
+        , _maxMemory{ maxMemory }
+        , _maxQueuedCount{ maxQueuedCount }
+    {
+    }
+
+    std::shared_ptr<ZipAdmissionQueue::Ticket> ZipAdmissionQueue::push(std::size_t memoryCost)
+    {
+        auto ticket{ std::make_shared<Ticket>() };
+        ticket->memoryCost = memoryCost;
+
+        std::scoped_lock lock{ _mutex };
+
+        // FIFO: do not overtake the queued downloads
+        if (_queue.empty() && canAdmit(*ticket))
+        {
+            admit(*ticket);
+            return ticket;
+        }
+
+        if (_maxQueuedCount > 0 && _queue.size() >= _maxQueuedCount)
+        {
+            _rejectedCount++;
+            return nullptr;
+        }
+
+        _queue.push_back(ticket);
+        return ticket;
+    }
+
+    bool ZipAdmissionQueue::isAdmitted(const Ticket& ticket) const
+    {
+        std::scoped_lock lock{ _mutex };
+        return ticket.isAdmitted;
+    }
+
+    bool ZipAdmissionQueue::waitForAdmission(Ticket& ticket, IResourceHandler::DataReadyCallback onAdmitted)
+    {
+        std::scoped_lock lock{ _mutex };
+
+        if (ticket.isAdmitted)
+            return false;
+
+        ticket.onAdmitted = std::move(onAdmitted);
+        return true;
+    }
+
+    void ZipAdmissionQueue::release(const std::shared_ptr<Ticket>& ticket)
+    {
+        std::vector<IResourceHandler::DataReadyCallback> callbacks;
+        {
+            std::scoped_lock lock{ _mutex };
+
+            if (ticket->isAdmitted)
+            {
+                _activeCount--;
+                _usedMemory -= ticket->memoryCost;
+            }
+            else
+            {
+                _queue.erase(std::remove(std::begin(_queue), std::end(_queue), ticket), std::end(_queue));
+            }
+
+            callbacks = admitQueued();
+        }
+
+        for (const IResourceHandler::DataReadyCallback& callback : callbacks)
+            callback();
+    }
+
+    std::size_t ZipAdmissionQueue::getActiveCount() const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _activeCount;
+    }
+
+    std::size_t ZipAdmissionQueue::getQueuedCount() const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _queue.size();
+    }
+
+    std::size_t ZipAdmissionQueue::getUsedMemory() const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _usedMemory;
+    }
+
+    std::uint64_t ZipAdmissionQueue::getRejectedCount() const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _rejectedCount;
+    }
+
+    bool ZipAdmissionQueue::canAdmit(const Ticket& ticket) const
+    {
+        if (_activeCount == 0)
+            return true;
+
+        if (_maxActiveCount > 0 && _activeCount >= _maxActiveCount)
+            return false;
+
+        if (_maxMemory > 0 && _usedMemory + ticket.memoryCost > _maxMemory)
+            return false;
+
+        return true;
+    }
+
+    void ZipAdmissionQueue::admit(Ticket& ticket)
+    {
+        ticket.isAdmitted = true;
+        _activeCount++;
+        _usedMemory += ticket.memoryCost;
+    }
+
+    std::vector<IResourceHandler::DataReadyCallback> ZipAdmissionQueue::admitQueued()
+    {
+        std::vector<IResourceHandler::DataReadyCallback> callbacks;
+
+        while (!_queue.empty() && canAdmit(*_queue.front()))
+        {
+            Ticket& ticket{ *_queue.front() };
+            admit(ticket);
+            if (ticket.onAdmitted)
+                callbacks.push_back(std::exchange(ticket.onAdmitted, {}));
+
+            _queue.pop_front();
+        }
+
+        return callbacks;
+    }
+
+    LimitedResourceHandler::LimitedResourceHandler(std::shared_ptr<ZipAdmissionQueue> queue, std::shared_ptr<ZipAdmissionQueue::Ticket> ticket, ResourceHandlerFactory factory)
+        : _queue{ std::move(queue) }
+        , _ticket{ std::move(ticket) }
+        , _factory{ std::move(factory) }
+    {
+    }
+
+    LimitedResourceHandler::~LimitedResourceHandler()
+    {
+        release();
+    }
+
+    void LimitedResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
+    {
+        if (!_handler)
+        {
+            if (!_ticket || !_queue->isAdmitted(*_ticket))
+                return;
+
+            _handler = std::exchange(_factory, {})();
+        }
+
+        _handler->processRequest(request, response);
+        if (_handler->isComplete())
+            release();
+    }
+
+    bool LimitedResourceHandler::isComplete() const
+    {
+        if (_handler)
+            return _handler->isComplete();
+
+        return _isAborted;
+    }
+
+    void LimitedResourceHandler::abort()
+    {
+        if (_handler)
+            _handler->abort();
+
+        _isAborted = true;
+        release();
+    }
+
+    bool LimitedResourceHandler::waitForData(DataReadyCallback onDataReady)
+    {
+        if (!_handler)
+            return _ticket && _queue->waitForAdmission(*_ticket, std::move(onDataReady));
+
+        return _handler->isAsynchronous() && _handler->waitForData(std::move(onDataReady));
+    }
+
+    void LimitedResourceHandler::release()
+    {
+        if (!_ticket)
+            return;
+
+        _queue->release(_ticket);
+        _ticket.reset();
+    }
+
+    ZipLimiter::ZipLimiter(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount)
+        : _queue{ std::make_shared<ZipAdmissionQueue>(maxActiveCount, maxMemory, maxQueuedCount) }
+    {
+        FS_LOG(UTILS, INFO) << "Archive limits: active = " << maxActiveCount << ", memory = " << maxMemory << " bytes, queued = " << maxQueuedCount << " (0 = unlimited)";
+    }
+
+    std::unique_ptr<IResourceHandler> ZipLimiter::createResourceHandler(std::size_t memoryCost, ResourceHandlerFactory factory)
+    {
+        std::shared_ptr<ZipAdmissionQueue::Ticket> ticket{ _queue->push(memoryCost) };
+        if (!ticket)
+            return nullptr;
+
+        return std::make_unique<LimitedResourceHandler>(_queue, std::move(ticket), std::move(factory));
+    }
+
+    std::size_t ZipLimiter::getActiveCount() const
+    {
+        return _queue->getActiveCount();
+    }
+
+    std::size_t ZipLimiter::getQueuedCount() const
+    {
+        return _queue->getQueuedCount();
+    }
+
+    std::size_t ZipLimiter::getUsedMemory() const
+    {
+        return _queue->getUsedMemory();
+    }
+
+    std::uint64_t ZipLimiter::getRejectedCount() const
+    {
+        return _queue->getRejectedCount();
+    }
+} // namespace Zip
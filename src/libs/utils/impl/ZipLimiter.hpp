@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "utils/IZipLimiter.hpp"
+
+namespace Zip
+{
+    // Shared with the handlers, that may outlive the limiter
+    class ZipAdmissionQueue
+    {
+    public:
+        ZipAdmissionQueue(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount);
+
+        struct Ticket
+        {
+            std::size_t memoryCost{};
+            bool isAdmitted{};
+            IResourceHandler::DataReadyCallback onAdmitted;
+        };
+
+        // Returns nullptr if the queue is full
+        std::shared_ptr<Ticket> push(std::size_t memoryCost);
+        bool isAdmitted(const Ticket& ticket) const;
+        // Returns false if already admitted, otherwise onAdmitted will be called once (from any thread)
+        bool waitForAdmission(Ticket& ticket, IResourceHandler::DataReadyCallback onAdmitted);
+        // Leaves the queue, or frees the slot if admitted
+        void release(const std::shared_ptr<Ticket>& ticket);
+
+        std::size_t getActiveCount() const;
+        std::size_t getQueuedCount() const;
+        std::size_t getUsedMemory() const;
+        std::uint64_t getRejectedCount() const;
+
+    private:
+        bool canAdmit(const Ticket& ticket) const; // must be called with _mutex held
+        void admit(Ticket& ticket);                // must be called with _mutex held
+        std::vector<IResourceHandler::DataReadyCallback> admitQueued(); // must be called with _mutex held
+
+        const std::size_t _maxActiveCount;
+        const std::size_t _maxMemory;
+        const std::size_t _maxQueuedCount;
+
+        mutable std::mutex _mutex;
+        std::deque<std::shared_ptr<Ticket>> _queue;
+        std::size_t _activeCount{};
+        std::size_t _usedMemory{};
+        std::uint64_t _rejectedCount{};
+    };
+
+    // Creates the actual handler once admitted
+    class LimitedResourceHandler final : public IResourceHandler
+    {
+    public:
+        LimitedResourceHandler(std::shared_ptr<ZipAdmissionQueue> queue, std::shared_ptr<ZipAdmissionQueue::Ticket> ticket, ResourceHandlerFactory factory);
+        ~LimitedResourceHandler() override;
+        LimitedResourceHandler(const LimitedResourceHandler&) = delete;
+        LimitedResourceHandler& operator=(const LimitedResourceHandler&) = delete;
+
+    private:
+        void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
+        bool isComplete() const override;
+        void abort() override;
+        bool isAsynchronous() const override { return true; }
+        bool waitForData(DataReadyCallback onDataReady) override;
+
+        void release();
+
+        std::shared_ptr<ZipAdmissionQueue> _queue;
+        std::shared_ptr<ZipAdmissionQueue::Ticket> _ticket; // reset once released
+        ResourceHandlerFactory _factory;
+        std::unique_ptr<IResourceHandler> _handler;
+        bool _isAborted{};
+    };
+
+    class ZipLimiter : public IZipLimiter
+    {
+    public:
+        ZipLimiter(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount);
+        ZipLimiter(const ZipLimiter&) = delete;
+        ZipLimiter& operator=(const ZipLimiter&) = delete;
+
+    private:
+        std::unique_ptr<IResourceHandler> createResourceHandler(std::size_t memoryCost, ResourceHandlerFactory factory) override;
+        std::size_t getActiveCount() const override;
+        std::size_t getQueuedCount() const override;
+        std::size_t getUsedMemory() const override;
+        std::uint64_t getRejectedCount() const override;
+
+        std::shared_ptr<ZipAdmissionQueue> _queue;
+    };
+} // namespace Zip
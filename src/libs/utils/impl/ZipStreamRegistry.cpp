@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ZipStreamRegistry.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+#include "utils/Logger.hpp"
+
+namespace Zip
+{
+    std::unique_ptr<IZipStreamRegistry> createZipStreamRegistry(std::size_t maxBufferSize)
+    {
+        return std::make_unique<ZipStreamRegistry>(maxBufferSize);
+    }
+
+    SharedZipStream::SharedZipStream(ZipperFactory zipperFactory, std::size_t maxBufferSize)
+        : _zipperFactory{ std::move(zipperFactory) }
+        , _maxBufferSize{ maxBufferSize }
+        , _zipper{ _zipperFactory() }
+    {
+    }
+
+    SharedZipStream::~SharedZipStream()
+    {
+        if (_zipper && !_zipper->isComplete())
+            _zipper->abort();
+    }
+
+    std::optional<std::uint64_t> SharedZipStream::read(std::uint64_t offset, std::ostream& output, std::size_t maxSize)
+    {
+        while (true)
+        {
+            {
+                std::scoped_lock lock{ _mutex };
+
+                if (offset < _bufferOffset)
+                    return std::nullopt;
+
+                if (offset < _bufferOffset + _bufferSize)
+                {
+                    // copy the remaining part of the chunk containing offset, within maxSize
+                    std::uint64_t chunkOffset{ _bufferOffset };
+                    for (const std::string& chunk : _chunks)
+                    {
+                        if (offset < chunkOffset + chunk.size())
+                        {
+                            const std::size_t offsetInChunk{ static_cast<std::size_t>(offset - chunkOffset) };
+                            const std::size_t size{ std::min(chunk.size() - offsetInChunk, maxSize) };
+                            output.write(chunk.data() + offsetInChunk, size);
+                            if (!output)
+                                throw Exception{ "Failed to write " + std::to_string(size) + " bytes in final archive output!" };
+
+                            return size;
+                        }
+                        chunkOffset += chunk.size();
+                    }
+                    assert(false);
+                }
+
+                if (_error)
+                    throw Exception{ *_error };
+
+                if (_isComplete)
+                    return 0;
+            }
+
+            produce(offset);
+        }
+    }
+
+    bool SharedZipStream::isComplete(std::uint64_t offset) const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _isComplete && offset == _bufferOffset + _bufferSize;
+    }
+
+    bool SharedZipStream::canAttach() const
+    {
+        std::scoped_lock lock{ _mutex };
+        return _bufferOffset == 0 && !_error;
+    }
+
+    void SharedZipStream::produce(std::uint64_t offset)
+    {
+        std::scoped_lock producerLock{ _producerMutex };
+
+        {
+            std::scoped_lock lock{ _mutex };
+
+            // another reader may have produced the data in the meantime
+            if (offset < _bufferOffset + _bufferSize || _isComplete || _error)
+                return;
+        }
+
+        std::ostringstream oss;
+        std::optional<std::string> error;
+        try
+        {
+            _zipper->writeSome(oss, WriteBudget{});
+        }
+        catch (const Exception& e)
+        {
+            error = e.what();
+        }
+
+        std::string chunk{ oss.str() };
+        const bool isComplete{ _zipper->isComplete() };
+
+        std::scoped_lock lock{ _mutex };
+
+        _error = std::move(error);
+        _isComplete = isComplete;
+        if (chunk.empty())
+            return;
+
+        _bufferSize += chunk.size();
+        _chunks.push_back(std::move(chunk));
+
+        // drop the oldest data: readers still needing it will have to detach
+        while (_bufferSize > _maxBufferSize && _chunks.size() > 1)
+        {
+            _bufferOffset += _chunks.front().size();
+            _bufferSize -= _chunks.front().size();
+            _chunks.pop_front();
+        }
+    }
+
+    SharedZipReader::SharedZipReader(std::shared_ptr<SharedZipStream> stream)
+        : _stream{ std::move(stream) }
+    {
+    }
+
+    std::uint64_t SharedZipReader::writeSome(std::ostream& output, const WriteBudget& budget)
+    {
+        if (_stream)
+        {
+            const std::optional<std::uint64_t> bytesWritten{ _stream->read(_offset, output, budget.maxOutputSize) };
+            if (bytesWritten)
+            {
+                _offset += *bytesWritten;
+                return *bytesWritten;
+            }
+
+            detach();
+        }
+
+        return writeSomeDetached(output, budget);
+    }
+
+    bool SharedZipReader::isComplete() const
+    {
+        if (_stream)
+            return _stream->isComplete(_offset);
+
+        return !_detachedZipper || _detachedZipper->isComplete();
+    }
+
+    void SharedZipReader::abort()
+    {
+        if (_detachedZipper)
+            _detachedZipper->abort();
+
+        _detachedZipper.reset();
+        _stream.reset();
+    }
+
+    void SharedZipReader::detach()
+    {
+        FS_LOG(UTILS, DEBUG) << "Reader too slow, detaching from shared zip stream at offset " << _offset;
+
+        _detachedZipper = _stream->getZipperFactory()();
+        _bytesToSkip = _offset;
+        _stream.reset();
+    }
+
+    std::uint64_t SharedZipReader::writeSomeDetached(std::ostream& output, const WriteBudget& budget)
+    {
+        assert(_detachedZipper);
+
+        if (_bytesToSkip == 0)
+        {
+            const std::uint64_t bytesWritten{ _detachedZipper->writeSome(output, budget) };
+            _offset += bytesWritten;
+            return bytesWritten;
+        }
+
+        // regenerate the data already sent, one chunk at a time so as not to hold the caller too long
+        std::ostringstream oss;
+        _detachedZipper->writeSome(oss, WriteBudget{ static_cast<std::size_t>(std::min<std::uint64_t>(_bytesToSkip, budget.maxInputSize)), budget.maxInputSize });
+        const std::string chunk{ oss.str() };
+        if (chunk.size() <= _bytesToSkip)
+        {
+            _bytesToSkip -= chunk.size();
+            return 0;
+        }
+
+        const std::size_t size{ static_cast<std::size_t>(chunk.size() - _bytesToSkip) };
+        output.write(chunk.data() + _bytesToSkip, size);
+        if (!output)
+            throw Exception{ "Failed to write " + std::to_string(size) + " bytes in final archive output!" };
+
+        _bytesToSkip = 0;
+        _offset += size;
+        return size;
+    }
+
+    ZipStreamRegistry::ZipStreamRegistry(std::size_t maxBufferSize)
+        : _maxBufferSize{ maxBufferSize }
+    {
+    }
+
+    std::unique_ptr<IZipper> ZipStreamRegistry::createZipper(const std::string& key, ZipperFactory zipperFactory)
+    {
+        std::scoped_lock lock{ _mutex };
+
+        for (auto it{ std::begin(_streams) }; it != std::end(_streams);)
+        {
+            if (it->second.expired())
+                it = _streams.erase(it);
+            else
+                ++it;
+        }
+
+        std::shared_ptr<SharedZipStream> stream;
+        if (auto it{ _streams.find(key) }; it != std::cend(_streams))
+            stream = it->second.lock();
+
+        if (stream && stream->canAttach())
+        {
+            FS_LOG(UTILS, DEBUG) << "Attaching to shared zip stream '" << key << "'";
+        }
+        else
+        {
+            stream = std::make_shared<SharedZipStream>(std::move(zipperFactory), _maxBufferSize);
+            _streams[key] = stream;
+        }
+
+        return std::make_unique<SharedZipReader>(std::move(stream));
+    }
+} // namespace Zip
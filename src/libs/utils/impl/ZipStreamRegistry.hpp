@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "utils/IZipStreamRegistry.hpp"
+
+namespace Zip
+{
+    // Single zip output, produced on demand by the readers that reached its end
+    class SharedZipStream
+    {
+    public:
+        SharedZipStream(ZipperFactory zipperFactory, std::size_t maxBufferSize);
+        ~SharedZipStream();
+        SharedZipStream(const SharedZipStream&) = delete;
+        SharedZipStream& operator=(const SharedZipStream&) = delete;
+
+        // Returns std::nullopt if the data at offset has been dropped from the buffer
+        std::optional<std::uint64_t> read(std::uint64_t offset, std::ostream& output, std::size_t maxSize);
+        bool isComplete(std::uint64_t offset) const;
+        bool canAttach() const;
+        const ZipperFactory& getZipperFactory() const { return _zipperFactory; }
+
+    private:
+        void produce(std::uint64_t offset);
+
+        const ZipperFactory _zipperFactory;
+        const std::size_t _maxBufferSize;
+
+        std::mutex _producerMutex;
+        std::unique_ptr<IZipper> _zipper; // protected by _producerMutex
+
+        mutable std::mutex _mutex;
+        std::deque<std::string> _chunks;
+        std::uint64_t _bufferOffset{}; // stream offset of the first buffered byte
+        std::uint64_t _bufferSize{};
+        bool _isComplete{};
+        std::optional<std::string> _error;
+    };
+
+    class SharedZipReader : public IZipper
+    {
+    public:
+        SharedZipReader(std::shared_ptr<SharedZipStream> stream);
+
+    private:
+        std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) override;
+        bool isComplete() const override;
+        void abort() override;
+
+        void detach();
+        std::uint64_t writeSomeDetached(std::ostream& output, const WriteBudget& budget);
+
+        std::shared_ptr<SharedZipStream> _stream;
+        std::unique_ptr<IZipper> _detachedZipper;
+        std::uint64_t _offset{};
+        std::uint64_t _bytesToSkip{};
+    };
+
+    class ZipStreamRegistry : public IZipStreamRegistry
+    {
+    public:
+        ZipStreamRegistry(std::size_t maxBufferSize);
+
+    private:
+        std::unique_ptr<IZipper> createZipper(const std::string& key, ZipperFactory zipperFactory) override;
+
+        const std::size_t _maxBufferSize;
+
+        std::mutex _mutex;
+        std::unordered_map<std::string, std::weak_ptr<SharedZipStream>> _streams;
+    };
+} // namespace Zip
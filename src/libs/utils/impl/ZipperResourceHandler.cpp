@@ -19,6 +19,8 @@
 
 #include "ZipperResourceHandler.hpp"
 
+#include <sstream>
+
 #include "utils/Logger.hpp"
 
 std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper)
@@ -26,16 +28,38 @@ std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zi
     return std::make_unique<ZipperResourceHandler>(std::move(zipper));
 }
 
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper)
+{
+    return std::make_unique<ZipperResourceHandler>(std::move(zipper));
+}
+
 ZipperResourceHandler::ZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper)
     : _zipper{ std::move(zipper) }
 {
 }
 
+ZipperResourceHandler::ZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper)
+    : _seekableZipper{ zipper.get() }
+{
+    _zipper = std::move(zipper);
+}
+
 void ZipperResourceHandler::processRequest(const Wt::Http::Request& request, Wt::Http::Response& response)
 {
     try
     {
-        _zipper->writeSome(response.out());
+        if (_seekableZipper)
+        {
+            const bool rangeSatisfiable{ setupZipperRange(*_seekableZipper, request, response) };
+            _seekableZipper = nullptr;
+            if (!rangeSatisfiable)
+            {
+                _zipper.reset();
+                return;
+            }
+        }
+
+        _zipper->writeSome(response.out(), Zip::WriteBudget{});
     }
     catch (const Zip::Exception& e)
     {
@@ -57,3 +81,43 @@ void ZipperResourceHandler::abort()
     _zipper->abort();
     _zipper.reset();
 }
+
+bool setupZipperRange(Zip::ISeekableZipper& zipper, const Wt::Http::Request& request, Wt::Http::Response& response)
+{
+    const std::uint64_t totalSize{ zipper.getTotalSize() };
+
+    const Wt::Http::Request::ByteRangeSpecifier ranges{ request.getRanges(totalSize) };
+    if (!ranges.isSatisfiable())
+    {
+        std::ostringstream contentRange;
+        contentRange << "bytes */" << totalSize;
+        response.setStatus(416); // Requested range not satisfiable
+        response.addHeader("Content-Range", contentRange.str());
+
+        FS_LOG(UTILS, DEBUG) << "Range not satisfiable";
+        return false;
+    }
+
+    if (ranges.size() == 1)
+    {
+        FS_LOG(UTILS, DEBUG) << "Range requested = " << ranges[0].firstByte() << "/" << ranges[0].lastByte();
+
+        const std::uint64_t firstByte{ ranges[0].firstByte() };
+        const std::uint64_t beyondLastByte{ ranges[0].lastByte() + 1 };
+
+        std::ostringstream contentRange;
+        contentRange << "bytes " << firstByte << "-" << beyondLastByte - 1 << "/" << totalSize;
+
+        response.setStatus(206);
+        response.addHeader("Content-Range", contentRange.str());
+        response.setContentLength(beyondLastByte - firstByte);
+
+        zipper.setRange(firstByte, beyondLastByte);
+    }
+    else
+    {
+        response.setContentLength(totalSize);
+    }
+
+    return true;
+}
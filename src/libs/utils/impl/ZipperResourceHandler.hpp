@@ -24,10 +24,14 @@
 #include "utils/IResourceHandler.hpp"
 #include "utils/IZipper.hpp"
 
+// Sets up the response headers and the zipper range, returns false if the requested range is not satisfiable
+bool setupZipperRange(Zip::ISeekableZipper& zipper, const Wt::Http::Request& request, Wt::Http::Response& response);
+
 class ZipperResourceHandler final : public IResourceHandler
 {
 public:
     ZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper);
+    ZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper);
 
 private:
     void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) override;
@@ -35,4 +39,5 @@ private:
     void abort() override;
 
     std::unique_ptr<Zip::IZipper> _zipper;
+    Zip::ISeekableZipper* _seekableZipper{}; // set if the zipper is seekable, until the range is set up
 };
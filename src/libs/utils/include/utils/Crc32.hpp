@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// CRC-32 as used by zip/gzip (reflected 0x04C11DB7 polynomial)
+// Uses PCLMUL (x86_64) or CRC32 (ARMv8) instructions if available at runtime
+namespace Crc32
+{
+    using Value = std::uint32_t;
+
+    // Start with crc = 0, feed the previous result to continue the computation
+    Value update(Value crc, const std::byte* data, std::size_t size);
+
+    // throws FsException on IO error
+    Value computeFromFile(const std::filesystem::path& path);
+} // namespace Crc32
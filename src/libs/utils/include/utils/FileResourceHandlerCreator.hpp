@@ -22,6 +22,15 @@
 #include <filesystem>
 #include <memory>
 
+#include "utils/IFileCache.hpp"
 #include "utils/IResourceHandler.hpp"
 
+class IAsyncFileReader;
+
 std::unique_ptr<IResourceHandler> createFileResourceHandler(const std::filesystem::path& path);
+
+// Reads ahead with the asynchronous reader, falls back to synchronous reads if all its buffers are in use
+std::unique_ptr<IResourceHandler> createFileResourceHandler(const std::filesystem::path& path, IAsyncFileReader& reader);
+
+// Serves a file content from memory
+std::unique_ptr<IResourceHandler> createFileResourceHandler(IFileCache::Content content);
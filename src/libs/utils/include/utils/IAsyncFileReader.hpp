@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+
+// Asynchronous file reads into a pool of buffers registered once with the kernel
+// Thread safe, completion handlers are called from the reader's own thread
+class IAsyncFileReader
+{
+public:
+    virtual ~IAsyncFileReader() = default;
+
+    struct Buffer
+    {
+        std::byte* data{};
+        std::size_t size{};
+        unsigned index{};
+    };
+
+    // Returns std::nullopt if all the buffers are in use
+    virtual std::optional<Buffer> acquireBuffer() = 0;
+    virtual void releaseBuffer(const Buffer& buffer) = 0;
+
+    // result is the number of bytes read (maybe less than size, 0 at end of file), or -errno
+    using CompletionHandler = std::function<void(int result)>;
+
+    // fd and buffer must be kept valid until the completion handler is called
+    virtual void read(int fd, std::uint64_t offset, const Buffer& buffer, std::size_t size, CompletionHandler onComplete) = 0;
+};
+
+// Returns nullptr if io_uring is not available (not built in, or refused by the kernel)
+std::unique_ptr<IAsyncFileReader> createIoUringFileReader(std::size_t bufferCount, std::size_t bufferSize);
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "utils/IResourceHandler.hpp"
+
+// Slot of an admitted download, released once destroyed
+class DownloadAdmission
+{
+public:
+    virtual ~DownloadAdmission() = default;
+};
+
+// Limits the downloads streamed at once, globally and per client address
+// Data of the admitted downloads is produced by a limited number of HTTP threads at once, the others being kept for the UI
+// When these threads are busy, waiting chunks are scheduled by deficit round robin between the flows, on the time spent producing them
+// Downloads whose client stops reading, or reads too slowly, are evicted by a sweeper: their handler is aborted and destroyed
+// Thread safe
+class IDownloadLimiter
+{
+public:
+    virtual ~IDownloadLimiter() = default;
+
+    // Returns nullptr if the server or the client already has too many downloads
+    virtual std::unique_ptr<DownloadAdmission> admit(std::string_view clientAddress) = 0;
+    // The admission is kept along with the handler. Handlers of the same flow share the same part of the threads
+    virtual std::unique_ptr<IResourceHandler> createResourceHandler(std::unique_ptr<DownloadAdmission> admission, std::string_view flow, std::unique_ptr<IResourceHandler> handler) = 0;
+
+    virtual std::size_t getActiveCount() const = 0;
+    virtual std::uint64_t getAdmittedCount() const = 0;
+    virtual std::uint64_t getRejectedCount() const = 0;       // server limit reached
+    virtual std::uint64_t getClientRejectedCount() const = 0; // client limit reached
+    virtual std::uint64_t getDeferredCount() const = 0;       // data production delayed to keep threads for the UI
+    virtual std::uint64_t getIdleEvictedCount() const = 0;
+    virtual std::uint64_t getSlowEvictedCount() const = 0;
+};
+
+struct DownloadLimits
+{
+    // 0 means no limit
+    std::size_t maxActiveCount{};
+    std::size_t maxActivePerClientCount{};
+    std::size_t maxProcessingCount{}; // HTTP threads producing download data at once
+    std::chrono::microseconds schedulingQuantum{ 1000 }; // time given to a flow at each round
+    std::uint64_t asyncProductionRate{}; // bytes per second charged to the asynchronous handlers (0 to charge time only)
+
+    // Eviction of the stalled downloads, 0 to disable
+    // Time spent waiting for our own data (disk, compression, threads) is not held against the clients
+    std::chrono::seconds idleTimeout{};   // client not reading anything
+    std::uint64_t minRate{};              // bytes per second, averaged over minRatePeriod
+    std::chrono::seconds minRatePeriod{};
+};
+std::unique_ptr<IDownloadLimiter> createDownloadLimiter(const DownloadLimits& limits);
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Contents of small files kept in memory within a byte budget, least recently used evicted first
+// Thread safe. Contents are shared: evicted ones stay alive while being served
+class IFileCache
+{
+public:
+    virtual ~IFileCache() = default;
+
+    using Content = std::shared_ptr<const std::vector<std::byte>>;
+
+    // The key must change whenever the file content may have changed
+    // Loads the file on a miss. Returns nullptr if the file is too large to be cached or cannot be read
+    virtual Content getContent(const std::string& key, const std::filesystem::path& path, std::uint64_t fileSize) = 0;
+
+    virtual std::uint64_t getHitCount() const = 0;
+    virtual std::uint64_t getMissCount() const = 0;
+    virtual std::uint64_t getSavedReadBytes() const = 0; // served from memory instead of being read from disk
+    virtual std::size_t getUsedSize() const = 0;
+};
+
+std::unique_ptr<IFileCache> createFileCache(std::size_t maxSize, std::size_t maxFileSize);
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Values exposed by the metrics resource, in the Prometheus text format
+// Getters are called from the HTTP threads, they must be thread safe
+class IMetrics
+{
+public:
+    virtual ~IMetrics() = default;
+
+    using ValueGetter = std::function<std::uint64_t()>;
+
+    // Current value, may go up and down
+    virtual void addGauge(const std::string& name, const std::string& help, ValueGetter getter) = 0;
+    // Total since startup
+    virtual void addCounter(const std::string& name, const std::string& help, ValueGetter getter) = 0;
+
+    virtual void write(std::ostream& output) const = 0;
+};
+
+std::unique_ptr<IMetrics> createMetrics();
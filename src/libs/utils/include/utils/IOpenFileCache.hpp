@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+
+// Read only file descriptor, closed on destruction
+class OpenedFile
+{
+public:
+    explicit OpenedFile(int fd)
+        : _fd{ fd } {}
+    ~OpenedFile();
+    OpenedFile(const OpenedFile&) = delete;
+    OpenedFile& operator=(const OpenedFile&) = delete;
+
+    int getFd() const { return _fd; }
+
+private:
+    const int _fd;
+};
+
+// Files opened once and shared by the concurrent downloads (parallel range requests), closed after being idle for a while
+// Entries are keyed by path and only used while the path still leads to the inode they were opened on (checked with a stat on each open)
+// Thread safe. Opened files stay valid while used, even once invalidated
+class IOpenFileCache
+{
+public:
+    virtual ~IOpenFileCache() = default;
+
+    virtual std::shared_ptr<const OpenedFile> open(const std::filesystem::path& path, std::error_code& ec) = 0;
+
+    // To be called when the file is removed or replaced
+    virtual void invalidate(const std::filesystem::path& path) = 0;
+
+    virtual std::uint64_t getHitCount() const = 0;
+    virtual std::uint64_t getMissCount() const = 0;
+    virtual std::size_t getOpenedCount() const = 0;
+};
+
+std::unique_ptr<IOpenFileCache> createOpenFileCache(std::size_t maxCount, std::chrono::seconds idleTimeout);
+
+// Uses the IOpenFileCache service if any
+std::shared_ptr<const OpenedFile> openFile(const std::filesystem::path& path, std::error_code& ec);
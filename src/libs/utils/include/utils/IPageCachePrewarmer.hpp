@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace PageCache
+{
+    // Reads ahead, in the background, the beginning of files that are likely to be downloaded soon (POSIX_FADV_WILLNEED)
+    // Files already in the page cache are skipped, and the bytes read ahead are limited by a global budget
+    // Thread safe
+    class IPrewarmer
+    {
+    public:
+        virtual ~IPrewarmer() = default;
+
+        // Does nothing if the same key has been prewarmed recently, or if too many prewarms are pending
+        virtual void prewarm(std::string_view key, std::vector<std::filesystem::path> files) = 0;
+
+        virtual std::uint64_t getPrewarmedBytes() const = 0;
+        virtual std::uint64_t getHotSkippedCount() const = 0;       // files already in the page cache
+        virtual std::uint64_t getBudgetExhaustedCount() const = 0; // files not prewarmed to stay within the budget
+    };
+
+    // maxFileSize: bytes read ahead at the beginning of each file
+    // budget: bytes read ahead per minute, for all the files
+    std::unique_ptr<IPrewarmer> createPrewarmer(std::uint64_t maxFileSize, std::uint64_t budget);
+} // namespace PageCache
@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include <Wt/Http/Request.h>
 #include <Wt/Http/Response.h>
 
@@ -31,4 +33,11 @@ public:
     virtual void processRequest(const Wt::Http::Request& request, Wt::Http::Response& response) = 0;
     [[nodiscard]] virtual bool isComplete() const = 0;
     virtual void abort() = 0;
+
+    using DataReadyCallback = std::function<void()>;
+
+    // Asynchronous handlers produce their data in the background: the continuation must wait for it
+    [[nodiscard]] virtual bool isAsynchronous() const { return false; }
+    // Returns false if some data is already ready, otherwise onDataReady will be called once (from any thread)
+    [[nodiscard]] virtual bool waitForData(DataReadyCallback onDataReady) { return false; }
 };
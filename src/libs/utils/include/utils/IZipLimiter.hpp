@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "utils/IResourceHandler.hpp"
+
+namespace Zip
+{
+    using ResourceHandlerFactory = std::function<std::unique_ptr<IResourceHandler>()>;
+
+    // Limits the number of archives produced at once and the memory they use
+    // Other downloads wait in a FIFO queue: their handler is only created once admitted
+    class IZipLimiter
+    {
+    public:
+        virtual ~IZipLimiter() = default;
+
+        // Returns nullptr if the queue is full
+        // memoryCost is an estimate of the memory used by the handler while producing the archive
+        virtual std::unique_ptr<IResourceHandler> createResourceHandler(std::size_t memoryCost, ResourceHandlerFactory factory) = 0;
+
+        virtual std::size_t getActiveCount() const = 0;
+        virtual std::size_t getQueuedCount() const = 0;
+        virtual std::size_t getUsedMemory() const = 0;
+        virtual std::uint64_t getRejectedCount() const = 0;
+    };
+
+    // 0 means no limit. A single download is always admitted, even if it exceeds maxMemory
+    std::unique_ptr<IZipLimiter> createZipLimiter(std::size_t maxActiveCount, std::size_t maxMemory, std::size_t maxQueuedCount);
+} // namespace Zip
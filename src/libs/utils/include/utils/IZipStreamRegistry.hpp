@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "utils/IZipper.hpp"
+
+namespace Zip
+{
+    using ZipperFactory = std::function<std::unique_ptr<IZipper>()>;
+
+    // Coalesces the concurrent downloads of the same archive: readers attach to a single
+    // producer that writes into a bounded buffer. Readers falling too far behind detach
+    // onto their own zipper and skip the bytes they already sent (the output is deterministic)
+    class IZipStreamRegistry
+    {
+    public:
+        virtual ~IZipStreamRegistry() = default;
+
+        // key must identify the archive contents and options
+        virtual std::unique_ptr<IZipper> createZipper(const std::string& key, ZipperFactory zipperFactory) = 0;
+    };
+
+    std::unique_ptr<IZipStreamRegistry> createZipStreamRegistry(std::size_t maxBufferSize);
+} // namespace Zip
@@ -19,8 +19,12 @@
 
 #pragma once
 
+#include <cstdint>
+#include <ctime>
 #include <filesystem>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "Exception.hpp"
@@ -31,6 +35,10 @@ namespace Zip
     {
         std::string fileName;
         std::filesystem::path filePath;
+        std::uint64_t size{};                          // checked when the file is opened
+        std::optional<std::uint32_t> mode{};           // permission bits, those of the file if not set
+        std::optional<std::time_t> modificationTime{}; // archive default date if not set
+        std::optional<std::uint32_t> crc32;            // precomputed, if available
     };
     using EntryContainer = std::vector<Entry>;
 
@@ -39,15 +47,65 @@ namespace Zip
         using FsException::FsException;
     };
 
+    // Limits the work done by a single writeSome call
+    struct WriteBudget
+    {
+        std::size_t maxOutputSize{ 65536 };  // bytes written in the output, extra data is kept for the next calls
+        std::size_t maxInputSize{ 262144 }; // bytes read from the files
+    };
+
     class IZipper
     {
     public:
         virtual ~IZipper() = default;
 
-        virtual std::uint64_t writeSome(std::ostream& output) = 0;
+        // May return 0 before completion, if the input budget is exhausted before any output is available
+        virtual std::uint64_t writeSome(std::ostream& output, const WriteBudget& budget) = 0;
         virtual bool isComplete() const = 0;
         virtual void abort() = 0;
     };
 
-    std::unique_ptr<IZipper> createArchiveZipper(const EntryContainer& entries);
+    // Zipper whose output size is known in advance and that can start writing at any offset
+    class ISeekableZipper : public IZipper
+    {
+    public:
+        virtual std::uint64_t getTotalSize() const = 0;
+
+        // Subsequent writes only output the bytes in [firstByte, beyondLastByte)
+        virtual void setRange(std::uint64_t firstByte, std::uint64_t beyondLastByte) = 0;
+    };
+
+    enum class Compression
+    {
+        Deflate,
+        Store,
+    };
+
+    std::unique_ptr<IZipper> createArchiveZipper(const EntryContainer& entries, Compression compression = Compression::Deflate);
+
+    // Minimal zip writer for stored entries, copying the file data as is (no libarchive round trip)
+    // Precomputed CRCs are used if available, otherwise CRCs are computed on the fly and written in data descriptors
+    // ZIP64 extensions are used when needed (large entries or archives, many entries)
+    // Entries it cannot encode (empty, too long or non UTF-8 names, modes with more than permission bits) must use createArchiveZipper
+    bool canUseStoreZipper(const EntryContainer& entries);
+    std::unique_ptr<IZipper> createStoreZipper(const EntryContainer& entries);
+
+    // Uncompressed tar (ustar, with pax extended headers for long names and large files)
+    std::unique_ptr<ISeekableZipper> createTarZipper(const EntryContainer& entries);
+    std::uint64_t getTarSize(const EntryContainer& entries); // without opening the files
+
+    // Zstandard compressed tar, using up to threadCount compression threads
+    std::unique_ptr<IZipper> createTarZstdZipper(const EntryContainer& entries, unsigned threadCount);
+
+    // Compressions of a single stream, as used by HTTP content encodings
+    enum class StreamCompression
+    {
+        Gzip,
+        Zstd,
+    };
+
+    // Data of a single file compressed as a stream (no archive format), level 0 meaning the default one
+    // onComplete is called with the file size and the compressed size once the whole stream is written
+    using StreamCompressionCallback = std::function<void(std::uint64_t inputSize, std::uint64_t outputSize)>;
+    std::unique_ptr<IZipper> createCompressedFileZipper(const Entry& entry, StreamCompression compression, int level, StreamCompressionCallback onComplete = {});
 } // namespace Zip
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Page cache usage of the files being served
+namespace PageCache
+{
+    struct Settings
+    {
+        std::uint64_t dropBehindMinFileSize{}; // files at least this large are dropped from the page cache once read, 0 to disable
+        std::uint64_t probeMaxFileSize{};      // files up to this size are checked for residency when opened, 0 to disable
+    };
+
+    // Must be called before serving files
+    void setSettings(const Settings& settings);
+
+    // Totals since startup, thread safe
+    std::uint64_t getProbedBytes();   // size of the probed files
+    std::uint64_t getResidentBytes(); // part of the probed files already in the page cache
+    std::uint64_t getDroppedBytes();  // dropped from the page cache after being read
+} // namespace PageCache
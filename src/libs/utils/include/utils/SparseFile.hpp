@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Sparse files support, relies on lseek(SEEK_DATA/SEEK_HOLE) and fallocate(FALLOC_FL_PUNCH_HOLE)
+// Files on file systems that do not support them are handled as fully allocated files
+namespace SparseFile
+{
+    // Deallocates the zero filled blocks of a file, keeping its size and content
+    // Returns the number of deallocated bytes, throws FsException on IO error
+    std::uint64_t sparsify(const std::filesystem::path& path);
+
+    // Totals since startup, thread safe
+    std::uint64_t getSkippedReadBytes(); // holes served without reading them
+    std::uint64_t getDeallocatedBytes(); // by sparsify
+} // namespace SparseFile
@@ -19,9 +19,22 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 
 #include "utils/IResourceHandler.hpp"
 #include "utils/IZipper.hpp"
 
+namespace Wt
+{
+    class WIOService;
+}
+
 std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper);
+
+// Also sets the content length and serves range requests
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper);
+
+// Zippers run on the workers, filling a buffer of bufferSize bytes ahead of the network
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::IZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize);
+std::unique_ptr<IResourceHandler> createZipperResourceHandler(std::unique_ptr<Zip::ISeekableZipper> zipper, Wt::WIOService& workers, std::size_t bufferSize);
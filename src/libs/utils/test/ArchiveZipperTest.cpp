@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "utils/IZipper.hpp"
+#include "TestCorpus.hpp"
+#include "ZipChecker.hpp"
+
+namespace Zip::tests
+{
+    class ArchiveZipperTest : public ::testing::TestWithParam<std::tuple<Compression, WriteBudget>>
+    {
+    protected:
+        TestDirectory _directory;
+    };
+
+    TEST_P(ArchiveZipperTest, corpus)
+    {
+        const auto [compression, budget] = GetParam();
+
+        const EntryContainer entries{ generateCorpus(_directory.getPath() / "corpus") };
+        const std::filesystem::path zipPath{ _directory.getPath() / "corpus.zip" };
+
+        writeArchive(*createArchiveZipper(entries, compression), zipPath, budget);
+        checkZip(entries, zipPath);
+    }
+
+    INSTANTIATE_TEST_SUITE_P(CompressionsAndBudgets, ArchiveZipperTest,
+        ::testing::Combine(
+            ::testing::Values(Compression::Deflate, Compression::Store),
+            ::testing::Values(WriteBudget{}, WriteBudget{ 100, 100 })));
+} // namespace Zip::tests
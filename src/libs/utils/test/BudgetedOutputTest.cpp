@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utils/IZipper.hpp"
+#include "BudgetedOutput.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        void write(BudgetedOutput& output, std::string_view data)
+        {
+            output.write(reinterpret_cast<const std::byte*>(data.data()), data.size());
+        }
+    } // namespace
+
+    TEST(BudgetedOutput, withinBudget)
+    {
+        BudgetedOutput output;
+        std::ostringstream stream;
+
+        output.open(stream, 10);
+        write(output, "abc");
+        write(output, "defg");
+        EXPECT_EQ(output.getBytesWritten(), 7u);
+        EXPECT_FALSE(output.hasPendingData());
+        output.close();
+
+        EXPECT_EQ(stream.str(), "abcdefg");
+    }
+
+    TEST(BudgetedOutput, overflowIsKeptForTheNextCalls)
+    {
+        BudgetedOutput output;
+        std::ostringstream stream;
+
+        output.open(stream, 4);
+        write(output, "abcdef");
+        write(output, "gh"); // must follow the pending data
+        EXPECT_EQ(output.getBytesWritten(), 4u);
+        EXPECT_TRUE(output.hasPendingData());
+        output.close();
+        EXPECT_EQ(stream.str(), "abcd");
+
+        output.open(stream, 3);
+        EXPECT_EQ(output.getBytesWritten(), 3u);
+        EXPECT_TRUE(output.hasPendingData());
+        output.close();
+        EXPECT_EQ(stream.str(), "abcdefg");
+
+        output.open(stream, 3);
+        EXPECT_EQ(output.getBytesWritten(), 1u);
+        EXPECT_FALSE(output.hasPendingData());
+        write(output, "ij");
+        EXPECT_EQ(output.getBytesWritten(), 3u);
+        output.close();
+        EXPECT_EQ(stream.str(), "abcdefghij");
+    }
+
+    TEST(BudgetedOutput, discardPendingData)
+    {
+        BudgetedOutput output;
+        std::ostringstream stream;
+
+        output.open(stream, 2);
+        write(output, "abcdef");
+        output.close();
+
+        output.discardPendingData();
+        EXPECT_FALSE(output.hasPendingData());
+
+        output.open(stream, 2);
+        EXPECT_EQ(output.getBytesWritten(), 0u);
+        write(output, "gh");
+        output.close();
+        EXPECT_EQ(stream.str(), "abgh");
+    }
+
+    TEST(BudgetedOutput, failedStream)
+    {
+        BudgetedOutput output;
+        std::ostringstream stream;
+        stream.setstate(std::ios::badbit);
+
+        output.open(stream, 10);
+        EXPECT_THROW(write(output, "abc"), Exception);
+    }
+
+    // Random writes and budgets: whole data in order, never more than the budget per call
+    TEST(BudgetedOutput, random)
+    {
+        std::mt19937 generator{ 42 };
+        std::uniform_int_distribution<std::size_t> sizeDistribution{ 0, 1000 };
+        std::uniform_int_distribution<int> charDistribution{ 'a', 'z' };
+
+        BudgetedOutput output;
+        std::ostringstream stream;
+        std::string expected;
+
+        for (std::size_t i{}; i < 1000 || output.hasPendingData(); ++i)
+        {
+            const std::size_t budget{ sizeDistribution(generator) };
+            output.open(stream, budget);
+            if (i < 1000)
+            {
+                std::string data(sizeDistribution(generator), ' ');
+                for (char& c : data)
+                    c = static_cast<char>(charDistribution(generator));
+
+                write(output, data);
+                expected += data;
+            }
+
+            ASSERT_LE(output.getBytesWritten(), budget);
+            output.close();
+        }
+
+        EXPECT_EQ(stream.str(), expected);
+    }
+} // namespace Zip::tests
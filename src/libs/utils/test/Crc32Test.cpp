@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "utils/Crc32.hpp"
+#include "utils/Exception.hpp"
+#include "TestCorpus.hpp"
+
+namespace Crc32::tests
+{
+    namespace
+    {
+        // Bitwise reference implementation
+        Value computeReference(const std::byte* data, std::size_t size)
+        {
+            Value crc{ 0xFFFFFFFF };
+            for (std::size_t i{}; i < size; ++i)
+            {
+                crc ^= static_cast<Value>(data[i]);
+                for (int bit{}; bit < 8; ++bit)
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+            }
+            return ~crc;
+        }
+
+        Value compute(std::string_view str)
+        {
+            return update(0, reinterpret_cast<const std::byte*>(str.data()), str.size());
+        }
+
+        std::vector<std::byte> generateData(std::size_t size)
+        {
+            std::mt19937 generator{ 42 };
+            std::uniform_int_distribution<int> distribution{ 0, 255 };
+
+            std::vector<std::byte> data(size);
+            for (std::byte& b : data)
+                b = static_cast<std::byte>(distribution(generator));
+            return data;
+        }
+    } // namespace
+
+    TEST(Crc32, knownValues)
+    {
+        EXPECT_EQ(compute(""), 0u);
+        EXPECT_EQ(compute("a"), 0xE8B7BE43u);
+        EXPECT_EQ(compute("123456789"), 0xCBF43926u);
+        EXPECT_EQ(compute("The quick brown fox jumps over the lazy dog"), 0x414FA339u);
+    }
+
+    // The accelerated implementations process large aligned blocks: check all the sizes and alignments around them
+    TEST(Crc32, sizesAndAlignments)
+    {
+        const std::vector<std::byte> data{ generateData(1024 + 16) };
+
+        for (std::size_t offset{}; offset < 16; ++offset)
+        {
+            for (std::size_t size{}; size <= 1024; ++size)
+                ASSERT_EQ(update(0, data.data() + offset, size), computeReference(data.data() + offset, size)) << "offset = " << offset << ", size = " << size;
+        }
+    }
+
+    TEST(Crc32, incremental)
+    {
+        const std::vector<std::byte> data{ generateData(1024 * 1024 + 7) };
+        const Value expected{ computeReference(data.data(), data.size()) };
+
+        for (const std::size_t chunkSize : { 1, 15, 63, 64, 65, 4096, 65537 })
+        {
+            Value crc{};
+            for (std::size_t offset{}; offset < data.size(); offset += chunkSize)
+                crc = update(crc, data.data() + offset, std::min(chunkSize, data.size() - offset));
+
+            EXPECT_EQ(crc, expected) << "chunkSize = " << chunkSize;
+        }
+    }
+
+    TEST(Crc32, computeFromFile)
+    {
+        Zip::tests::TestDirectory directory;
+
+        const std::vector<std::byte> data{ generateData(200'000) };
+        const std::filesystem::path filePath{ directory.getPath() / "file.bin" };
+        Zip::tests::writeFile(filePath, std::string_view{ reinterpret_cast<const char*>(data.data()), data.size() });
+        EXPECT_EQ(computeFromFile(filePath), computeReference(data.data(), data.size()));
+
+        const std::filesystem::path emptyFilePath{ directory.getPath() / "empty.bin" };
+        Zip::tests::writeFile(emptyFilePath, "");
+        EXPECT_EQ(computeFromFile(emptyFilePath), 0u);
+
+        EXPECT_THROW(computeFromFile(directory.getPath() / "missing.bin"), FsException);
+    }
+} // namespace Crc32::tests
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DownloadLimiter.hpp"
+
+namespace
+{
+    using namespace std::chrono_literals;
+
+    // A single processing slot, handed over between the handlers of the flows
+    class DownloadSlotsTest : public ::testing::Test
+    {
+    protected:
+        DownloadSlotsTest()
+        {
+            DownloadLimits limits;
+            limits.maxProcessingCount = 1;
+            limits.schedulingQuantum = 1000us;
+
+            _slots = std::make_shared<DownloadSlots>(limits);
+        }
+
+        struct Handler
+        {
+            std::string name;
+            DownloadSlots::Flow* flow{};
+            std::shared_ptr<DownloadSlots::ProcessingTicket> ticket{ std::make_shared<DownloadSlots::ProcessingTicket>() };
+        };
+
+        Handler& createHandler(const std::string& name, const std::string& flow)
+        {
+            Handler& handler{ _handlers[name] };
+            handler.name = name;
+            handler.flow = _slots->openFlow(flow);
+            handler.ticket->flow = handler.flow;
+            return handler;
+        }
+
+        // Returns true if queued
+        bool wait(Handler& handler)
+        {
+            return _slots->waitForProcessing(handler.ticket, [this, &handler] { _served.push_back(handler.name); });
+        }
+
+        // Handler given the slot by the last release or cancellation, if any
+        Handler* takeServed()
+        {
+            if (_served.empty())
+                return nullptr;
+
+            EXPECT_EQ(_served.size(), 1u);
+            Handler* handler{ &_handlers[_served.back()] };
+            _served.clear();
+            return handler;
+        }
+
+        void TearDown() override
+        {
+            for (auto& [name, handler] : _handlers)
+            {
+                _slots->cancelProcessing(handler.ticket);
+                _slots->closeFlow(handler.flow);
+            }
+        }
+
+        std::shared_ptr<DownloadSlots> _slots;
+        std::map<std::string, Handler> _handlers;
+        std::vector<std::string> _served;
+    };
+
+    TEST_F(DownloadSlotsTest, acquireRelease)
+    {
+        Handler& first{ createHandler("first", "client-1") };
+        Handler& second{ createHandler("second", "client-2") };
+
+        ASSERT_TRUE(_slots->acquireProcessing(*first.ticket));
+        EXPECT_FALSE(_slots->acquireProcessing(*second.ticket));
+        EXPECT_EQ(_slots->getDeferredCount(), 1u);
+
+        // the released slot goes to the waiting handler, that cannot be overtaken
+        ASSERT_TRUE(wait(second));
+        _slots->releaseProcessing(*first.ticket, 10us);
+        EXPECT_EQ(takeServed(), &second);
+        EXPECT_FALSE(_slots->acquireProcessing(*first.ticket));
+        EXPECT_TRUE(_slots->acquireProcessing(*second.ticket));
+
+        // nobody waiting: the slot is free again
+        _slots->releaseProcessing(*second.ticket, 10us);
+        EXPECT_EQ(takeServed(), nullptr);
+        EXPECT_TRUE(_slots->acquireProcessing(*first.ticket));
+        _slots->releaseProcessing(*first.ticket, 10us);
+    }
+
+    TEST_F(DownloadSlotsTest, waitWhenSlotAvailable)
+    {
+        Handler& handler{ createHandler("handler", "client") };
+
+        // the slot is handed over right away, without any callback
+        EXPECT_FALSE(wait(handler));
+        EXPECT_EQ(takeServed(), nullptr);
+        EXPECT_TRUE(_slots->acquireProcessing(*handler.ticket));
+        _slots->releaseProcessing(*handler.ticket, 10us);
+    }
+
+    // Flows share the processing time, whatever the cost of their chunks
+    // Each handler waits for the slot again once its chunk is produced: the flows stay backlogged thanks to their other handlers
+    TEST_F(DownloadSlotsTest, fairShare)
+    {
+        Handler& holder{ createHandler("holder", "holder") };
+        ASSERT_TRUE(_slots->acquireProcessing(*holder.ticket));
+
+        std::map<std::string, std::chrono::microseconds> chunkCosts;
+        for (std::size_t i{}; i < 3; ++i)
+        {
+            const std::string heavyName{ "heavy-" + std::to_string(i) };
+            ASSERT_TRUE(wait(createHandler(heavyName, "client-1")));
+            chunkCosts[heavyName] = 4000us;
+
+            const std::string lightName{ "light-" + std::to_string(i) };
+            ASSERT_TRUE(wait(createHandler(lightName, "client-2")));
+            chunkCosts[lightName] = 500us;
+        }
+        _slots->releaseProcessing(*holder.ticket, 0us);
+
+        std::map<DownloadSlots::Flow*, std::chrono::microseconds> processingTimes;
+        for (std::size_t i{}; i < 1000; ++i)
+        {
+            Handler* handler{ takeServed() };
+            ASSERT_NE(handler, nullptr);
+            ASSERT_TRUE(_slots->acquireProcessing(*handler->ticket));
+
+            const std::chrono::microseconds cost{ chunkCosts.at(handler->name) };
+            processingTimes[handler->flow] += cost;
+            _slots->releaseProcessing(*handler->ticket, cost);
+
+            // ready to produce its next chunk
+            ASSERT_TRUE(wait(*handler));
+        }
+
+        const double ratio{ static_cast<double>(processingTimes[_handlers["heavy-0"].flow].count()) / processingTimes[_handlers["light-0"].flow].count() };
+        EXPECT_GT(ratio, 0.9);
+        EXPECT_LT(ratio, 1.1);
+    }
+
+    // A flow that starts waiting is served before the flows that keep on waiting
+    TEST_F(DownloadSlotsTest, newFlowFirst)
+    {
+        Handler& holder{ createHandler("holder", "holder") };
+        Handler& first{ createHandler("first", "client-1") };
+        Handler& second{ createHandler("second", "client-2") };
+
+        ASSERT_TRUE(_slots->acquireProcessing(*holder.ticket));
+        ASSERT_TRUE(wait(first));
+        ASSERT_TRUE(wait(second));
+        _slots->releaseProcessing(*holder.ticket, 0us);
+
+        for (std::size_t i{}; i < 10; ++i)
+        {
+            Handler* handler{ takeServed() };
+            ASSERT_NE(handler, nullptr);
+            ASSERT_TRUE(_slots->acquireProcessing(*handler->ticket));
+            _slots->releaseProcessing(*handler->ticket, 2000us);
+            ASSERT_TRUE(wait(*handler));
+        }
+
+        Handler* current{ takeServed() };
+        ASSERT_NE(current, nullptr);
+        ASSERT_TRUE(_slots->acquireProcessing(*current->ticket));
+
+        Handler& newcomer{ createHandler("newcomer", "client-3") };
+        ASSERT_TRUE(wait(newcomer));
+
+        _slots->releaseProcessing(*current->ticket, 2000us);
+        EXPECT_EQ(takeServed(), &newcomer);
+        ASSERT_TRUE(_slots->acquireProcessing(*newcomer.ticket));
+        _slots->releaseProcessing(*newcomer.ticket, 10us);
+        ASSERT_TRUE(wait(*current));
+    }
+
+    // Handlers of the same flow share its part of the processing time
+    TEST_F(DownloadSlotsTest, sameFlow)
+    {
+        Handler& holder{ createHandler("holder", "holder") };
+        Handler& first{ createHandler("first", "client-1") };
+        Handler& second{ createHandler("second", "client-1") };
+        Handler& other{ createHandler("other", "client-2") };
+
+        ASSERT_TRUE(_slots->acquireProcessing(*holder.ticket));
+        ASSERT_TRUE(wait(first));
+        ASSERT_TRUE(wait(second));
+        ASSERT_TRUE(wait(other));
+        _slots->releaseProcessing(*holder.ticket, 0us);
+
+        std::map<std::string, std::size_t> servedCounts;
+        for (std::size_t i{}; i < 1000; ++i)
+        {
+            Handler* handler{ takeServed() };
+            ASSERT_NE(handler, nullptr);
+            ASSERT_TRUE(_slots->acquireProcessing(*handler->ticket));
+            servedCounts[handler->name]++;
+            _slots->releaseProcessing(*handler->ticket, 1000us);
+            ASSERT_TRUE(wait(*handler));
+        }
+
+        const double ratio{ static_cast<double>(servedCounts["first"] + servedCounts["second"]) / servedCounts["other"] };
+        EXPECT_GT(ratio, 0.9);
+        EXPECT_LT(ratio, 1.1);
+        EXPECT_GT(servedCounts["first"], 0u);
+        EXPECT_GT(servedCounts["second"], 0u);
+    }
+
+    TEST_F(DownloadSlotsTest, cancel)
+    {
+        Handler& holder{ createHandler("holder", "holder") };
+        Handler& first{ createHandler("first", "client-1") };
+        Handler& second{ createHandler("second", "client-2") };
+
+        ASSERT_TRUE(_slots->acquireProcessing(*holder.ticket));
+        ASSERT_TRUE(wait(first));
+        ASSERT_TRUE(wait(second));
+
+        // queued ticket: leaves the queue
+        _slots->cancelProcessing(first.ticket);
+        EXPECT_EQ(takeServed(), nullptr);
+
+        _slots->releaseProcessing(*holder.ticket, 10us);
+        EXPECT_EQ(takeServed(), &second);
+
+        // slot handed over but not used: given back, to nobody
+        _slots->cancelProcessing(second.ticket);
+        EXPECT_EQ(takeServed(), nullptr);
+        EXPECT_TRUE(_slots->acquireProcessing(*first.ticket));
+        _slots->releaseProcessing(*first.ticket, 10us);
+    }
+} // namespace
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "EntryFile.hpp"
+#include "TestCorpus.hpp"
+#include "ZipFileException.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        Entry createEntry(const std::filesystem::path& filePath, std::uint64_t size)
+        {
+            Entry entry;
+            entry.fileName = filePath.filename().string();
+            entry.filePath = filePath;
+            entry.size = size;
+            return entry;
+        }
+
+        std::string read(EntryFile& file, std::uint64_t offset, std::size_t size)
+        {
+            std::vector<std::byte> buffer(size);
+            file.read(offset, buffer.data(), size);
+            return std::string{ reinterpret_cast<const char*>(buffer.data()), size };
+        }
+    } // namespace
+
+    class EntryFileTest : public ::testing::Test
+    {
+    protected:
+        TestDirectory _directory;
+    };
+
+    TEST_F(EntryFileTest, read)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "file.txt" };
+        writeFile(filePath, "0123456789");
+        std::filesystem::permissions(filePath, std::filesystem::perms::owner_read | std::filesystem::perms::group_read);
+
+        EntryFile file;
+        file.open(createEntry(filePath, 10));
+        EXPECT_TRUE(file.isOpen());
+        EXPECT_EQ(file.getMode(), 0440u);
+        EXPECT_EQ(read(file, 0, 10), "0123456789");
+        EXPECT_EQ(read(file, 3, 4), "3456");
+        EXPECT_THROW(read(file, 8, 4), FileException);
+
+        file.close();
+        EXPECT_FALSE(file.isOpen());
+    }
+
+    TEST_F(EntryFileTest, holes)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "sparse.bin" };
+        constexpr std::uint64_t fileSize{ 10 * 1024 * 1024 };
+        createSparseFile(filePath, fileSize, "end");
+
+        EntryFile file;
+        file.open(createEntry(filePath, fileSize));
+        EXPECT_EQ(read(file, 0, 16), std::string(16, '\0'));
+        EXPECT_EQ(read(file, fileSize - 5, 5), (std::string{ "\0\0end", 5 }));
+        EXPECT_EQ(read(file, 5 * 1024 * 1024, 1024 * 1024), std::string(1024 * 1024, '\0'));
+    }
+
+    TEST_F(EntryFileTest, checks)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "file.txt" };
+        writeFile(filePath, "content");
+
+        EntryFile file;
+        EXPECT_THROW(file.open(createEntry(filePath, 6)), FileException); // size changed
+        EXPECT_THROW(file.open(createEntry(_directory.getPath() / "missing.txt", 0)), FileException);
+        EXPECT_THROW(file.open(createEntry(_directory.getPath(), 0)), FileException); // not a regular file
+    }
+} // namespace Zip::tests
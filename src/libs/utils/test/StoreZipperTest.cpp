@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "utils/Crc32.hpp"
+#include "utils/IZipper.hpp"
+#include "TestCorpus.hpp"
+#include "ZipChecker.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        void writeZip(const EntryContainer& entries, const std::filesystem::path& zipPath, const WriteBudget& budget = {})
+        {
+            ASSERT_TRUE(canUseStoreZipper(entries));
+            writeArchive(*createStoreZipper(entries), zipPath, budget);
+        }
+    } // namespace
+
+    class StoreZipperTest : public ::testing::Test
+    {
+    protected:
+        TestDirectory _directory;
+    };
+
+    TEST_F(StoreZipperTest, corpus)
+    {
+        const EntryContainer entries{ generateCorpus(_directory.getPath() / "corpus") };
+        const std::filesystem::path zipPath{ _directory.getPath() / "corpus.zip" };
+
+        writeZip(entries, zipPath);
+        checkZip(entries, zipPath);
+    }
+
+    TEST_F(StoreZipperTest, corpusSmallBudget)
+    {
+        // headers and central directory records larger than the budget are split between calls
+        const EntryContainer entries{ generateCorpus(_directory.getPath() / "corpus") };
+        const std::filesystem::path zipPath{ _directory.getPath() / "corpus.zip" };
+
+        writeZip(entries, zipPath, WriteBudget{ 7, 7 });
+        checkZip(entries, zipPath);
+    }
+
+    // Not recognized by libarchive, rejected by unzip
+    TEST_F(StoreZipperTest, empty)
+    {
+        const std::filesystem::path zipPath{ _directory.getPath() / "empty.zip" };
+        writeZip({}, zipPath);
+
+        std::ifstream file{ zipPath, std::ios::binary };
+        const std::string content{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+        EXPECT_EQ(content, (std::string{ "PK\x05\x06", 4 } + std::string(18, '\0'))); // end of central directory only
+    }
+
+    // More than 65535 entries: ZIP64 end of central directory
+    TEST_F(StoreZipperTest, manyEntries)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "file.txt" };
+        writeFile(filePath, "content");
+
+        EntryContainer entries;
+        for (std::size_t i{}; i < 70'000; ++i)
+        {
+            Entry& entry{ entries.emplace_back() };
+            entry.fileName = "dir/file-" + std::to_string(i) + ".txt";
+            entry.filePath = filePath;
+            entry.size = 7;
+            if (i % 2)
+                entry.crc32 = Crc32::computeFromFile(filePath);
+        }
+
+        const std::filesystem::path zipPath{ _directory.getPath() / "many.zip" };
+        writeZip(entries, zipPath);
+        checkZip(entries, zipPath);
+    }
+
+    // Entry larger than 4 GiB (ZIP64 sizes and data descriptor), followed by an entry beyond 4 GiB (ZIP64 offsets)
+    TEST_F(StoreZipperTest, largeSparseEntry)
+    {
+        const std::filesystem::path largeFilePath{ _directory.getPath() / "large.bin" };
+        constexpr std::uint64_t largeFileSize{ 4ULL * 1024 * 1024 * 1024 + 1024 * 1024 + 3 };
+        createSparseFile(largeFilePath, largeFileSize, "end of file");
+
+        const std::filesystem::path smallFilePath{ _directory.getPath() / "small.txt" };
+        writeFile(smallFilePath, "small");
+
+        auto createEntry{ [](std::string fileName, const std::filesystem::path& filePath, std::uint64_t size) {
+            Entry entry;
+            entry.fileName = std::move(fileName);
+            entry.filePath = filePath;
+            entry.size = size;
+            return entry;
+        } };
+
+        EntryContainer entries;
+        entries.push_back(createEntry("small-first.txt", smallFilePath, 5));
+        entries.push_back(createEntry("large.bin", largeFilePath, largeFileSize));
+        entries.push_back(createEntry("small-last.txt", smallFilePath, 5));
+        entries.back().crc32 = Crc32::computeFromFile(smallFilePath);
+
+        const std::filesystem::path zipPath{ _directory.getPath() / "large.zip" };
+        writeZip(entries, zipPath, WriteBudget{ 1024 * 1024, 1024 * 1024 });
+        EXPECT_GT(std::filesystem::file_size(zipPath), largeFileSize);
+        checkZip(entries, zipPath);
+    }
+
+    TEST(StoreZipper, canUseStoreZipper)
+    {
+        auto canUse{ [](std::string fileName, std::uint32_t mode = 0644) {
+            Entry entry;
+            entry.fileName = std::move(fileName);
+            entry.mode = mode;
+            return canUseStoreZipper({ entry });
+        } };
+
+        EXPECT_TRUE(canUseStoreZipper({}));
+        EXPECT_TRUE(canUse("file.txt"));
+        EXPECT_TRUE(canUse("dir/fïlé €.txt"));
+        EXPECT_TRUE(canUse("\xF0\x9F\x98\x80.txt"));
+        EXPECT_TRUE(canUse(std::string(65534, 'a')));
+        EXPECT_TRUE(canUse("file.sh", 04755));
+
+        EXPECT_FALSE(canUse(""));
+        EXPECT_FALSE(canUse(std::string(65535, 'a')));
+        EXPECT_FALSE(canUse(std::string{ "a\0b", 3 }));
+        EXPECT_FALSE(canUse("latin1 \xE9.txt"));
+        EXPECT_FALSE(canUse("truncated \xE2\x82"));
+        EXPECT_FALSE(canUse("overlong \xC0\xAF"));
+        EXPECT_FALSE(canUse("surrogate \xED\xA0\x80"));
+        EXPECT_FALSE(canUse("file.txt", 0100644));
+    }
+} // namespace Zip::tests
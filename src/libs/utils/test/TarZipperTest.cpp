@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <clocale>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "utils/Crc32.hpp"
+#include "utils/IZipper.hpp"
+#include "TestCorpus.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        constexpr std::size_t blockSize{ 512 };
+
+        std::string writeTar(const EntryContainer& entries, std::optional<std::pair<std::uint64_t, std::uint64_t>> range = std::nullopt, const WriteBudget& budget = {})
+        {
+            auto zipper{ createTarZipper(entries) };
+            if (range)
+                zipper->setRange(range->first, range->second);
+
+            std::ostringstream output;
+            while (!zipper->isComplete())
+                EXPECT_LE(zipper->writeSome(output, budget), budget.maxOutputSize);
+
+            return output.str();
+        }
+
+        // Checks the length prefix of each "<length> <key>=<value>\n" record
+        std::map<std::string, std::string> parsePaxRecords(std::string_view paxData)
+        {
+            std::map<std::string, std::string> records;
+
+            while (!paxData.empty())
+            {
+                const std::size_t spacePos{ paxData.find(' ') };
+                EXPECT_NE(spacePos, std::string_view::npos);
+                if (spacePos == std::string_view::npos)
+                    break;
+
+                const std::size_t recordSize{ std::stoul(std::string{ paxData.substr(0, spacePos) }) };
+                EXPECT_LE(recordSize, paxData.size());
+                if (recordSize > paxData.size())
+                    break;
+
+                const std::string_view record{ paxData.substr(spacePos + 1, recordSize - spacePos - 1) };
+                EXPECT_EQ(record.back(), '\n') << "bad length " << recordSize;
+
+                const std::size_t equalPos{ record.find('=') };
+                EXPECT_NE(equalPos, std::string_view::npos);
+                records.emplace(record.substr(0, equalPos), record.substr(equalPos + 1, record.size() - equalPos - 2));
+
+                paxData.remove_prefix(recordSize);
+            }
+
+            return records;
+        }
+
+        // pax records of the first entry, if any
+        std::map<std::string, std::string> getPaxRecords(std::string_view tar)
+        {
+            if (tar.size() < blockSize || tar[156] != 'x')
+                return {};
+
+            const std::size_t paxDataSize{ std::stoul(std::string{ tar.substr(124, 11) }, nullptr, 8) };
+            return parsePaxRecords(tar.substr(blockSize, paxDataSize));
+        }
+
+        struct ReadEntry
+        {
+            std::string fileName;
+            std::uint64_t size{};
+            std::uint32_t mode{};
+            Crc32::Value crc32{};
+        };
+
+        std::vector<ReadEntry> readTar(const std::string& tar)
+        {
+            std::vector<ReadEntry> res;
+
+            // names are converted to the current locale
+            std::setlocale(LC_CTYPE, "C.UTF-8");
+
+            ::archive* archive{ ::archive_read_new() };
+            ::archive_read_support_format_tar(archive);
+            EXPECT_EQ(::archive_read_open_memory(archive, tar.data(), tar.size()), ARCHIVE_OK) << ::archive_error_string(archive);
+
+            std::vector<std::byte> buffer(65536);
+            ::archive_entry* archiveEntry;
+            int headerResult;
+            while ((headerResult = ::archive_read_next_header(archive, &archiveEntry)) == ARCHIVE_OK)
+            {
+                ReadEntry& entry{ res.emplace_back() };
+                entry.fileName = ::archive_entry_pathname_utf8(archiveEntry);
+                entry.mode = ::archive_entry_perm(archiveEntry);
+
+                la_ssize_t readSize;
+                while ((readSize = ::archive_read_data(archive, buffer.data(), buffer.size())) > 0)
+                {
+                    entry.crc32 = Crc32::update(entry.crc32, buffer.data(), readSize);
+                    entry.size += readSize;
+                }
+                EXPECT_EQ(readSize, 0) << ::archive_error_string(archive);
+            }
+            EXPECT_EQ(headerResult, ARCHIVE_EOF) << ::archive_error_string(archive);
+
+            ::archive_read_free(archive);
+
+            return res;
+        }
+
+        Entry createEntry(std::string fileName, const std::filesystem::path& filePath, std::uint64_t size)
+        {
+            Entry entry;
+            entry.fileName = std::move(fileName);
+            entry.filePath = filePath;
+            entry.size = size;
+            return entry;
+        }
+    } // namespace
+
+    class TarZipperTest : public ::testing::Test
+    {
+    protected:
+        TestDirectory _directory;
+    };
+
+    TEST_F(TarZipperTest, corpus)
+    {
+        const EntryContainer entries{ generateCorpus(_directory.getPath() / "corpus") };
+
+        const std::string tar{ writeTar(entries) };
+        EXPECT_EQ(tar.size(), getTarSize(entries));
+        EXPECT_EQ(tar.size() % blockSize, 0u);
+
+        const std::vector<ReadEntry> readEntries{ readTar(tar) };
+        ASSERT_EQ(readEntries.size(), entries.size());
+        for (std::size_t i{}; i < entries.size(); ++i)
+        {
+            EXPECT_EQ(readEntries[i].fileName, entries[i].fileName);
+            EXPECT_EQ(readEntries[i].size, entries[i].size) << entries[i].fileName;
+            EXPECT_EQ(readEntries[i].mode, getExpectedMode(entries[i])) << entries[i].fileName;
+            EXPECT_EQ(readEntries[i].crc32, Crc32::computeFromFile(entries[i].filePath)) << entries[i].fileName;
+        }
+    }
+
+    TEST_F(TarZipperTest, ranges)
+    {
+        const EntryContainer entries{ generateCorpus(_directory.getPath() / "corpus") };
+        const std::string tar{ writeTar(entries) };
+
+        const std::pair<std::uint64_t, std::uint64_t> ranges[]{
+            { 0, 0 },
+            { 0, 1 },
+            { 100, 1000 },
+            { blockSize, 3 * blockSize + 1 },
+            { 70'000, 400'000 },
+            { tar.size() - 1030, tar.size() },
+            { 0, tar.size() },
+        };
+        for (const auto& range : ranges)
+        {
+            EXPECT_EQ(writeTar(entries, range), tar.substr(range.first, range.second - range.first)) << "[" << range.first << ", " << range.second << ")";
+            EXPECT_EQ(writeTar(entries, range, WriteBudget{ 7, 7 }), tar.substr(range.first, range.second - range.first)) << "[" << range.first << ", " << range.second << ")";
+        }
+    }
+
+    // Record lengths include their own digits: check the names whose records cross the 100 and 1000 bytes boundaries
+    TEST_F(TarZipperTest, paxPathRecordLengths)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "file.txt" };
+        writeFile(filePath, "content");
+
+        for (std::size_t nameSize{ 90 }; nameSize < 1010; ++nameSize)
+        {
+            // non ASCII names always need a pax record
+            const std::string fileName{ std::string(nameSize - 2, 'a') + "\xC3\xA9" };
+            const EntryContainer entries{ createEntry(fileName, filePath, 7) };
+
+            const std::string tar{ writeTar(entries) };
+            ASSERT_EQ(tar.size(), getTarSize(entries));
+
+            const std::map<std::string, std::string> records{ getPaxRecords(tar) };
+            ASSERT_EQ(records.size(), 1u) << "nameSize = " << nameSize;
+            EXPECT_EQ(records.at("path"), fileName);
+
+            const std::vector<ReadEntry> readEntries{ readTar(tar) };
+            ASSERT_EQ(readEntries.size(), 1u);
+            EXPECT_EQ(readEntries[0].fileName, fileName);
+        }
+    }
+
+    TEST_F(TarZipperTest, asciiNames)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "file.txt" };
+        writeFile(filePath, "content");
+
+        // fits in the ustar header
+        EXPECT_TRUE(getPaxRecords(writeTar({ createEntry(std::string(100, 'a'), filePath, 7) })).empty());
+        EXPECT_EQ(getPaxRecords(writeTar({ createEntry(std::string(101, 'a'), filePath, 7) })).at("path"), std::string(101, 'a'));
+    }
+
+    // Sizes above 8 GiB do not fit in the ustar header: only the headers are generated, the file is not read
+    TEST_F(TarZipperTest, paxSizeRecord)
+    {
+        const std::filesystem::path filePath{ _directory.getPath() / "large.bin" };
+        constexpr std::uint64_t fileSize{ 8ULL * 1024 * 1024 * 1024 };
+        createSparseFile(filePath, fileSize, "end");
+
+        const EntryContainer entries{ createEntry("large.bin", filePath, fileSize) };
+        const std::string headers{ writeTar(entries, std::make_pair(0, 3 * blockSize)) };
+
+        const std::map<std::string, std::string> records{ getPaxRecords(headers) };
+        ASSERT_EQ(records.size(), 1u);
+        EXPECT_EQ(records.at("size"), std::to_string(fileSize));
+        EXPECT_EQ(getTarSize(entries), 3 * blockSize + fileSize + 2 * blockSize);
+
+        // the ustar header follows the pax data
+        EXPECT_EQ(headers.substr(2 * blockSize, 9), "large.bin");
+        EXPECT_EQ(headers[2 * blockSize + 156], '0');
+    }
+} // namespace Zip::tests
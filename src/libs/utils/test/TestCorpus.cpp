@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TestCorpus.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <random>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils/Crc32.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        [[noreturn]] void throwSystemError(const std::filesystem::path& path, std::string_view operation)
+        {
+            throw std::system_error{ errno, std::generic_category(), std::string{ operation } + " '" + path.string() + "'" };
+        }
+    } // namespace
+
+    TestDirectory::TestDirectory()
+    {
+        std::string pathTemplate{ (std::filesystem::temp_directory_path() / "fileshelter-test-XXXXXX").string() };
+        if (!::mkdtemp(pathTemplate.data()))
+            throwSystemError(pathTemplate, "cannot create directory");
+
+        _path = pathTemplate;
+    }
+
+    TestDirectory::~TestDirectory()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(_path, ec);
+    }
+
+    void writeFile(const std::filesystem::path& path, std::string_view content)
+    {
+        std::filesystem::create_directories(path.parent_path());
+
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file.write(content.data(), content.size());
+        if (!file)
+            throwSystemError(path, "cannot write");
+    }
+
+    void createSparseFile(const std::filesystem::path& path, std::uint64_t size, std::string_view endContent)
+    {
+        const int fd{ ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        if (fd < 0)
+            throwSystemError(path, "cannot open");
+
+        const bool success{ ::ftruncate(fd, size) == 0
+                            && ::pwrite(fd, endContent.data(), endContent.size(), size - endContent.size()) == static_cast<::ssize_t>(endContent.size()) };
+        ::close(fd);
+        if (!success)
+            throwSystemError(path, "cannot write");
+    }
+
+    EntryContainer generateCorpus(const std::filesystem::path& directory)
+    {
+        struct FileDesc
+        {
+            std::string_view fileName;
+            std::uint64_t size;
+            std::filesystem::perms filePermissions{ std::filesystem::perms::owner_read | std::filesystem::perms::owner_write };
+            std::optional<std::uint32_t> mode{}; // of the entry, overriding the permissions of the file
+            bool precomputeCrc32{};
+            std::optional<std::time_t> modificationTime{};
+        };
+
+        using std::filesystem::perms;
+
+        // sizes around the read buffer and budget sizes
+        const FileDesc fileDescs[]{
+            { "empty.txt", 0 },
+            { "empty-crc.txt", 0, perms::owner_read, 0644, true },
+            { "one.txt", 1, perms::owner_all | perms::group_read },
+            { "dir/65535.bin", 65535, perms::owner_read, 0644, true, 1'700'000'000 },
+            { "dir/65536.bin", 65536, perms::owner_read, 0755 },
+            { "dir/65537.bin", 65537, perms::owner_read | perms::group_read | perms::others_read, std::nullopt, false, 946'684'800 },
+            { "dir/sub dir/262145.bin", 262145, perms::owner_read, 0600, true },
+            { "dir/sub dir/1MiB+1.bin", 1024 * 1024 + 1, perms::owner_read, 0444 },
+            { "données €.txt", 1234 },
+            { "\xF0\x9F\x98\x80 emoji.txt", 4321, perms::owner_read, 0644, true },
+        };
+
+        std::mt19937 generator{ 42 };
+        std::uniform_int_distribution<int> distribution{ 0, 255 };
+
+        EntryContainer entries;
+        for (const FileDesc& fileDesc : fileDescs)
+        {
+            std::string content(fileDesc.size, '\0');
+            std::generate(std::begin(content), std::end(content), [&] { return static_cast<char>(distribution(generator)); });
+
+            Entry& entry{ entries.emplace_back() };
+            entry.fileName = fileDesc.fileName;
+            entry.filePath = directory / fileDesc.fileName;
+            entry.size = fileDesc.size;
+            entry.mode = fileDesc.mode;
+            entry.modificationTime = fileDesc.modificationTime;
+
+            writeFile(entry.filePath, content);
+            std::filesystem::permissions(entry.filePath, fileDesc.filePermissions);
+            if (fileDesc.precomputeCrc32)
+                entry.crc32 = Crc32::computeFromFile(entry.filePath);
+        }
+
+        // holes larger than the read buffer
+        {
+            Entry& entry{ entries.emplace_back() };
+            entry.fileName = "sparse.bin";
+            entry.filePath = directory / entry.fileName;
+            entry.size = 3 * 1024 * 1024 + 17;
+            createSparseFile(entry.filePath, entry.size, "data after the hole");
+        }
+
+        return entries;
+    }
+
+    std::uint32_t getExpectedMode(const Entry& entry)
+    {
+        return entry.mode.value_or(static_cast<std::uint32_t>(std::filesystem::status(entry.filePath).permissions()));
+    }
+
+    SparseOutputFile::SparseOutputFile(const std::filesystem::path& path)
+        : _streamBuffer{ path }
+        , _stream{ &_streamBuffer }
+    {
+    }
+
+    SparseOutputFile::~SparseOutputFile() = default;
+
+    void SparseOutputFile::close()
+    {
+        _streamBuffer.close();
+    }
+
+    SparseOutputFile::StreamBuffer::StreamBuffer(const std::filesystem::path& path)
+        : _fd{ ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) }
+    {
+        if (_fd < 0)
+            throwSystemError(path, "cannot open");
+    }
+
+    SparseOutputFile::StreamBuffer::~StreamBuffer()
+    {
+        close();
+    }
+
+    void SparseOutputFile::StreamBuffer::close()
+    {
+        if (_fd < 0)
+            return;
+
+        // trailing hole
+        const bool success{ ::ftruncate(_fd, _size) == 0 };
+        ::close(_fd);
+        _fd = -1;
+        if (!success)
+            throwSystemError("output", "cannot truncate");
+    }
+
+    std::streamsize SparseOutputFile::StreamBuffer::xsputn(const char* data, std::streamsize size)
+    {
+        constexpr std::uint64_t blockSize{ 4096 };
+
+        std::streamsize written{};
+        while (written < size)
+        {
+            // split on block boundaries: whole blocks of zeros are skipped
+            const std::size_t chunkSize{ static_cast<std::size_t>(std::min<std::uint64_t>(size - written, blockSize - _size % blockSize)) };
+            const char* chunk{ data + written };
+            if (std::any_of(chunk, chunk + chunkSize, [](char c) { return c != 0; }))
+            {
+                if (::pwrite(_fd, chunk, chunkSize, _size) != static_cast<::ssize_t>(chunkSize))
+                    return written;
+            }
+
+            _size += chunkSize;
+            written += chunkSize;
+        }
+
+        return written;
+    }
+
+    SparseOutputFile::StreamBuffer::int_type SparseOutputFile::StreamBuffer::overflow(int_type c)
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        const char ch{ traits_type::to_char_type(c) };
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+} // namespace Zip::tests
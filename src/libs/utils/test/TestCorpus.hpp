@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+#include "utils/IZipper.hpp"
+
+namespace Zip::tests
+{
+    // Temporary directory, removed with its contents on destruction
+    class TestDirectory
+    {
+    public:
+        TestDirectory();
+        ~TestDirectory();
+        TestDirectory(const TestDirectory&) = delete;
+        TestDirectory& operator=(const TestDirectory&) = delete;
+
+        const std::filesystem::path& getPath() const { return _path; }
+
+    private:
+        std::filesystem::path _path;
+    };
+
+    void writeFile(const std::filesystem::path& path, std::string_view content);
+
+    // File made of a hole, followed by the given content
+    void createSparseFile(const std::filesystem::path& path, std::uint64_t size, std::string_view endContent);
+
+    // Files of various sizes (empty, around the read buffer sizes, with holes), names (directories, UTF-8),
+    // modes and dates, with and without precomputed CRCs
+    EntryContainer generateCorpus(const std::filesystem::path& directory);
+
+    // Mode of the entry, or the permissions of its file
+    std::uint32_t getExpectedMode(const Entry& entry);
+
+    // Output file whose blocks of zeros are left as holes, so that large archives do not use disk space
+    class SparseOutputFile
+    {
+    public:
+        SparseOutputFile(const std::filesystem::path& path);
+        ~SparseOutputFile();
+        SparseOutputFile(const SparseOutputFile&) = delete;
+        SparseOutputFile& operator=(const SparseOutputFile&) = delete;
+
+        std::ostream& getStream() { return _stream; }
+        void close();
+
+    private:
+        class StreamBuffer : public std::streambuf
+        {
+        public:
+            StreamBuffer(const std::filesystem::path& path);
+            ~StreamBuffer() override;
+
+            void close();
+
+        private:
+            std::streamsize xsputn(const char* data, std::streamsize size) override;
+            int_type overflow(int_type c) override;
+
+            int _fd{ -1 };
+            std::uint64_t _size{};
+        };
+
+        StreamBuffer _streamBuffer;
+        std::ostream _stream;
+    };
+} // namespace Zip::tests
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ZipChecker.hpp"
+
+#include <gtest/gtest.h>
+
+#include <clocale>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "utils/Crc32.hpp"
+#include "TestCorpus.hpp"
+
+namespace Zip::tests
+{
+    namespace
+    {
+        // Reads back the whole archive with libarchive, using the central directory
+        struct ReadEntry
+        {
+            std::string fileName;
+            std::uint64_t size{};
+            std::uint32_t mode{};
+            std::time_t modificationTime{};
+            Crc32::Value crc32{};
+        };
+
+        std::vector<ReadEntry> readZip(const std::filesystem::path& zipPath)
+        {
+            std::vector<ReadEntry> res;
+
+            // names are converted to the current locale
+            std::setlocale(LC_CTYPE, "C.UTF-8");
+
+            ::archive* archive{ ::archive_read_new() };
+            ::archive_read_support_format_zip_seekable(archive);
+            EXPECT_EQ(::archive_read_open_filename(archive, zipPath.c_str(), 65536), ARCHIVE_OK) << ::archive_error_string(archive);
+
+            std::vector<std::byte> buffer(1024 * 1024);
+            ::archive_entry* archiveEntry;
+            int headerResult;
+            while ((headerResult = ::archive_read_next_header(archive, &archiveEntry)) == ARCHIVE_OK)
+            {
+                ReadEntry& entry{ res.emplace_back() };
+                entry.fileName = ::archive_entry_pathname_utf8(archiveEntry);
+                entry.mode = ::archive_entry_perm(archiveEntry);
+                entry.modificationTime = ::archive_entry_mtime(archiveEntry);
+
+                la_ssize_t readSize;
+                while ((readSize = ::archive_read_data(archive, buffer.data(), buffer.size())) > 0)
+                {
+                    entry.crc32 = Crc32::update(entry.crc32, buffer.data(), readSize);
+                    entry.size += readSize;
+                }
+                EXPECT_EQ(readSize, 0) << "Entry '" << entry.fileName << "': " << ::archive_error_string(archive);
+            }
+            EXPECT_EQ(headerResult, ARCHIVE_EOF) << ::archive_error_string(archive);
+
+            ::archive_read_free(archive);
+
+            return res;
+        }
+    } // namespace
+
+    void writeArchive(IZipper& zipper, const std::filesystem::path& archivePath, const WriteBudget& budget)
+    {
+        SparseOutputFile output{ archivePath };
+        while (!zipper.isComplete())
+            ASSERT_LE(zipper.writeSome(output.getStream(), budget), budget.maxOutputSize);
+        output.close();
+    }
+
+    void checkZip(const EntryContainer& entries, const std::filesystem::path& zipPath)
+    {
+#ifdef UNZIP_EXECUTABLE
+        const std::string command{ std::string{ UNZIP_EXECUTABLE } + " -tqq '" + zipPath.string() + "'" };
+        EXPECT_EQ(std::system(command.c_str()), 0) << command;
+#endif
+
+        const std::vector<ReadEntry> readEntries{ readZip(zipPath) };
+        ASSERT_EQ(readEntries.size(), entries.size());
+
+        std::map<std::filesystem::path, Crc32::Value> fileCrc32s;
+        for (const Entry& entry : entries)
+        {
+            if (fileCrc32s.find(entry.filePath) == std::cend(fileCrc32s))
+                fileCrc32s.emplace(entry.filePath, Crc32::computeFromFile(entry.filePath));
+        }
+        for (std::size_t i{}; i < entries.size(); ++i)
+        {
+            const Entry& entry{ entries[i] };
+            const ReadEntry& readEntry{ readEntries[i] };
+
+            EXPECT_EQ(readEntry.fileName, entry.fileName);
+            EXPECT_EQ(readEntry.size, entry.size) << entry.fileName;
+            EXPECT_EQ(readEntry.crc32, fileCrc32s[entry.filePath]) << entry.fileName;
+            EXPECT_EQ(readEntry.mode, getExpectedMode(entry)) << entry.fileName;
+            if (entry.modificationTime)
+            {
+                EXPECT_EQ(readEntry.modificationTime, *entry.modificationTime) << entry.fileName;
+            }
+        }
+    }
+} // namespace Zip::tests
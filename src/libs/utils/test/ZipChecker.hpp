@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <filesystem>
+
+#include "utils/IZipper.hpp"
+
+namespace Zip::tests
+{
+    // Writes the whole archive produced by the zipper in a sparse file, checking the output budget of each call
+    void writeArchive(IZipper& zipper, const std::filesystem::path& archivePath, const WriteBudget& budget = {});
+
+    // Reads back the whole zip with libarchive (and with unzip if available), and checks it against the entries
+    void checkZip(const EntryContainer& entries, const std::filesystem::path& zipPath);
+} // namespace Zip::tests
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CorpusCommand.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static void
+writeRandomFile(const std::filesystem::path& path, std::uint64_t size, std::mt19937& generator)
+{
+    std::uniform_int_distribution<int> distribution{ 0, 255 };
+
+    std::vector<char> buffer(std::min<std::uint64_t>(size, 1024 * 1024));
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    while (size > 0)
+    {
+        const std::size_t writeSize{ static_cast<std::size_t>(std::min<std::uint64_t>(size, buffer.size())) };
+        std::generate(std::begin(buffer), std::begin(buffer) + writeSize, [&] { return static_cast<char>(distribution(generator)); });
+        file.write(buffer.data(), writeSize);
+        size -= writeSize;
+    }
+
+    if (!file)
+        throw std::runtime_error{ "Cannot write '" + path.string() + "'" };
+}
+
+// Only the last byte is written: the rest of the file is a hole
+static void
+writeSparseFile(const std::filesystem::path& path, std::uint64_t size)
+{
+    const int fd{ ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (fd < 0)
+        throw std::runtime_error{ "Cannot open '" + path.string() + "'" };
+
+    const bool success{ ::ftruncate(fd, size) == 0 && (size == 0 || ::pwrite(fd, "\n", 1, size - 1) == 1) };
+    ::close(fd);
+    if (!success)
+        throw std::runtime_error{ "Cannot write '" + path.string() + "'" };
+}
+
+static void
+processCorpusCommand(const std::filesystem::path& directory, std::size_t fileCount, std::uint64_t fileSize, std::size_t filesPerDirectory, std::uint64_t sparseFileSize)
+{
+    std::mt19937 generator{ 42 };
+
+    for (std::size_t i{}; i < fileCount; ++i)
+    {
+        const std::filesystem::path subDirectory{ directory / ("dir-" + std::to_string(i / filesPerDirectory)) };
+        std::filesystem::create_directories(subDirectory);
+        writeRandomFile(subDirectory / ("file-" + std::to_string(i) + ".bin"), fileSize, generator);
+    }
+
+    if (sparseFileSize > 0)
+    {
+        std::filesystem::create_directories(directory);
+        writeSparseFile(directory / "sparse.bin", sparseFileSize);
+    }
+
+    std::cout << "Created " << fileCount << " files of " << fileSize << " bytes";
+    if (sparseFileSize > 0)
+        std::cout << " and a sparse file of " << sparseFileSize << " bytes";
+    std::cout << " in '" << directory.string() << "'" << std::endl;
+}
+
+CorpusCommand::CorpusCommand(std::string_view processArg)
+    : _processArg{ processArg }
+{
+    namespace po = boost::program_options;
+
+    po::options_description options{ "Options" };
+    options.add_options()("file-count", po::value<std::size_t>()->default_value(10'000), "number of files")("file-size", po::value<std::uint64_t>()->default_value(4096), "size of each file, in bytes")("files-per-directory", po::value<std::size_t>()->default_value(1000), "number of files in each sub directory")("sparse-file-size", po::value<std::uint64_t>()->default_value(0), "size of an additional sparse file, in bytes (0 to disable). Larger than 4 GiB to exercise ZIP64");
+
+    po::options_description hiddenOptions{ "Hidden options" };
+    hiddenOptions.add_options()("directory", po::value<std::string>(), "directory");
+
+    _allOptions.add(options).add(hiddenOptions);
+    _visibleOptions.add(options);
+}
+
+void CorpusCommand::displayHelp(std::ostream& os) const
+{
+    os << "Usage: " << _processArg << " " << getName() << " [options] directory\n";
+    os << _visibleOptions << std::endl;
+}
+
+int CorpusCommand::process(const std::vector<std::string>& args) const
+{
+    namespace po = boost::program_options;
+
+    po::positional_options_description pos;
+    pos.add("directory", 1);
+
+    po::variables_map vm;
+    {
+        po::parsed_options parsed{ po::command_line_parser(args)
+                .options(_allOptions)
+                .positional(pos)
+                .run() };
+        po::store(parsed, vm);
+    }
+
+    if (!vm.count("directory") || vm["files-per-directory"].as<std::size_t>() == 0)
+    {
+        displayHelp(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    processCorpusCommand(vm["directory"].as<std::string>(), vm["file-count"].as<std::size_t>(), vm["file-size"].as<std::uint64_t>(), vm["files-per-directory"].as<std::size_t>(), vm["sparse-file-size"].as<std::uint64_t>());
+
+    return EXIT_SUCCESS;
+}
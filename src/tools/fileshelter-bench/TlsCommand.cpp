@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TlsCommand.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+namespace
+{
+    template<typename T, void (*Free)(T*)>
+    struct OpenSSLDeleter
+    {
+        void operator()(T* object) const { Free(object); }
+    };
+    using SslCtxPtr = std::unique_ptr<SSL_CTX, OpenSSLDeleter<SSL_CTX, SSL_CTX_free>>;
+    using SslPtr = std::unique_ptr<SSL, OpenSSLDeleter<SSL, SSL_free>>;
+    using KeyPtr = std::unique_ptr<EVP_PKEY, OpenSSLDeleter<EVP_PKEY, EVP_PKEY_free>>;
+    using CertificatePtr = std::unique_ptr<X509, OpenSSLDeleter<X509, X509_free>>;
+
+    class FileDescriptor
+    {
+    public:
+        FileDescriptor(int fd)
+            : _fd{ fd } {}
+        ~FileDescriptor()
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        int get() const { return _fd; }
+
+    private:
+        const int _fd;
+    };
+
+    [[noreturn]] void throwOpenSSLError(std::string_view message)
+    {
+        std::string error{ message };
+        if (const unsigned long code{ ERR_get_error() }; code != 0)
+        {
+            char buffer[256];
+            ERR_error_string_n(code, buffer, sizeof(buffer));
+            error += ": " + std::string{ buffer };
+        }
+        throw std::runtime_error{ error };
+    }
+
+    [[noreturn]] void throwSystemError(std::string_view message)
+    {
+        throw std::runtime_error{ std::string{ message } + ": " + std::strerror(errno) };
+    }
+
+    // Sender thread only: the receiver runs in the same process
+    std::chrono::duration<double> getThreadCpuTime(std::chrono::duration<double>& systemTime)
+    {
+        ::rusage usage;
+        ::getrusage(RUSAGE_THREAD, &usage);
+
+        auto toDuration{ [](const ::timeval& tv) { return std::chrono::seconds{ tv.tv_sec } + std::chrono::microseconds{ tv.tv_usec }; } };
+        systemTime = toDuration(usage.ru_stime);
+        return toDuration(usage.ru_utime) + toDuration(usage.ru_stime);
+    }
+
+    // Throw-away self-signed certificate, the receiver does not check it
+    std::pair<KeyPtr, CertificatePtr> createCertificate()
+    {
+        KeyPtr key{ EVP_EC_gen("P-256") };
+        if (!key)
+            throwOpenSSLError("Cannot generate key");
+
+        CertificatePtr certificate{ X509_new() };
+        if (!certificate)
+            throwOpenSSLError("Cannot create certificate");
+
+        X509_set_version(certificate.get(), 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate.get()), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate.get()), 0);
+        X509_gmtime_adj(X509_getm_notAfter(certificate.get()), 24 * 3600);
+        X509_set_pubkey(certificate.get(), key.get());
+
+        X509_NAME* name{ X509_get_subject_name(certificate.get()) };
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(certificate.get(), name);
+        if (!X509_sign(certificate.get(), key.get(), EVP_sha256()))
+            throwOpenSSLError("Cannot sign certificate");
+
+        return { std::move(key), std::move(certificate) };
+    }
+
+    // AES-GCM: the cipher supported by all the kernels providing kTLS
+    void setProtocol(SSL_CTX& context, std::string_view tlsVersion)
+    {
+        const int version{ tlsVersion == "1.2" ? TLS1_2_VERSION : TLS1_3_VERSION };
+        if (tlsVersion != "1.2" && tlsVersion != "1.3")
+            throw std::runtime_error{ "Unknown TLS version '" + std::string{ tlsVersion } + "'" };
+
+        if (!SSL_CTX_set_min_proto_version(&context, version) || !SSL_CTX_set_max_proto_version(&context, version))
+            throwOpenSSLError("Cannot set TLS version");
+        if (!SSL_CTX_set_cipher_list(&context, "ECDHE-ECDSA-AES128-GCM-SHA256") || !SSL_CTX_set_ciphersuites(&context, "TLS_AES_128_GCM_SHA256"))
+            throwOpenSSLError("Cannot set ciphers");
+    }
+
+    SslCtxPtr createServerContext(std::string_view tlsVersion, bool enableKtls)
+    {
+        SslCtxPtr context{ SSL_CTX_new(TLS_server_method()) };
+        if (!context)
+            throwOpenSSLError("Cannot create server context");
+
+        const auto [key, certificate]{ createCertificate() };
+        if (!SSL_CTX_use_certificate(context.get(), certificate.get()) || !SSL_CTX_use_PrivateKey(context.get(), key.get()))
+            throwOpenSSLError("Cannot use certificate");
+
+        setProtocol(*context, tlsVersion);
+        if (enableKtls)
+            SSL_CTX_set_options(context.get(), SSL_OP_ENABLE_KTLS);
+
+        return context;
+    }
+
+    SslCtxPtr createClientContext(std::string_view tlsVersion)
+    {
+        SslCtxPtr context{ SSL_CTX_new(TLS_client_method()) };
+        if (!context)
+            throwOpenSSLError("Cannot create client context");
+
+        SSL_CTX_set_verify(context.get(), SSL_VERIFY_NONE, nullptr);
+        setProtocol(*context, tlsVersion);
+
+        return context;
+    }
+
+    // Reads and discards everything, until the sender closes the connection
+    void receive(SSL_CTX& context, std::uint16_t port, std::uint64_t& receivedSize)
+    {
+        const FileDescriptor socket{ ::socket(AF_INET, SOCK_STREAM, 0) };
+        if (socket.get() < 0)
+            throwSystemError("Cannot create socket");
+
+        ::sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(socket.get(), reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0)
+            throwSystemError("Cannot connect");
+
+        SslPtr ssl{ SSL_new(&context) };
+        SSL_set_fd(ssl.get(), socket.get());
+        if (SSL_connect(ssl.get()) != 1)
+            throwOpenSSLError("TLS handshake failed");
+
+        std::vector<char> buffer(256 * 1024);
+        int readSize;
+        while ((readSize = SSL_read(ssl.get(), buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            receivedSize += readSize;
+    }
+
+    // Same as the embedded web server: chunks read from the file, then encrypted in user space
+    void sendWithWrite(SSL& ssl, int fd, std::uint64_t fileSize, std::size_t chunkSize)
+    {
+        std::vector<char> buffer(chunkSize);
+        for (std::uint64_t offset{}; offset < fileSize;)
+        {
+            const ::ssize_t readSize{ ::pread(fd, buffer.data(), buffer.size(), offset) };
+            if (readSize <= 0)
+                throwSystemError("Cannot read file");
+
+            if (SSL_write(&ssl, buffer.data(), static_cast<int>(readSize)) != readSize)
+                throwOpenSSLError("Cannot write");
+            offset += readSize;
+        }
+    }
+
+    // Same as a reverse proxy using sendfile: the kernel reads and encrypts the file
+    void sendWithSendfile(SSL& ssl, int fd, std::uint64_t fileSize, std::size_t chunkSize)
+    {
+        if (!BIO_get_ktls_send(SSL_get_wbio(&ssl)))
+            throw std::runtime_error{ "kTLS not used for sending: check that the 'tls' kernel module is loaded and that OpenSSL is built with kTLS support" };
+
+        for (std::uint64_t offset{}; offset < fileSize;)
+        {
+            const ossl_ssize_t sentSize{ SSL_sendfile(&ssl, fd, offset, std::min<std::uint64_t>(chunkSize, fileSize - offset), 0) };
+            if (sentSize <= 0)
+                throwOpenSSLError("Cannot send file");
+            offset += sentSize;
+        }
+    }
+
+    void processTlsCommand(const std::filesystem::path& filePath, bool useKtls, std::string_view tlsVersion, unsigned iterationCount, std::size_t chunkSize)
+    {
+        const FileDescriptor file{ ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (file.get() < 0)
+            throwSystemError("Cannot open '" + filePath.string() + "'");
+        const std::uint64_t fileSize{ std::filesystem::file_size(filePath) };
+
+        const SslCtxPtr serverContext{ createServerContext(tlsVersion, useKtls) };
+        const SslCtxPtr clientContext{ createClientContext(tlsVersion) };
+
+        const FileDescriptor listenSocket{ ::socket(AF_INET, SOCK_STREAM, 0) };
+        if (listenSocket.get() < 0)
+            throwSystemError("Cannot create socket");
+
+        ::sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::socklen_t addressSize{ sizeof(address) };
+        if (::bind(listenSocket.get(), reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listenSocket.get(), 1) != 0
+            || ::getsockname(listenSocket.get(), reinterpret_cast<::sockaddr*>(&address), &addressSize) != 0)
+            throwSystemError("Cannot listen on the loopback");
+
+        std::cout << "TLS " << tlsVersion << (useKtls ? ", kernel TLS (sendfile)" : ", user space TLS (read and write)") << ", " << fileSize << " bytes, chunk size = " << chunkSize << " bytes" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+
+        for (unsigned iteration{}; iteration < iterationCount; ++iteration)
+        {
+            std::uint64_t receivedSize{};
+            std::exception_ptr receiveError;
+            std::thread receiver{ [&] {
+                try
+                {
+                    receive(*clientContext, ntohs(address.sin_port), receivedSize);
+                }
+                catch (...)
+                {
+                    receiveError = std::current_exception();
+                }
+            } };
+
+            std::chrono::duration<double> duration{};
+            std::chrono::duration<double> cpuTime{};
+            std::chrono::duration<double> systemTime{};
+            try
+            {
+                const FileDescriptor socket{ ::accept(listenSocket.get(), nullptr, nullptr) };
+                if (socket.get() < 0)
+                    throwSystemError("Cannot accept");
+
+                SslPtr ssl{ SSL_new(serverContext.get()) };
+                SSL_set_fd(ssl.get(), socket.get());
+                if (SSL_accept(ssl.get()) != 1)
+                    throwOpenSSLError("TLS handshake failed");
+
+                // handshake excluded
+                std::chrono::duration<double> startSystemTime;
+                const auto startTime{ std::chrono::steady_clock::now() };
+                const auto startCpuTime{ getThreadCpuTime(startSystemTime) };
+
+                if (useKtls)
+                    sendWithSendfile(*ssl, file.get(), fileSize, chunkSize);
+                else
+                    sendWithWrite(*ssl, file.get(), fileSize, chunkSize);
+                SSL_shutdown(ssl.get());
+
+                duration = std::chrono::steady_clock::now() - startTime;
+                cpuTime = getThreadCpuTime(systemTime) - startCpuTime;
+                systemTime -= startSystemTime;
+            }
+            catch (...)
+            {
+                receiver.join();
+                throw;
+            }
+
+            receiver.join();
+            if (receiveError)
+                std::rethrow_exception(receiveError);
+            if (receivedSize != fileSize)
+                throw std::runtime_error{ "Received " + std::to_string(receivedSize) + " bytes instead of " + std::to_string(fileSize) };
+
+            const double sizeGB{ fileSize / 1e9 };
+            std::cout << "Iteration " << iteration + 1 << ": "
+                      << fileSize << " bytes in " << duration.count() << " s"
+                      << ", " << (fileSize / 1e6) / duration.count() << " MB/s"
+                      << ", " << cpuTime.count() / sizeGB << " CPU s/GB"
+                      << " (system " << systemTime.count() / sizeGB << ")" << std::endl;
+        }
+    }
+} // namespace
+
+TlsCommand::TlsCommand(std::string_view processArg)
+    : _processArg{ processArg }
+{
+    namespace po = boost::program_options;
+
+    po::options_description options{ "Options" };
+    options.add_options()("ktls", "send with SSL_sendfile on a kernel TLS socket, as a reverse proxy offloading the downloads does")("tls-version", po::value<std::string>()->default_value("1.3"), "TLS version: 1.2 or 1.3")("iterations", po::value<unsigned>()->default_value(3), "number of transfers")("chunk-size", po::value<std::size_t>()->default_value(64 * 1024), "bytes read and written, or sent, at once");
+
+    po::options_description hiddenOptions{ "Hidden options" };
+    hiddenOptions.add_options()("file", po::value<std::string>(), "file");
+
+    _allOptions.add(options).add(hiddenOptions);
+    _visibleOptions.add(options);
+}
+
+void TlsCommand::displayHelp(std::ostream& os) const
+{
+    os << "Usage: " << _processArg << " " << getName() << " [options] file\n";
+    os << _visibleOptions << std::endl;
+}
+
+int TlsCommand::process(const std::vector<std::string>& args) const
+{
+    namespace po = boost::program_options;
+
+    po::positional_options_description pos;
+    pos.add("file", 1);
+
+    po::variables_map vm;
+    {
+        po::parsed_options parsed{ po::command_line_parser(args)
+                .options(_allOptions)
+                .positional(pos)
+                .run() };
+        po::store(parsed, vm);
+    }
+
+    if (!vm.count("file") || vm["chunk-size"].as<std::size_t>() == 0)
+    {
+        displayHelp(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    processTlsCommand(vm["file"].as<std::string>(), vm.count("ktls"), vm["tls-version"].as<std::string>(), vm["iterations"].as<unsigned>(), vm["chunk-size"].as<std::size_t>());
+
+    return EXIT_SUCCESS;
+}
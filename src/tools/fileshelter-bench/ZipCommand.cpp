@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2024 Emeric Poupon
+ *
+ * This file is part of fileshelter.
+ *
+ * fileshelter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fileshelter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fileshelter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ZipCommand.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "utils/Crc32.hpp"
+#include "utils/IZipper.hpp"
+
+namespace
+{
+    // Discards the archive, only counting its size
+    class NullStreamBuffer : public std::streambuf
+    {
+    public:
+        std::uint64_t getSize() const { return _size; }
+
+    private:
+        std::streamsize xsputn(const char*, std::streamsize size) override
+        {
+            _size += size;
+            return size;
+        }
+
+        int_type overflow(int_type c) override
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                _size += 1;
+            return traits_type::not_eof(c);
+        }
+
+        std::uint64_t _size{};
+    };
+
+    std::chrono::duration<double> getProcessCpuTime()
+    {
+        ::rusage usage;
+        ::getrusage(RUSAGE_SELF, &usage);
+
+        auto toDuration{ [](const ::timeval& tv) { return std::chrono::seconds{ tv.tv_sec } + std::chrono::microseconds{ tv.tv_usec }; } };
+        return toDuration(usage.ru_utime) + toDuration(usage.ru_stime);
+    }
+
+    // Same entries as the share downloads: relative names, recorded sizes and CRCs
+    Zip::EntryContainer createEntries(const std::filesystem::path& directory, bool precomputeCrc32)
+    {
+        Zip::EntryContainer entries;
+
+        for (const std::filesystem::directory_entry& directoryEntry : std::filesystem::recursive_directory_iterator{ directory })
+        {
+            if (!directoryEntry.is_regular_file())
+                continue;
+
+            struct ::stat fileStat;
+            if (::stat(directoryEntry.path().c_str(), &fileStat) != 0)
+                throw std::runtime_error{ "Cannot stat '" + directoryEntry.path().string() + "'" };
+
+            Zip::Entry& entry{ entries.emplace_back() };
+            entry.fileName = std::filesystem::relative(directoryEntry.path(), directory).string();
+            entry.filePath = directoryEntry.path();
+            entry.size = fileStat.st_size;
+            entry.modificationTime = fileStat.st_mtime;
+            if (precomputeCrc32)
+                entry.crc32 = Crc32::computeFromFile(entry.filePath);
+        }
+
+        return entries;
+    }
+
+    std::unique_ptr<Zip::IZipper> createZipper(std::string_view format, const Zip::EntryContainer& entries, unsigned threadCount)
+    {
+        if (format == "zip-store")
+        {
+            if (Zip::canUseStoreZipper(entries))
+                return Zip::createStoreZipper(entries);
+            return Zip::createArchiveZipper(entries, Zip::Compression::Store);
+        }
+        if (format == "zip-deflate")
+            return Zip::createArchiveZipper(entries, Zip::Compression::Deflate);
+        if (format == "tar")
+            return Zip::createTarZipper(entries);
+        if (format == "tar-zst")
+            return Zip::createTarZstdZipper(entries, threadCount);
+
+        throw std::runtime_error{ "Unknown format '" + std::string{ format } + "'" };
+    }
+
+    void processZipCommand(const std::filesystem::path& directory, std::string_view format, bool precomputeCrc32, unsigned iterationCount, unsigned threadCount, const Zip::WriteBudget& budget)
+    {
+        const Zip::EntryContainer entries{ createEntries(directory, precomputeCrc32) };
+        if (entries.empty())
+            throw std::runtime_error{ "No file found in '" + directory.string() + "'" };
+
+        std::uint64_t inputSize{};
+        for (const Zip::Entry& entry : entries)
+            inputSize += entry.size;
+
+        std::cout << "Format " << format << ", " << entries.size() << " files, " << inputSize << " bytes" << (precomputeCrc32 ? ", precomputed CRCs" : "") << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+
+        for (unsigned iteration{}; iteration < iterationCount; ++iteration)
+        {
+            NullStreamBuffer streamBuffer;
+            std::ostream output{ &streamBuffer };
+
+            const auto startTime{ std::chrono::steady_clock::now() };
+            const auto startCpuTime{ getProcessCpuTime() };
+
+            std::size_t writeCount{};
+            auto zipper{ createZipper(format, entries, threadCount) };
+            while (!zipper->isComplete())
+            {
+                zipper->writeSome(output, budget);
+                writeCount++;
+            }
+
+            const std::chrono::duration<double> duration{ std::chrono::steady_clock::now() - startTime };
+            const std::chrono::duration<double> cpuTime{ getProcessCpuTime() - startCpuTime };
+            const double archiveSizeGB{ streamBuffer.getSize() / 1e9 };
+
+            std::cout << "Iteration " << iteration + 1 << ": "
+                      << streamBuffer.getSize() << " bytes in " << duration.count() << " s"
+                      << ", " << (streamBuffer.getSize() / 1e6) / duration.count() << " MB/s"
+                      << ", " << cpuTime.count() / archiveSizeGB << " CPU s/GB"
+                      << ", " << std::chrono::duration<double, std::micro>{ duration }.count() / entries.size() << " us/file"
+                      << ", " << writeCount << " writeSome calls" << std::endl;
+        }
+    }
+} // namespace
+
+ZipCommand::ZipCommand(std::string_view processArg)
+    : _processArg{ processArg }
+{
+    namespace po = boost::program_options;
+
+    po::options_description options{ "Options" };
+    options.add_options()("format", po::value<std::string>()->default_value("zip-store"), "archive format: zip-store, zip-deflate, tar or tar-zst")("crc32", "precompute the CRCs, as done for the share files")("iterations", po::value<unsigned>()->default_value(3), "number of archives to produce")("threads", po::value<unsigned>()->default_value(1), "compression threads (tar-zst)")("output-budget", po::value<std::size_t>()->default_value(Zip::WriteBudget{}.maxOutputSize), "max output bytes of each writeSome call")("input-budget", po::value<std::size_t>()->default_value(Zip::WriteBudget{}.maxInputSize), "max input bytes of each writeSome call");
+
+    po::options_description hiddenOptions{ "Hidden options" };
+    hiddenOptions.add_options()("directory", po::value<std::string>(), "directory");
+
+    _allOptions.add(options).add(hiddenOptions);
+    _visibleOptions.add(options);
+}
+
+void ZipCommand::displayHelp(std::ostream& os) const
+{
+    os << "Usage: " << _processArg << " " << getName() << " [options] directory\n";
+    os << _visibleOptions << std::endl;
+}
+
+int ZipCommand::process(const std::vector<std::string>& args) const
+{
+    namespace po = boost::program_options;
+
+    po::positional_options_description pos;
+    pos.add("directory", 1);
+
+    po::variables_map vm;
+    {
+        po::parsed_options parsed{ po::command_line_parser(args)
+                .options(_allOptions)
+                .positional(pos)
+                .run() };
+        po::store(parsed, vm);
+    }
+
+    if (!vm.count("directory"))
+    {
+        displayHelp(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    Zip::WriteBudget budget;
+    budget.maxOutputSize = vm["output-budget"].as<std::size_t>();
+    budget.maxInputSize = vm["input-budget"].as<std::size_t>();
+
+    processZipCommand(vm["directory"].as<std::string>(), vm["format"].as<std::string>(), vm.count("crc32"), vm["iterations"].as<unsigned>(), vm["threads"].as<unsigned>(), budget);
+
+    return EXIT_SUCCESS;
+}
@@ -28,6 +28,7 @@
 #include "Common.hpp"
 #include "share/CreateParameters.hpp"
 #include "share/IShareManager.hpp"
+#include "utils/Crc32.hpp"
 #include "utils/IConfig.hpp"
 #include "utils/Logger.hpp"
 #include "utils/Service.hpp"
@@ -66,7 +67,7 @@ processCreateCommand(Share::IShareManager& shareManager,
     for (const std::string& strPath : files)
     {
         const std::filesystem::path p{ std::filesystem::absolute(strPath) };
-        fileParameters.emplace_back(FileCreateParameters{ p, p.filename() });
+        fileParameters.emplace_back(FileCreateParameters{ p, p.filename(), Crc32::computeFromFile(p) });
     }
 
     const ShareDesc shareDesc{ shareManager.createShare(shareParameters, fileParameters, false /* keep ownership */) };
@@ -119,7 +120,7 @@ int CreateCommand::process(const std::vector<std::string>& args) const
     }
 
     Service<IConfig> config{ createConfig(vm["conf"].as<std::string>()) };
-    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */) };
+    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */, false /* enableBackgroundCrc32 */) };
 
     conflictingOptions(vm, "validity-hours", "validity-days");
 
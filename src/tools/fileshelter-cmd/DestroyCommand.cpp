@@ -96,7 +96,7 @@ int DestroyCommand::process(const std::vector<std::string>& args) const
     }
 
     Service<IConfig> config{ createConfig(vm["conf"].as<std::string>()) };
-    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */) };
+    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */, false /* enableBackgroundCrc32 */) };
 
     processDestroyCommand(*shareManager.get(), parseShareEditUUIDs(vm["EditUUID"].as<std::vector<std::string>>()));
 
@@ -75,7 +75,7 @@ int ListCommand::process(const std::vector<std::string>& args) const
     }
 
     Service<IConfig> config{ createConfig(vm["conf"].as<std::string>()) };
-    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */) };
+    Service<Share::IShareManager> shareManager{ Share::createShareManager(false /* enableCleaner */, false /* enableBackgroundCrc32 */) };
 
     processListCommand(*shareManager.get(), vm.count("details"), vm["url"].as<std::string>());
 